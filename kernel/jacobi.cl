@@ -6,9 +6,28 @@
  */
 
 
+/*
+ * Friction is a per contact buffer and the iteration count is a host loop for the solver kernels. The
+ * experimental kernels still use these constants, they are not launched by the solver.
+ */
+#ifndef ITER_COUNT
+#define ITER_COUNT 60
+#endif
+#ifndef MU
+#define MU 0.33f
+#endif
+
+/* DP is passed by the host when the world solves in double, the device must support cl_khr_fp64 */
+#ifdef DP
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+typedef double scalar;
+typedef double2 vec2;
+typedef double4 vec4;
+#else
 typedef float scalar;
 typedef float2 vec2;
 typedef float4 vec4;
+#endif
 typedef uint2 ivec2;
 
 typedef struct {
@@ -155,156 +174,53 @@ __kernel void jacobi_parallel(__global scalar *deltaVel, __global uint *bufBodyI
 	barrier(CLK_GLOBAL_MEM_FENCE);
 }
 
-//http://suhorukov.blogspot.ca/2011/12/opencl-11-atomic-operations-on-floating.html
-/*inline void atomicAdd(volatile __global float *source, const float operand) {
-  union {
-    unsigned int intVal;
-    float floatVal;
-  } newVal;
-  union {
-    unsigned int intVal;
-    float floatVal;
-  } prevVal;
-  do {
-    prevVal.floatVal = *source;
-    newVal.floatVal = prevVal.floatVal + operand;
-  } while (atomic_cmpxchg((volatile __global unsigned int *)source, prevVal.intVal, newVal.intVal) != prevVal.intVal);
-  // Loop until source stops changing   
-}*/
-
-//https://streamcomputing.eu/blog/2016-02-09/atomic-operations-for-floats-in-opencl-improved/
-inline void atomicAdd(volatile __global float *addr, float val) {
-  union{
-    unsigned int u32;
-    float        f32;
-  } next, expected, current;
-  current.f32    = *addr;
-  do{
-    expected.f32 = current.f32;
-    next.f32     = expected.f32 + val;
-    current.u32  = atomic_cmpxchg( (volatile __global unsigned int *)addr, 
-	expected.u32, next.u32);
-  } while( current.u32 != expected.u32 );
-}
-
 // Kernel 2
-__kernel void jacobi_serial(volatile __global scalar *bufDeltaVel,  __global uint *bufBodyIndex, __global scalar *bufConstNormalM_A,
-	__global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B, __global scalar *bufConstTangentM_B, 
-	__global scalar *bufDeltaLambda) {
-	
-  size_t i = get_global_id(0);
-  ivec2 bodyIndex = ipack2(&bufBodyIndex[i << 1]);
-  vec6 constNormalM_A = pack6(&bufConstNormalM_A[6 * i]);
-  vec6 constNormalM_B = pack6(&bufConstNormalM_B[6 * i]);
-  vec6 constTangentM_A = pack6(&bufConstTangentM_A[6 * i]);
-  vec6 constTangentM_B = pack6(&bufConstTangentM_B[6 * i]);
-  vec2 deltaLambda = pack2(&bufDeltaLambda[i << 1]);
-	
-  vec6 deltaVelA;
-  vec6 deltaVelB;
-  
-  deltaVelA.vLin = add3(mul3s(constNormalM_A.vLin, deltaLambda.x), mul3s(constTangentM_A.vLin, deltaLambda.y));
-  deltaVelA.vAng = add3(mul3s(constNormalM_A.vAng, deltaLambda.x), mul3s(constTangentM_A.vAng, deltaLambda.y));
-
-  deltaVelB.vLin = add3(mul3s(constNormalM_B.vLin, deltaLambda.x), mul3s(constTangentM_B.vLin, deltaLambda.y));
-  deltaVelB.vAng = add3(mul3s(constNormalM_B.vAng, deltaLambda.x), mul3s(constTangentM_B.vAng, deltaLambda.y));
-
-  volatile __global scalar *ptrA = &bufDeltaVel[6 * bodyIndex.x];
-  volatile __global scalar *ptrB = &bufDeltaVel[6 * bodyIndex.y];
-	
-  atomicAdd(&ptrA[0], deltaVelA.vLin.ab.x);
-  atomicAdd(&ptrA[1], deltaVelA.vLin.ab.y);
-  atomicAdd(&ptrA[2], deltaVelA.vLin.c);
-  atomicAdd(&ptrA[3], deltaVelA.vAng.ab.x);
-  atomicAdd(&ptrA[4], deltaVelA.vAng.ab.y);
-  atomicAdd(&ptrA[5], deltaVelA.vAng.c);
-	
-  atomicAdd(&ptrB[0], deltaVelB.vLin.ab.x);
-  atomicAdd(&ptrB[1], deltaVelB.vLin.ab.y);
-  atomicAdd(&ptrB[2], deltaVelB.vLin.c);
-  atomicAdd(&ptrB[3], deltaVelB.vAng.ab.x);
-  atomicAdd(&ptrB[4], deltaVelB.vAng.ab.y);
-  atomicAdd(&ptrB[5], deltaVelB.vAng.c);
-	
-  barrier(CLK_GLOBAL_MEM_FENCE);
-}
-
-// Kernel 3
-__kernel void jacobi_comb(volatile __global scalar *deltaVel, __global uint *bufBodyIndex, __global scalar *bufConstNormalD_A,
+/*
+ * Contact half of a gather based Jacobi iteration. Every contact reads the deltaVel of the previous
+ * iteration and writes its delta lambda, jacobi_body then applies them. Nothing is scattered, so there
+ * are no atomics and the cost does not depend on how many contacts share a body.
+ */
+__kernel void jacobi_contact(__global scalar *deltaVel, __global uint *bufBodyIndex, __global scalar *bufConstNormalD_A,
 	__global scalar *bufConstTangentD_A, __global scalar *bufConstNormalD_B, __global scalar *bufConstTangentD_B,
-	__global scalar *bufConstNormalM_A, __global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B, 
-	__global scalar *bufConstTangentM_B, __global scalar *bufB, uint numContacts)
+	__global scalar *bufB, __global scalar *bufLambda, __global scalar *bufDeltaLambda, __global scalar *bufMaterial,
+	__global scalar *bufResidual, uint numContacts)
 {
   size_t i = get_global_id(0);
+  if (i >= numContacts)
+    return;
+
   ivec2 bodyIndex = ipack2(&bufBodyIndex[i<<1]);
   vec6 constNormalD_A = pack6(&bufConstNormalD_A[6 * i]);
   vec6 constNormalD_B = pack6(&bufConstNormalD_B[6 * i]);
   vec6 constTangentD_A = pack6(&bufConstTangentD_A[6 * i]);
   vec6 constTangentD_B = pack6(&bufConstTangentD_B[6 * i]);
-  vec6 constNormalM_A = pack6(&bufConstNormalM_A[6 * i]);
-  vec6 constNormalM_B = pack6(&bufConstNormalM_B[6 * i]);
-  vec6 constTangentM_A = pack6(&bufConstTangentM_A[6 * i]);
-  vec6 constTangentM_B = pack6(&bufConstTangentM_B[6 * i]);
+  vec2 lambda = pack2(&bufLambda[i<<1]);
   vec2 b = pack2(&bufB[i<<1]);
+  vec6 deltaVelA = pack6(&deltaVel[6 * bodyIndex.x]);
+  vec6 deltaVelB = pack6(&deltaVel[6 * bodyIndex.y]);
 
-  scalar lambda1;
-  scalar lambda2;
-  lambda1 = 0;
-  lambda2 = 0;
-  
-  int iter;
-   
-  volatile __global scalar *ptrA = &deltaVel[6 * bodyIndex.x];
-  volatile __global scalar *ptrB = &deltaVel[6 * bodyIndex.y];
-  
-  if (i < numContacts)
-  for (iter = 0; iter < ITER_COUNT; iter++) {
-	vec6 deltaVelA = pack6(ptrA);
-	vec6 deltaVelB = pack6(ptrB);
-	
-	scalar lambda_final1 = lambda1 - b.x - dot3(constNormalD_A.vLin, deltaVelA.vLin)
-	    		- dot3(constNormalD_A.vAng, deltaVelA.vAng) - dot3(constNormalD_B.vLin, deltaVelB.vLin)
-    			- dot3(constNormalD_B.vAng, deltaVelB.vAng);
-	scalar lambda_final2 = lambda2 - b.y - dot3(constTangentD_A.vLin, deltaVelA.vLin)
-	    		- dot3(constTangentD_A.vAng, deltaVelA.vAng) - dot3(constTangentD_B.vLin, deltaVelB.vLin)
-    			- dot3(constTangentD_B.vAng, deltaVelB.vAng);
-	
-	//show6(constNormalD_A);
-	//printf("%f %f\n", lambda_final1, lambda_final2);		
-	lambda_final1 = (lambda_final1 < 0) ? 0 : lambda_final1;
-	scalar max_tangent1 = MU * lambda_final1;
-	lambda_final2 = (lambda_final2 < -max_tangent1) ? -max_tangent1 : lambda_final2;
-	lambda_final2 = (lambda_final2 > max_tangent1) ? max_tangent1 : lambda_final2;
-	
-	scalar deltaLambda1;
-	scalar deltaLambda2;
-	deltaLambda1 = lambda_final1 - lambda1;
-	deltaLambda2 = lambda_final2 - lambda2;
-	lambda1 = lambda_final1;
-	lambda2 = lambda_final2;
-	
-	deltaVelA.vLin = add3(mul3s(constNormalM_A.vLin, deltaLambda1), mul3s(constTangentM_A.vLin, deltaLambda2));
-	deltaVelA.vAng = add3(mul3s(constNormalM_A.vAng, deltaLambda1), mul3s(constTangentM_A.vAng, deltaLambda2));
+  scalar lambda_final1 = lambda.x - b.x - dot3(constNormalD_A.vLin, deltaVelA.vLin)
+    		- dot3(constNormalD_A.vAng, deltaVelA.vAng) - dot3(constNormalD_B.vLin, deltaVelB.vLin)
+    		- dot3(constNormalD_B.vAng, deltaVelB.vAng);
+  scalar lambda_final2 = lambda.y - b.y - dot3(constTangentD_A.vLin, deltaVelA.vLin)
+    		- dot3(constTangentD_A.vAng, deltaVelA.vAng) - dot3(constTangentD_B.vLin, deltaVelB.vLin)
+    		- dot3(constTangentD_B.vAng, deltaVelB.vAng);
 
-	deltaVelB.vLin = add3(mul3s(constNormalM_B.vLin, deltaLambda1), mul3s(constTangentM_B.vLin, deltaLambda2));
-	deltaVelB.vAng = add3(mul3s(constNormalM_B.vAng, deltaLambda1), mul3s(constTangentM_B.vAng, deltaLambda2));
-	
-	atomicAdd(&ptrA[0], deltaVelA.vLin.ab.x);
-	atomicAdd(&ptrA[1], deltaVelA.vLin.ab.y);
-	atomicAdd(&ptrA[2], deltaVelA.vLin.c);
-	atomicAdd(&ptrA[3], deltaVelA.vAng.ab.x);
-	atomicAdd(&ptrA[4], deltaVelA.vAng.ab.y);
-	atomicAdd(&ptrA[5], deltaVelA.vAng.c);
-	
-	atomicAdd(&ptrB[0], deltaVelB.vLin.ab.x);
-	atomicAdd(&ptrB[1], deltaVelB.vLin.ab.y);
-	atomicAdd(&ptrB[2], deltaVelB.vLin.c);
-	atomicAdd(&ptrB[3], deltaVelB.vAng.ab.x);
-	atomicAdd(&ptrB[4], deltaVelB.vAng.ab.y);
-	atomicAdd(&ptrB[5], deltaVelB.vAng.c);
-	
-	barrier(CLK_GLOBAL_MEM_FENCE);
-  }
+  lambda_final1 = (lambda_final1 < 0) ? 0 : lambda_final1;
+  scalar max_tangent1 = bufMaterial[i<<1] * lambda_final1;
+  lambda_final2 = (lambda_final2 < -max_tangent1) ? -max_tangent1 : lambda_final2;
+  lambda_final2 = (lambda_final2 > max_tangent1) ? max_tangent1 : lambda_final2;
+
+  vec2 deltaLambda;
+  deltaLambda.x = lambda_final1 - lambda.x;
+  deltaLambda.y = lambda_final2 - lambda.y;
+  lambda.x = lambda_final1;
+  lambda.y = lambda_final2;
+  unpack2(&bufDeltaLambda[i<<1], deltaLambda);
+  unpack2(&bufLambda[i<<1], lambda);
+
+  bufResidual[i<<1] = deltaLambda.x * deltaLambda.x + deltaLambda.y * deltaLambda.y;
+  bufResidual[(i<<1) + 1] = lambda.x * lambda.x + lambda.y * lambda.y;
 }
 
 /*
@@ -348,303 +264,7 @@ __kernel void jacobi_comb(volatile __global scalar *deltaVel, __global uint *buf
 
 */
 
-// Kernel 4
-__kernel void jacobi_v2(volatile __global scalar *deltaVel, __global uint *bufBodyIndex, __global scalar *bufConstNormalD_A,
-	__global scalar *bufConstTangentD_A, __global scalar *bufConstNormalD_B, __global scalar *bufConstTangentD_B,
-	__global scalar *bufConstNormalM_A, __global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B, 
-	__global scalar *bufConstTangentM_B, __global scalar *bufB, __global scalar *bufLambda, uint numContacts,
-	__local uint *s_bufBodyIndex, __local scalar *s_bufConstNormalM_A, __local scalar *s_bufConstTangentM_A,
-	__local scalar *s_bufConstNormalM_B, __local scalar *s_bufConstTangentM_B)
-{
-  size_t i = get_global_id(0);
-  ivec2 bodyIndex = ipack2(&bufBodyIndex[i<<1]);
-  vec6 constNormalD_A = pack6(&bufConstNormalD_A[6 * i]);
-  vec6 constNormalD_B = pack6(&bufConstNormalD_B[6 * i]);
-  vec6 constTangentD_A = pack6(&bufConstTangentD_A[6 * i]);
-  vec6 constTangentD_B = pack6(&bufConstTangentD_B[6 * i]);
-  vec6 constNormalM_A = pack6(&bufConstNormalM_A[6 * i]);
-  vec6 constNormalM_B = pack6(&bufConstNormalM_B[6 * i]);
-  vec6 constTangentM_A = pack6(&bufConstTangentM_A[6 * i]);
-  vec6 constTangentM_B = pack6(&bufConstTangentM_B[6 * i]);
-  vec2 b = pack2(&bufB[i<<1]);
-  vec2 lambda;
-  
-  lambda.x = 0;
-  lambda.y = 0;
-  uint iter;
-  uint s;
-  
-  for (s = get_local_id(0); s < numContacts; s += get_local_size(0)) {
-    uint temp = s << 1;
-    s_bufBodyIndex[temp] = bufBodyIndex[temp];
-    s_bufBodyIndex[temp + 1] = bufBodyIndex[temp + 1];
-    temp = s * 6;
-    s_bufConstNormalM_A[temp] = bufConstNormalM_A[temp];
-    s_bufConstNormalM_A[temp + 1] = bufConstNormalM_A[temp + 1];
-    s_bufConstNormalM_A[temp + 2] = bufConstNormalM_A[temp + 2];
-    s_bufConstNormalM_A[temp + 3] = bufConstNormalM_A[temp + 3];
-    s_bufConstNormalM_A[temp + 4] = bufConstNormalM_A[temp + 4];
-    s_bufConstNormalM_A[temp + 5] = bufConstNormalM_A[temp + 5];
-    
-    s_bufConstTangentM_A[temp] = bufConstTangentM_A[temp];
-    s_bufConstTangentM_A[temp + 1] = bufConstTangentM_A[temp + 1];
-    s_bufConstTangentM_A[temp + 2] = bufConstTangentM_A[temp + 2];
-    s_bufConstTangentM_A[temp + 3] = bufConstTangentM_A[temp + 3];
-    s_bufConstTangentM_A[temp + 4] = bufConstTangentM_A[temp + 4];
-    s_bufConstTangentM_A[temp + 5] = bufConstTangentM_A[temp + 5];
-    
-    s_bufConstNormalM_B[temp] = bufConstNormalM_B[temp];
-    s_bufConstNormalM_B[temp + 1] = bufConstNormalM_B[temp + 1];
-    s_bufConstNormalM_B[temp + 2] = bufConstNormalM_B[temp + 2];
-    s_bufConstNormalM_B[temp + 3] = bufConstNormalM_B[temp + 3];
-    s_bufConstNormalM_B[temp + 4] = bufConstNormalM_B[temp + 4];
-    s_bufConstNormalM_B[temp + 5] = bufConstNormalM_B[temp + 5];
-    
-    s_bufConstTangentM_B[temp] = bufConstTangentM_B[temp];
-    s_bufConstTangentM_B[temp + 1] = bufConstTangentM_B[temp + 1];
-    s_bufConstTangentM_B[temp + 2] = bufConstTangentM_B[temp + 2];
-    s_bufConstTangentM_B[temp + 3] = bufConstTangentM_B[temp + 3];
-    s_bufConstTangentM_B[temp + 4] = bufConstTangentM_B[temp + 4];
-    s_bufConstTangentM_B[temp + 5] = bufConstTangentM_B[temp + 5];
-  }
-  barrier(CLK_LOCAL_MEM_FENCE);
-    
-  volatile __global scalar *ptrA = &deltaVel[6 * bodyIndex.x];
-  volatile __global scalar *ptrB = &deltaVel[6 * bodyIndex.y];
-  
-  for (iter = 0; iter < ITER_COUNT; iter++) {
-    scalar a1 = 0;
-    scalar a2 = 0;
-    uint j;
-    for (j = 0; j < numContacts; j++) {
-      ivec2 bodyIndexI = s_ipack2(&s_bufBodyIndex[j<<1]);
-      vec2 lambdaI;
-      if (bodyIndex.x == bodyIndexI.x || bodyIndex.x == bodyIndexI.y || bodyIndex.y == bodyIndexI.x ||  bodyIndex.y == bodyIndexI.y){
-	lambdaI = pack2(&bufLambda[j<<1]);
-	//vec6 cnA = pack6(&bufConstNormalM_A[6 * j]);
-      }
-      if (bodyIndex.x == bodyIndexI.x){
-	vec6 cnA = s_pack6(&s_bufConstNormalM_A[6 * j]);
-	vec6 ctA = s_pack6(&s_bufConstTangentM_A[6 * j]);
-	a1 += dot6(constNormalD_A, cnA) * lambdaI.x + dot6(constNormalD_A, ctA) * lambdaI.y;
-	a2 += dot6(constTangentD_A, cnA) * lambdaI.x + dot6(constTangentD_A, ctA) * lambdaI.y;
-      }
-      else if (bodyIndex.x == bodyIndexI.y){
-	//vec2 lambdaI = pack2(&bufLambda[j<<1]);
-      
-	vec6 cnB = s_pack6(&s_bufConstNormalM_B[6 * j]);
-	vec6 ctB = s_pack6(&s_bufConstTangentM_B[6 * j]);
-	a1 += dot6(constNormalD_A, cnB) * lambdaI.x + dot6(constNormalD_A, ctB) * lambdaI.y;
-	a2 += dot6(constTangentD_A, cnB) * lambdaI.x + dot6(constTangentD_A, ctB) * lambdaI.y;
-      }
-      if (bodyIndex.y == bodyIndexI.x){
-	//vec2 lambdaI = pack2(&bufLambda[j<<1]);
-      
-	vec6 cnA = s_pack6(&s_bufConstNormalM_A[6 * j]);
-	vec6 ctA = s_pack6(&s_bufConstTangentM_A[6 * j]);
-	a1 += dot6(constNormalD_B, cnA) * lambdaI.x + dot6(constNormalD_B, ctA) * lambdaI.y;
-	a2 += dot6(constTangentD_B, cnA) * lambdaI.x + dot6(constTangentD_B, ctA) * lambdaI.y;
-      }
-      else if (bodyIndex.y == bodyIndexI.y){
-	//vec2 lambdaI = pack2(&bufLambda[j<<1]);
-	vec6 cnB = s_pack6(&s_bufConstNormalM_B[6 * j]);
-	vec6 ctB = s_pack6(&s_bufConstTangentM_B[6 * j]);
-	a1 += dot6(constNormalD_B, cnB) * lambdaI.x + dot6(constNormalD_B, ctB) * lambdaI.y;
-	a2 += dot6(constTangentD_B, cnB) * lambdaI.x + dot6(constTangentD_B, ctB) * lambdaI.y;
-      }
-    }
-    
-    lambda.x = lambda.x - b.x - a1;
-    lambda.y = lambda.y - b.y - a2;
-    
-    lambda.x = (lambda.x < 0) ? 0 : lambda.x;
-    scalar max_tangent1 = MU * lambda.x;
-    lambda.y = (lambda.y < -max_tangent1) ? -max_tangent1 : lambda.y;
-    lambda.y = (lambda.y > max_tangent1) ? max_tangent1 : lambda.y;
-        
-    unpack2(&bufLambda[i<<1], lambda);
-    
-    barrier(CLK_GLOBAL_MEM_FENCE);
-  }
-  
-  vec6 deltaVelA;
-  vec6 deltaVelB;
-  
-  deltaVelA.vLin = add3(mul3s(constNormalM_A.vLin, lambda.x), mul3s(constTangentM_A.vLin, lambda.y));
-  deltaVelA.vAng = add3(mul3s(constNormalM_A.vAng, lambda.x), mul3s(constTangentM_A.vAng, lambda.y));
-
-  deltaVelB.vLin = add3(mul3s(constNormalM_B.vLin, lambda.x), mul3s(constTangentM_B.vLin, lambda.y));
-  deltaVelB.vAng = add3(mul3s(constNormalM_B.vAng, lambda.x), mul3s(constTangentM_B.vAng, lambda.y));
-	
-  atomicAdd(&ptrA[0], deltaVelA.vLin.ab.x);
-  atomicAdd(&ptrA[1], deltaVelA.vLin.ab.y);
-  atomicAdd(&ptrA[2], deltaVelA.vLin.c);
-  atomicAdd(&ptrA[3], deltaVelA.vAng.ab.x);
-  atomicAdd(&ptrA[4], deltaVelA.vAng.ab.y);
-  atomicAdd(&ptrA[5], deltaVelA.vAng.c);
-	
-  atomicAdd(&ptrB[0], deltaVelB.vLin.ab.x);
-  atomicAdd(&ptrB[1], deltaVelB.vLin.ab.y);
-  atomicAdd(&ptrB[2], deltaVelB.vLin.c);
-  atomicAdd(&ptrB[3], deltaVelB.vAng.ab.x);
-  atomicAdd(&ptrB[4], deltaVelB.vAng.ab.y);
-  atomicAdd(&ptrB[5], deltaVelB.vAng.c);
-}
-
-// Kernel 5 
-__kernel void jacobi_v3(volatile __global scalar *deltaVel, __global ivec2 *bufBodyIndex, __global scalar *bufConstNormalD_A,
-	__global scalar *bufConstTangentD_A, __global scalar *bufConstNormalD_B, __global scalar *bufConstTangentD_B,
-	__global scalar *bufConstNormalM_A, __global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B, 
-	__global scalar *bufConstTangentM_B, __global vec2 *bufB, __global vec2 *bufLambda, __global vec4 *matrixA, uint numContacts,
-	__local ivec2 *s_bufBodyIndex, __local scalar *s_bufConstNormalM_A, __local scalar *s_bufConstTangentM_A,
-	__local scalar *s_bufConstNormalM_B, __local scalar *s_bufConstTangentM_B)
-{
-  size_t i = get_global_id(0);
-  ivec2 bodyIndex = bufBodyIndex[i];
- {
-    vec6 constNormalD_A = pack6(&bufConstNormalD_A[6 * i]);
-    vec6 constNormalD_B = pack6(&bufConstNormalD_B[6 * i]);
-    vec6 constTangentD_A = pack6(&bufConstTangentD_A[6 * i]);
-    vec6 constTangentD_B = pack6(&bufConstTangentD_B[6 * i]);
- 
-    uint s;
-    for (s = get_local_id(0); s < numContacts; s += get_local_size(0)) {
-	s_bufBodyIndex[s] = bufBodyIndex[s];
-   
-	uint temp = s * 6;
-	s_bufConstNormalM_A[temp] = bufConstNormalM_A[temp];
-	s_bufConstNormalM_A[temp + 1] = bufConstNormalM_A[temp + 1];
-	s_bufConstNormalM_A[temp + 2] = bufConstNormalM_A[temp + 2];
-	s_bufConstNormalM_A[temp + 3] = bufConstNormalM_A[temp + 3];
-	s_bufConstNormalM_A[temp + 4] = bufConstNormalM_A[temp + 4];
-	s_bufConstNormalM_A[temp + 5] = bufConstNormalM_A[temp + 5];
-    
-	s_bufConstTangentM_A[temp] = bufConstTangentM_A[temp];
-	s_bufConstTangentM_A[temp + 1] = bufConstTangentM_A[temp + 1];
-	s_bufConstTangentM_A[temp + 2] = bufConstTangentM_A[temp + 2];
-	s_bufConstTangentM_A[temp + 3] = bufConstTangentM_A[temp + 3];
-	s_bufConstTangentM_A[temp + 4] = bufConstTangentM_A[temp + 4];
-	s_bufConstTangentM_A[temp + 5] = bufConstTangentM_A[temp + 5];
-    
-	s_bufConstNormalM_B[temp] = bufConstNormalM_B[temp];
-	s_bufConstNormalM_B[temp + 1] = bufConstNormalM_B[temp + 1];
-	s_bufConstNormalM_B[temp + 2] = bufConstNormalM_B[temp + 2];
-	s_bufConstNormalM_B[temp + 3] = bufConstNormalM_B[temp + 3];
-	s_bufConstNormalM_B[temp + 4] = bufConstNormalM_B[temp + 4];
-	s_bufConstNormalM_B[temp + 5] = bufConstNormalM_B[temp + 5];
-    
-	s_bufConstTangentM_B[temp] = bufConstTangentM_B[temp];
-	s_bufConstTangentM_B[temp + 1] = bufConstTangentM_B[temp + 1];
-	s_bufConstTangentM_B[temp + 2] = bufConstTangentM_B[temp + 2];
-	s_bufConstTangentM_B[temp + 3] = bufConstTangentM_B[temp + 3];
-	s_bufConstTangentM_B[temp + 4] = bufConstTangentM_B[temp + 4];
-	s_bufConstTangentM_B[temp + 5] = bufConstTangentM_B[temp + 5];
-    }
-    barrier(CLK_LOCAL_MEM_FENCE);
-  
-    for (s = 0; s < numContacts; s++) {
-      ivec2 bodyIndexI = s_bufBodyIndex[s];
-      uint temp = s * 6;
-      vec4 a;
-      a.x = 0, a.y = 0, a.z = 0, a.w = 0;
-      if (bodyIndex.x == bodyIndexI.x) {
-	  vec6 cnA = s_pack6(&s_bufConstNormalM_A[temp]);
-	  vec6 ctA = s_pack6(&s_bufConstTangentM_A[temp]);
-	  a.x = dot6(constNormalD_A, cnA); a.y = dot6(constNormalD_A, ctA);
-	  a.z = dot6(constTangentD_A, cnA); a.w = dot6(constTangentD_A, ctA);
-      }
-      else if (bodyIndex.x == bodyIndexI.y) {
-	  vec6 cnB = s_pack6(&s_bufConstNormalM_B[temp]);
-	  vec6 ctB = s_pack6(&s_bufConstTangentM_B[temp]);
-	  a.x = dot6(constNormalD_A, cnB); a.y = dot6(constNormalD_A, ctB);
-	  a.z = dot6(constTangentD_A, cnB); a.w = dot6(constTangentD_A, ctB);
-      }
-      if (bodyIndex.y == bodyIndexI.x) {
-	  vec6 cnA = s_pack6(&s_bufConstNormalM_A[temp]);
-	  vec6 ctA = s_pack6(&s_bufConstTangentM_A[temp]);
-	  a.x += dot6(constNormalD_B, cnA); a.y += dot6(constNormalD_B, ctA);
-	  a.z += dot6(constTangentD_B, cnA); a.w += dot6(constTangentD_B, ctA);
-      }
-      else if (bodyIndex.y == bodyIndexI.y) {
-	  vec6 cnB = s_pack6(&s_bufConstNormalM_B[temp]);
-	  vec6 ctB = s_pack6(&s_bufConstTangentM_B[temp]);
-	  a.x += dot6(constNormalD_B, cnB); a.y += dot6(constNormalD_B, ctB);
-	  a.z += dot6(constTangentD_B, cnB); a.w += dot6(constTangentD_B, ctB);
-      }
-       
-      matrixA[s * numContacts + i] = a;
-    }
-  }
-  
-  barrier(CLK_GLOBAL_MEM_FENCE);
-  vec2 lambda;
-  lambda.x = 0;
-  lambda.y = 0;
-  
-  {
-    vec2 b = bufB[i];
-    uint iter;
-  
-    for (iter = 0; iter < ITER_COUNT; iter++) {
-      scalar a1 = 0;
-      scalar a2 = 0;
-      uint j;
-      for (j = 0; j < numContacts; j++) {
-	vec4 a =  matrixA[j * numContacts + i];
-	vec2 lambdaI = bufLambda[j];
-	a1 += a.x * lambdaI.x + a.y * lambdaI.y;
-	a2 += a.z * lambdaI.x + a.w * lambdaI.y;
-      }
-    
-      lambda.x = lambda.x - b.x - a1;
-      lambda.y = lambda.y - b.y - a2;
-    
-      lambda.x = (lambda.x < 0) ? 0 : lambda.x;
-      scalar max_tangent1 = MU * lambda.x;
-      lambda.y = (lambda.y < -max_tangent1) ? -max_tangent1 : lambda.y;
-      lambda.y = (lambda.y > max_tangent1) ? max_tangent1 : lambda.y;
-        
-      bufLambda[i] = lambda;
-    
-      barrier(CLK_GLOBAL_MEM_FENCE);
-    }
-  }
-  
-  {
-    volatile __global scalar *ptrA = &deltaVel[6 * bodyIndex.x];
-    volatile __global scalar *ptrB = &deltaVel[6 * bodyIndex.y];
-  
-    vec6 constNormalM_A = pack6(&bufConstNormalM_A[6 * i]);
-    vec6 constNormalM_B = pack6(&bufConstNormalM_B[6 * i]);
-    vec6 constTangentM_A = pack6(&bufConstTangentM_A[6 * i]);
-    vec6 constTangentM_B = pack6(&bufConstTangentM_B[6 * i]);
-  
-    vec6 deltaVelA;
-    vec6 deltaVelB;
-  
-    deltaVelA.vLin = add3(mul3s(constNormalM_A.vLin, lambda.x), mul3s(constTangentM_A.vLin, lambda.y));
-    deltaVelA.vAng = add3(mul3s(constNormalM_A.vAng, lambda.x), mul3s(constTangentM_A.vAng, lambda.y));
-
-    deltaVelB.vLin = add3(mul3s(constNormalM_B.vLin, lambda.x), mul3s(constTangentM_B.vLin, lambda.y));
-    deltaVelB.vAng = add3(mul3s(constNormalM_B.vAng, lambda.x), mul3s(constTangentM_B.vAng, lambda.y));
-	
-    atomicAdd(&ptrA[0], deltaVelA.vLin.ab.x);
-    atomicAdd(&ptrA[1], deltaVelA.vLin.ab.y);
-    atomicAdd(&ptrA[2], deltaVelA.vLin.c);
-    atomicAdd(&ptrA[3], deltaVelA.vAng.ab.x);
-    atomicAdd(&ptrA[4], deltaVelA.vAng.ab.y);
-    atomicAdd(&ptrA[5], deltaVelA.vAng.c);
-	
-    atomicAdd(&ptrB[0], deltaVelB.vLin.ab.x);
-    atomicAdd(&ptrB[1], deltaVelB.vLin.ab.y);
-    atomicAdd(&ptrB[2], deltaVelB.vLin.c);
-    atomicAdd(&ptrB[3], deltaVelB.vAng.ab.x);
-    atomicAdd(&ptrB[4], deltaVelB.vAng.ab.y);
-    atomicAdd(&ptrB[5], deltaVelB.vAng.c);
-  }
-}
-
-// Kernel 6
+// Kernel 3
 __kernel void jacobi_v3_split1(__global ivec2 *bufBodyIndex, __global scalar *bufConstNormalD_A,
 	__global scalar *bufConstTangentD_A, __global scalar *bufConstNormalD_B, __global scalar *bufConstTangentD_B,
 	__global scalar *bufConstNormalM_A, __global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B, 
@@ -730,162 +350,6 @@ __kernel void jacobi_v3_split1(__global ivec2 *bufBodyIndex, __global scalar *bu
   }
 }
 
-// Kernel 7
-__kernel void jacobi_v3_split2(volatile __global scalar *deltaVel, __global ivec2 *bufBodyIndex, __global scalar *bufConstNormalM_A, 
-	__global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B, __global scalar *bufConstTangentM_B, 
-	__global vec2 *bufB, __global vec2 *bufLambda, __global vec4 *matrixA, uint numContacts) {
-  
-  size_t i = get_global_id(0);
-  ivec2 bodyIndex = bufBodyIndex[i];
-  
-  vec2 lambda;
-  lambda.x = 0;
-  lambda.y = 0;
-  
-  {
-    vec2 b = bufB[i];
-    uint iter;
-  
-    for (iter = 0; iter < ITER_COUNT; iter++) {
-      scalar a1 = 0;
-      scalar a2 = 0;
-      uint j;
-      for (j = 0; j < numContacts; j++) {
-	vec4 a =  matrixA[i * numContacts + j];
-	vec2 lambdaI = bufLambda[j];
-	a1 += a.x * lambdaI.x + a.y * lambdaI.y;
-	a2 += a.z * lambdaI.x + a.w * lambdaI.y;
-      }
-    
-      lambda.x = lambda.x - b.x - a1;
-      lambda.y = lambda.y - b.y - a2;
-    
-      lambda.x = (lambda.x < 0) ? 0 : lambda.x;
-      scalar max_tangent1 = MU * lambda.x;
-      lambda.y = (lambda.y < -max_tangent1) ? -max_tangent1 : lambda.y;
-      lambda.y = (lambda.y > max_tangent1) ? max_tangent1 : lambda.y;
-        
-      barrier(CLK_GLOBAL_MEM_FENCE);
-      bufLambda[i] = lambda;
-      barrier(CLK_GLOBAL_MEM_FENCE);
-      
-    }
-  }
-  
-  {
-    volatile __global scalar *ptrA = &deltaVel[6 * bodyIndex.x];
-    volatile __global scalar *ptrB = &deltaVel[6 * bodyIndex.y];
-  
-    vec6 constNormalM_A = pack6(&bufConstNormalM_A[6 * i]);
-    vec6 constNormalM_B = pack6(&bufConstNormalM_B[6 * i]);
-    vec6 constTangentM_A = pack6(&bufConstTangentM_A[6 * i]);
-    vec6 constTangentM_B = pack6(&bufConstTangentM_B[6 * i]);
-  
-    vec6 deltaVelA;
-    vec6 deltaVelB;
-  
-    deltaVelA.vLin = add3(mul3s(constNormalM_A.vLin, lambda.x), mul3s(constTangentM_A.vLin, lambda.y));
-    deltaVelA.vAng = add3(mul3s(constNormalM_A.vAng, lambda.x), mul3s(constTangentM_A.vAng, lambda.y));
-
-    deltaVelB.vLin = add3(mul3s(constNormalM_B.vLin, lambda.x), mul3s(constTangentM_B.vLin, lambda.y));
-    deltaVelB.vAng = add3(mul3s(constNormalM_B.vAng, lambda.x), mul3s(constTangentM_B.vAng, lambda.y));
-	
-    atomicAdd(&ptrA[0], deltaVelA.vLin.ab.x);
-    atomicAdd(&ptrA[1], deltaVelA.vLin.ab.y);
-    atomicAdd(&ptrA[2], deltaVelA.vLin.c);
-    atomicAdd(&ptrA[3], deltaVelA.vAng.ab.x);
-    atomicAdd(&ptrA[4], deltaVelA.vAng.ab.y);
-    atomicAdd(&ptrA[5], deltaVelA.vAng.c);
-	
-    atomicAdd(&ptrB[0], deltaVelB.vLin.ab.x);
-    atomicAdd(&ptrB[1], deltaVelB.vLin.ab.y);
-    atomicAdd(&ptrB[2], deltaVelB.vLin.c);
-    atomicAdd(&ptrB[3], deltaVelB.vAng.ab.x);
-    atomicAdd(&ptrB[4], deltaVelB.vAng.ab.y);
-    atomicAdd(&ptrB[5], deltaVelB.vAng.c);
-  }
-}
-
-// Kernel 8
-__kernel void jacobi_comb_v4(volatile __global scalar *deltaVel, __global uint *bufBodyIndex, __global scalar *bufConstNormalD_A,
-	__global scalar *bufConstTangentD_A, __global scalar *bufConstNormalD_B, __global scalar *bufConstTangentD_B,
-	__global scalar *bufConstNormalM_A, __global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B, 
-	__global scalar *bufConstTangentM_B, __global scalar *bufB, __global scalar *bufLambda)
-{
-  size_t i = get_global_id(0);
-  ivec2 bodyIndex = ipack2(&bufBodyIndex[i<<1]);
-  vec6 constNormalD_A = pack6(&bufConstNormalD_A[6 * i]);
-  vec6 constNormalD_B = pack6(&bufConstNormalD_B[6 * i]);
-  vec6 constTangentD_A = pack6(&bufConstTangentD_A[6 * i]);
-  vec6 constTangentD_B = pack6(&bufConstTangentD_B[6 * i]);
-  vec6 constNormalM_A = pack6(&bufConstNormalM_A[6 * i]);
-  vec6 constNormalM_B = pack6(&bufConstNormalM_B[6 * i]);
-  vec6 constTangentM_A = pack6(&bufConstTangentM_A[6 * i]);
-  vec6 constTangentM_B = pack6(&bufConstTangentM_B[6 * i]);
-  vec2 b = pack2(&bufB[i<<1]);
-
-  scalar lambda1;
-  scalar lambda2;
-  lambda1 = 0;
-  lambda2 = 0;
-  
-  int iter;
-  
-  volatile __global scalar *ptrA = &deltaVel[6 * bodyIndex.x];
-  volatile __global scalar *ptrB = &deltaVel[6 * bodyIndex.y];
-  
-  for (iter = 0; iter < ITER_COUNT; iter++) {
-	vec6 deltaVelA = pack6(ptrA);
-	vec6 deltaVelB = pack6(ptrB);
-	
-	scalar lambda_final1 = lambda1 - b.x - dot3(constNormalD_A.vLin, deltaVelA.vLin)
-	    		- dot3(constNormalD_A.vAng, deltaVelA.vAng) - dot3(constNormalD_B.vLin, deltaVelB.vLin)
-    			- dot3(constNormalD_B.vAng, deltaVelB.vAng);
-	scalar lambda_final2 = lambda2 - b.y - dot3(constTangentD_A.vLin, deltaVelA.vLin)
-	    		- dot3(constTangentD_A.vAng, deltaVelA.vAng) - dot3(constTangentD_B.vLin, deltaVelB.vLin)
-    			- dot3(constTangentD_B.vAng, deltaVelB.vAng);
-	
-	//show6(constNormalD_A);
-	//printf("%f %f\n", lambda_final1, lambda_final2);		
-	lambda_final1 = (lambda_final1 < 0) ? 0 : lambda_final1;
-	scalar max_tangent1 = MU * lambda_final1;
-	lambda_final2 = (lambda_final2 < -max_tangent1) ? -max_tangent1 : lambda_final2;
-	lambda_final2 = (lambda_final2 > max_tangent1) ? max_tangent1 : lambda_final2;
-	
-	scalar deltaLambda1;
-	scalar deltaLambda2;
-	deltaLambda1 = lambda_final1 - lambda1;
-	deltaLambda2 = lambda_final2 - lambda2;
-	lambda1 = lambda_final1;
-	lambda2 = lambda_final2;
-	
-	deltaVelA.vLin = add3(mul3s(constNormalM_A.vLin, deltaLambda1), mul3s(constTangentM_A.vLin, deltaLambda2));
-	deltaVelA.vAng = add3(mul3s(constNormalM_A.vAng, deltaLambda1), mul3s(constTangentM_A.vAng, deltaLambda2));
-
-	deltaVelB.vLin = add3(mul3s(constNormalM_B.vLin, deltaLambda1), mul3s(constTangentM_B.vLin, deltaLambda2));
-	deltaVelB.vAng = add3(mul3s(constNormalM_B.vAng, deltaLambda1), mul3s(constTangentM_B.vAng, deltaLambda2));
-	
-	atomicAdd(&ptrA[0], deltaVelA.vLin.ab.x);
-	atomicAdd(&ptrA[1], deltaVelA.vLin.ab.y);
-	atomicAdd(&ptrA[2], deltaVelA.vLin.c);
-	atomicAdd(&ptrA[3], deltaVelA.vAng.ab.x);
-	atomicAdd(&ptrA[4], deltaVelA.vAng.ab.y);
-	atomicAdd(&ptrA[5], deltaVelA.vAng.c);
-	
-	atomicAdd(&ptrB[0], deltaVelB.vLin.ab.x);
-	atomicAdd(&ptrB[1], deltaVelB.vLin.ab.y);
-	atomicAdd(&ptrB[2], deltaVelB.vLin.c);
-	atomicAdd(&ptrB[3], deltaVelB.vAng.ab.x);
-	atomicAdd(&ptrB[4], deltaVelB.vAng.ab.y);
-	atomicAdd(&ptrB[5], deltaVelB.vAng.c);
-	
-	barrier(CLK_GLOBAL_MEM_FENCE);
-  }
-  
-  bufLambda[i << 1] = lambda1;
-  bufLambda[(i << 1) + 1] = lambda2;
-}
-
 inline void mul6s(__global scalar *vIn, scalar s) {
   
   vIn[0] = vIn[0] * s;
@@ -902,7 +366,7 @@ inline void mul2s(__global scalar *vIn, scalar s) {
 }
 
 /*
-// Kenrel 9
+// Kenrel 4
 __kernel void jacobi_norm(__global ivec2 *bufBodyIndex, __global scalar *bufConstNormalD_A,
 	__global scalar *bufConstTangentD_A, __global scalar *bufConstNormalD_B, __global scalar *bufConstTangentD_B,
 	__global scalar *bufConstNormalM_A, __global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B, 
@@ -1023,7 +487,7 @@ __kernel void jacobi_norm(__global ivec2 *bufBodyIndex, __global scalar *bufCons
   }
 }*/
 
-// Kenrel 9
+// Kenrel 4
 __kernel void jacobi_norm(__global ivec2 *bufBodyIndex, __global scalar *bufConstNormalD_A,
 	__global scalar *bufConstTangentD_A, __global scalar *bufConstNormalD_B, __global scalar *bufConstTangentD_B,
 	__global scalar *bufConstNormalM_A, __global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B, 
@@ -1138,3 +602,569 @@ __kernel void jacobi_norm(__global ivec2 *bufBodyIndex, __global scalar *bufCons
   }
 }
 
+
+inline void add6(__global scalar *vOut, vec6 v) {
+  vOut[0] += v.vLin.ab.x;
+  vOut[1] += v.vLin.ab.y;
+  vOut[2] += v.vLin.c;
+  vOut[3] += v.vAng.ab.x;
+  vOut[4] += v.vAng.ab.y;
+  vOut[5] += v.vAng.c;
+}
+
+/*
+ * Constrained bodies have zero inverse mass, so the linear part of their scaled normal row is exactly
+ * zero. Used to skip writes to the ground, which is shared by many contacts in the same color.
+ */
+inline int isDynamic(vec6 constNormalM) {
+  return constNormalM.vLin.ab.x != 0 || constNormalM.vLin.ab.y != 0 || constNormalM.vLin.c != 0;
+}
+
+// Kernel 5
+/*
+ * One Gauss-Seidel sweep over a single color of the contact graph. Contacts in a color share no
+ * dynamic body, so deltaVel is updated without atomics. Lambda persists in global memory between
+ * launches. The host launches this once per color per iteration, colorOrder holds contact indices
+ * grouped by color.
+ */
+__kernel void gs_color(__global scalar *deltaVel, __global uint *bufBodyIndex, __global scalar *bufConstNormalD_A,
+	__global scalar *bufConstTangentD_A, __global scalar *bufConstNormalD_B, __global scalar *bufConstTangentD_B,
+	__global scalar *bufConstNormalM_A, __global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B,
+	__global scalar *bufConstTangentM_B, __global scalar *bufB, __global scalar *bufLambda,
+	__global uint *colorOrder, uint colorOffset, uint colorSize, __global scalar *bufResidual,
+	__global scalar *bufMaterial)
+{
+  size_t gid = get_global_id(0);
+  if (gid >= colorSize)
+    return;
+
+  uint i = colorOrder[colorOffset + gid];
+  ivec2 bodyIndex = ipack2(&bufBodyIndex[i<<1]);
+  vec6 constNormalD_A = pack6(&bufConstNormalD_A[6 * i]);
+  vec6 constNormalD_B = pack6(&bufConstNormalD_B[6 * i]);
+  vec6 constTangentD_A = pack6(&bufConstTangentD_A[6 * i]);
+  vec6 constTangentD_B = pack6(&bufConstTangentD_B[6 * i]);
+  vec2 lambda = pack2(&bufLambda[i<<1]);
+  vec2 b = pack2(&bufB[i<<1]);
+
+  __global scalar *ptrA = &deltaVel[6 * bodyIndex.x];
+  __global scalar *ptrB = &deltaVel[6 * bodyIndex.y];
+  vec6 deltaVelA = pack6(ptrA);
+  vec6 deltaVelB = pack6(ptrB);
+
+  scalar lambda_final1 = lambda.x - b.x - dot3(constNormalD_A.vLin, deltaVelA.vLin)
+    		- dot3(constNormalD_A.vAng, deltaVelA.vAng) - dot3(constNormalD_B.vLin, deltaVelB.vLin)
+    		- dot3(constNormalD_B.vAng, deltaVelB.vAng);
+  scalar lambda_final2 = lambda.y - b.y - dot3(constTangentD_A.vLin, deltaVelA.vLin)
+    		- dot3(constTangentD_A.vAng, deltaVelA.vAng) - dot3(constTangentD_B.vLin, deltaVelB.vLin)
+    		- dot3(constTangentD_B.vAng, deltaVelB.vAng);
+
+  lambda_final1 = (lambda_final1 < 0) ? 0 : lambda_final1;
+  scalar max_tangent1 = bufMaterial[i<<1] * lambda_final1;
+  lambda_final2 = (lambda_final2 < -max_tangent1) ? -max_tangent1 : lambda_final2;
+  lambda_final2 = (lambda_final2 > max_tangent1) ? max_tangent1 : lambda_final2;
+
+  scalar deltaLambda1 = lambda_final1 - lambda.x;
+  scalar deltaLambda2 = lambda_final2 - lambda.y;
+  lambda.x = lambda_final1;
+  lambda.y = lambda_final2;
+  unpack2(&bufLambda[i<<1], lambda);
+
+  // Per contact |delta lambda|^2 and |lambda|^2 of this sweep, summed by reduce_residual
+  bufResidual[i<<1] = deltaLambda1 * deltaLambda1 + deltaLambda2 * deltaLambda2;
+  bufResidual[(i<<1) + 1] = lambda.x * lambda.x + lambda.y * lambda.y;
+
+  vec6 constNormalM_A = pack6(&bufConstNormalM_A[6 * i]);
+  vec6 constNormalM_B = pack6(&bufConstNormalM_B[6 * i]);
+
+  if (isDynamic(constNormalM_A)) {
+    vec6 constTangentM_A = pack6(&bufConstTangentM_A[6 * i]);
+    deltaVelA.vLin = add3(mul3s(constNormalM_A.vLin, deltaLambda1), mul3s(constTangentM_A.vLin, deltaLambda2));
+    deltaVelA.vAng = add3(mul3s(constNormalM_A.vAng, deltaLambda1), mul3s(constTangentM_A.vAng, deltaLambda2));
+    add6(ptrA, deltaVelA);
+  }
+
+  if (isDynamic(constNormalM_B)) {
+    vec6 constTangentM_B = pack6(&bufConstTangentM_B[6 * i]);
+    deltaVelB.vLin = add3(mul3s(constNormalM_B.vLin, deltaLambda1), mul3s(constTangentM_B.vLin, deltaLambda2));
+    deltaVelB.vAng = add3(mul3s(constNormalM_B.vAng, deltaLambda1), mul3s(constTangentM_B.vAng, deltaLambda2));
+    add6(ptrB, deltaVelB);
+  }
+}
+
+// Kernel 6
+/* Sums the per contact residuals written by gs_color. Launched as a single work group, scratch holds 2 * local size scalars. */
+__kernel void reduce_residual(__global scalar *bufResidual, __global scalar *residualSum, uint numContacts,
+	__local scalar *scratch)
+{
+  size_t lid = get_local_id(0);
+  size_t lsize = get_local_size(0);
+  __local scalar *s_delta = scratch;
+  __local scalar *s_norm = scratch + lsize;
+
+  scalar delta = 0;
+  scalar norm = 0;
+  for (uint i = lid; i < numContacts; i += lsize) {
+    delta += bufResidual[i<<1];
+    norm += bufResidual[(i<<1) + 1];
+  }
+  s_delta[lid] = delta;
+  s_norm[lid] = norm;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (size_t stride = lsize >> 1; stride > 0; stride >>= 1) {
+    if (lid < stride) {
+      s_delta[lid] += s_delta[lid + stride];
+      s_norm[lid] += s_norm[lid + stride];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (lid == 0) {
+    residualSum[0] = s_delta[0];
+    residualSum[1] = s_norm[0];
+  }
+}
+
+// Kernel 7
+/*
+ * Body half of a gather based Jacobi iteration, one work item per body. bodyContacts lists the contacts of
+ * every body as contact index << 1 | side, side 1 when the body is B. Constrained bodies have no entries.
+ */
+__kernel void jacobi_body(__global scalar *deltaVel, __global uint *bodyOffset, __global uint *bodyContacts,
+	__global scalar *bufConstNormalM_A, __global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B,
+	__global scalar *bufConstTangentM_B, __global scalar *bufDeltaLambda, uint numBodies)
+{
+  size_t body = get_global_id(0);
+  if (body >= numBodies)
+    return;
+
+  uint begin = bodyOffset[body];
+  uint end = bodyOffset[body + 1];
+  if (begin == end)
+    return;
+
+  vec6 sum;
+  sum.vLin.ab.x = sum.vLin.ab.y = sum.vLin.c = 0;
+  sum.vAng.ab.x = sum.vAng.ab.y = sum.vAng.c = 0;
+  for (uint k = begin; k < end; k++) {
+    uint entry = bodyContacts[k];
+    uint i = entry >> 1;
+    vec2 deltaLambda = pack2(&bufDeltaLambda[i<<1]);
+    vec6 constNormalM = (entry & 1) ? pack6(&bufConstNormalM_B[6 * i]) : pack6(&bufConstNormalM_A[6 * i]);
+    vec6 constTangentM = (entry & 1) ? pack6(&bufConstTangentM_B[6 * i]) : pack6(&bufConstTangentM_A[6 * i]);
+    sum.vLin = add3(sum.vLin, add3(mul3s(constNormalM.vLin, deltaLambda.x), mul3s(constTangentM.vLin, deltaLambda.y)));
+    sum.vAng = add3(sum.vAng, add3(mul3s(constNormalM.vAng, deltaLambda.x), mul3s(constTangentM.vAng, deltaLambda.y)));
+  }
+  add6(&deltaVel[6 * body], sum);
+}
+
+inline vec6 vpack6(volatile __global scalar *vIn) {
+  vec6 v;
+  v.vLin.ab.x = vIn[0];
+  v.vLin.ab.y = vIn[1];
+  v.vLin.c = vIn[2];
+  v.vAng.ab.x = vIn[3];
+  v.vAng.ab.y = vIn[4];
+  v.vAng.c = vIn[5];
+
+  return v;
+}
+
+inline void vadd6(volatile __global scalar *vOut, vec6 v) {
+  vOut[0] += v.vLin.ab.x;
+  vOut[1] += v.vLin.ab.y;
+  vOut[2] += v.vLin.c;
+  vOut[3] += v.vAng.ab.x;
+  vOut[4] += v.vAng.ab.y;
+  vOut[5] += v.vAng.c;
+}
+
+/*
+ * Barrier across all work groups of a launch. syncState[0] counts arrivals, the last group to arrive resets
+ * it and bumps the generation in syncState[1], which the others spin on. Only safe when every group of the
+ * launch is resident at once, the host bounds the group count by the number of compute units.
+ */
+inline void globalBarrier(volatile __global uint *syncState, uint numGroups) {
+  barrier(CLK_GLOBAL_MEM_FENCE | CLK_LOCAL_MEM_FENCE);
+  if (get_local_id(0) == 0) {
+    uint generation = atomic_add(&syncState[1], 0);
+    mem_fence(CLK_GLOBAL_MEM_FENCE);
+    if (atomic_inc(&syncState[0]) == numGroups - 1) {
+      atomic_xchg(&syncState[0], 0);
+      atomic_inc(&syncState[1]);
+    }
+    else {
+      while (atomic_add(&syncState[1], 0) == generation);
+    }
+    mem_fence(CLK_GLOBAL_MEM_FENCE);
+  }
+  barrier(CLK_GLOBAL_MEM_FENCE | CLK_LOCAL_MEM_FENCE);
+}
+
+// Kernel 8
+/*
+ * jacobi_contact and jacobi_body fused into one persistent launch that runs all iterations, with a global
+ * barrier after each half. Work items stride over contacts and bodies, so a contact is always solved by the
+ * same work item. Buffers shared across groups are volatile to keep reads out of non coherent caches.
+ * Every group writes its residual partials to groupResidual, double buffered by iteration, and every work
+ * item sums them after the second barrier, so all groups agree on when to stop. The number of iterations
+ * run is left in syncState[2]. scratch holds 2 * local size scalars, local size must be a power of two.
+ */
+__kernel void jacobi_persistent(volatile __global scalar *deltaVel, __global uint *bufBodyIndex, __global scalar *bufConstNormalD_A,
+	__global scalar *bufConstTangentD_A, __global scalar *bufConstNormalD_B, __global scalar *bufConstTangentD_B,
+	__global scalar *bufConstNormalM_A, __global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B,
+	__global scalar *bufConstTangentM_B, __global scalar *bufB, __global scalar *bufLambda,
+	volatile __global scalar *bufDeltaLambda, __global scalar *bufMaterial, __global uint *bodyOffset,
+	__global uint *bodyContacts, volatile __global scalar *groupResidual, volatile __global uint *syncState,
+	uint numContacts, uint numBodies, uint iterCount, scalar tolerance, __local scalar *scratch)
+{
+  size_t gid = get_global_id(0);
+  size_t gsize = get_global_size(0);
+  size_t lid = get_local_id(0);
+  size_t lsize = get_local_size(0);
+  uint group = get_group_id(0);
+  uint numGroups = get_num_groups(0);
+  __local scalar *s_delta = scratch;
+  __local scalar *s_norm = scratch + lsize;
+
+  uint iter;
+  for (iter = 0; iter < iterCount; iter++) {
+    scalar delta = 0;
+    scalar norm = 0;
+    for (size_t i = gid; i < numContacts; i += gsize) {
+      ivec2 bodyIndex = ipack2(&bufBodyIndex[i<<1]);
+      vec6 constNormalD_A = pack6(&bufConstNormalD_A[6 * i]);
+      vec6 constNormalD_B = pack6(&bufConstNormalD_B[6 * i]);
+      vec6 constTangentD_A = pack6(&bufConstTangentD_A[6 * i]);
+      vec6 constTangentD_B = pack6(&bufConstTangentD_B[6 * i]);
+      vec2 lambda = pack2(&bufLambda[i<<1]);
+      vec2 b = pack2(&bufB[i<<1]);
+      vec6 deltaVelA = vpack6(&deltaVel[6 * bodyIndex.x]);
+      vec6 deltaVelB = vpack6(&deltaVel[6 * bodyIndex.y]);
+
+      scalar lambda_final1 = lambda.x - b.x - dot6(constNormalD_A, deltaVelA) - dot6(constNormalD_B, deltaVelB);
+      scalar lambda_final2 = lambda.y - b.y - dot6(constTangentD_A, deltaVelA) - dot6(constTangentD_B, deltaVelB);
+
+      lambda_final1 = (lambda_final1 < 0) ? 0 : lambda_final1;
+      scalar max_tangent1 = bufMaterial[i<<1] * lambda_final1;
+      lambda_final2 = (lambda_final2 < -max_tangent1) ? -max_tangent1 : lambda_final2;
+      lambda_final2 = (lambda_final2 > max_tangent1) ? max_tangent1 : lambda_final2;
+
+      scalar deltaLambda1 = lambda_final1 - lambda.x;
+      scalar deltaLambda2 = lambda_final2 - lambda.y;
+      lambda.x = lambda_final1;
+      lambda.y = lambda_final2;
+      bufDeltaLambda[i<<1] = deltaLambda1;
+      bufDeltaLambda[(i<<1) + 1] = deltaLambda2;
+      unpack2(&bufLambda[i<<1], lambda);
+
+      delta += deltaLambda1 * deltaLambda1 + deltaLambda2 * deltaLambda2;
+      norm += lambda.x * lambda.x + lambda.y * lambda.y;
+    }
+
+    s_delta[lid] = delta;
+    s_norm[lid] = norm;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (size_t stride = lsize >> 1; stride > 0; stride >>= 1) {
+      if (lid < stride) {
+        s_delta[lid] += s_delta[lid + stride];
+        s_norm[lid] += s_norm[lid + stride];
+      }
+      barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    volatile __global scalar *partial = &groupResidual[((iter & 1) * numGroups + group) << 1];
+    if (lid == 0) {
+      partial[0] = s_delta[0];
+      partial[1] = s_norm[0];
+    }
+
+    globalBarrier(syncState, numGroups);
+
+    for (size_t body = gid; body < numBodies; body += gsize) {
+      uint begin = bodyOffset[body];
+      uint end = bodyOffset[body + 1];
+      if (begin == end)
+        continue;
+
+      vec6 sum;
+      sum.vLin.ab.x = sum.vLin.ab.y = sum.vLin.c = 0;
+      sum.vAng.ab.x = sum.vAng.ab.y = sum.vAng.c = 0;
+      for (uint k = begin; k < end; k++) {
+        uint entry = bodyContacts[k];
+        uint i = entry >> 1;
+        scalar deltaLambda1 = bufDeltaLambda[i<<1];
+        scalar deltaLambda2 = bufDeltaLambda[(i<<1) + 1];
+        vec6 constNormalM = (entry & 1) ? pack6(&bufConstNormalM_B[6 * i]) : pack6(&bufConstNormalM_A[6 * i]);
+        vec6 constTangentM = (entry & 1) ? pack6(&bufConstTangentM_B[6 * i]) : pack6(&bufConstTangentM_A[6 * i]);
+        sum.vLin = add3(sum.vLin, add3(mul3s(constNormalM.vLin, deltaLambda1), mul3s(constTangentM.vLin, deltaLambda2)));
+        sum.vAng = add3(sum.vAng, add3(mul3s(constNormalM.vAng, deltaLambda1), mul3s(constTangentM.vAng, deltaLambda2)));
+      }
+      vadd6(&deltaVel[6 * body], sum);
+    }
+
+    globalBarrier(syncState, numGroups);
+
+    // Groups write the other half of groupResidual in the next iteration, so this half is stable here
+    scalar totalDelta = 0;
+    scalar totalNorm = 0;
+    for (uint g = 0; g < numGroups; g++) {
+      totalDelta += groupResidual[((iter & 1) * numGroups + g) << 1];
+      totalNorm += groupResidual[(((iter & 1) * numGroups + g) << 1) + 1];
+    }
+    if (totalDelta <= tolerance * tolerance * totalNorm) {
+      iter++;
+      break;
+    }
+  }
+
+  if (gid == 0)
+    syncState[2] = iter;
+}
+
+// Kernel 9
+/*
+ * NNCG step between jacobi_contact and jacobi_body, after reduce_residual has summed the sweep. Lambda moves
+ * on by beta along the previous direction and the total change becomes the new direction, which jacobi_body
+ * applies. residualSum[2 + parity] keeps this sweep's squared change for the next iteration while the other
+ * slot holds the previous one, so no work item overwrites a value another one still reads.
+ */
+__kernel void nncg_momentum(__global scalar *bufLambda, __global scalar *bufDeltaLambda, __global scalar *bufDirection,
+	__global scalar *residualSum, uint parity, uint numContacts)
+{
+  size_t i = get_global_id(0);
+  scalar delta = residualSum[0];
+  scalar previous = residualSum[3 - parity];
+  if (i == 0)
+    residualSum[2 + parity] = delta;
+  if (i >= numContacts)
+    return;
+
+  // Restart when the change grows, the direction of the first sweep is never read
+  scalar beta = (previous <= 0 || delta > previous) ? 0 : delta / previous;
+  vec2 deltaLambda = pack2(&bufDeltaLambda[i<<1]);
+  if (beta > 0) {
+    vec2 step = pack2(&bufDirection[i<<1]) * beta;
+    unpack2(&bufLambda[i<<1], pack2(&bufLambda[i<<1]) + step);
+    deltaLambda += step;
+    unpack2(&bufDeltaLambda[i<<1], deltaLambda);
+  }
+  unpack2(&bufDirection[i<<1], deltaLambda);
+}
+
+// Kernel 10
+/*
+ * Chebyshev step between jacobi_contact and jacobi_body. The sweep is blended with the change of the
+ * iteration before by omega, projected again and the total change is what jacobi_body applies. omega
+ * comes from the host, which estimates the spectral radius from the first sweeps.
+ */
+__kernel void chebyshev_weight(__global scalar *bufLambda, __global scalar *bufDeltaLambda, __global scalar *bufDirection,
+	__global scalar *bufMaterial, scalar omega, uint numContacts)
+{
+  size_t i = get_global_id(0);
+  if (i >= numContacts)
+    return;
+
+  vec2 lambda = pack2(&bufLambda[i<<1]);
+  vec2 deltaLambda = pack2(&bufDeltaLambda[i<<1]);
+  vec2 old = lambda - deltaLambda;
+  lambda += (omega - 1) * (deltaLambda + pack2(&bufDirection[i<<1]));
+
+  lambda.x = (lambda.x < 0) ? 0 : lambda.x;
+  scalar max_tangent1 = bufMaterial[i<<1] * lambda.x;
+  lambda.y = (lambda.y < -max_tangent1) ? -max_tangent1 : lambda.y;
+  lambda.y = (lambda.y > max_tangent1) ? max_tangent1 : lambda.y;
+
+  deltaLambda = lambda - old;
+  unpack2(&bufLambda[i<<1], lambda);
+  unpack2(&bufDeltaLambda[i<<1], deltaLambda);
+  unpack2(&bufDirection[i<<1], deltaLambda);
+}
+
+inline void store6(__global scalar *vOut, vec6 v) {
+  vOut[0] = v.vLin.ab.x;
+  vOut[1] = v.vLin.ab.y;
+  vOut[2] = v.vLin.c;
+  vOut[3] = v.vAng.ab.x;
+  vOut[4] = v.vAng.ab.y;
+  vOut[5] = v.vAng.c;
+}
+
+// Kernel 11
+/*
+ * Contact half of a block Jacobi iteration, one work item per manifold. The points of a manifold share both
+ * bodies, they are solved one after the other against a private copy of the two deltaVel, so within the
+ * manifold this is Gauss-Seidel. The summed change of both bodies goes to manifoldDelta, A then B, and
+ * manifold_body applies it. Contacts of manifold m are manifoldOffset[m] to manifoldOffset[m + 1] - 1.
+ */
+__kernel void jacobi_manifold(__global scalar *deltaVel, __global uint *bufBodyIndex, __global scalar *bufConstNormalD_A,
+	__global scalar *bufConstTangentD_A, __global scalar *bufConstNormalD_B, __global scalar *bufConstTangentD_B,
+	__global scalar *bufConstNormalM_A, __global scalar *bufConstTangentM_A, __global scalar *bufConstNormalM_B,
+	__global scalar *bufConstTangentM_B, __global scalar *bufB, __global scalar *bufLambda, __global scalar *bufMaterial,
+	__global scalar *bufResidual, __global uint *manifoldOffset, __global scalar *manifoldDelta, uint numManifolds)
+{
+  size_t m = get_global_id(0);
+  if (m >= numManifolds)
+    return;
+
+  uint begin = manifoldOffset[m];
+  uint end = manifoldOffset[m + 1];
+  ivec2 bodyIndex = ipack2(&bufBodyIndex[begin<<1]);
+  vec6 deltaVelA = pack6(&deltaVel[6 * bodyIndex.x]);
+  vec6 deltaVelB = pack6(&deltaVel[6 * bodyIndex.y]);
+  vec6 sumA, sumB;
+  sumA.vLin.ab.x = sumA.vLin.ab.y = sumA.vLin.c = 0;
+  sumA.vAng.ab.x = sumA.vAng.ab.y = sumA.vAng.c = 0;
+  sumB = sumA;
+
+  for (uint i = begin; i < end; i++) {
+    vec6 constNormalD_A = pack6(&bufConstNormalD_A[6 * i]);
+    vec6 constNormalD_B = pack6(&bufConstNormalD_B[6 * i]);
+    vec6 constTangentD_A = pack6(&bufConstTangentD_A[6 * i]);
+    vec6 constTangentD_B = pack6(&bufConstTangentD_B[6 * i]);
+    vec2 lambda = pack2(&bufLambda[i<<1]);
+    vec2 b = pack2(&bufB[i<<1]);
+
+    scalar lambda_final1 = lambda.x - b.x - dot6(constNormalD_A, deltaVelA) - dot6(constNormalD_B, deltaVelB);
+    scalar lambda_final2 = lambda.y - b.y - dot6(constTangentD_A, deltaVelA) - dot6(constTangentD_B, deltaVelB);
+
+    lambda_final1 = (lambda_final1 < 0) ? 0 : lambda_final1;
+    scalar max_tangent1 = bufMaterial[i<<1] * lambda_final1;
+    lambda_final2 = (lambda_final2 < -max_tangent1) ? -max_tangent1 : lambda_final2;
+    lambda_final2 = (lambda_final2 > max_tangent1) ? max_tangent1 : lambda_final2;
+
+    vec2 deltaLambda;
+    deltaLambda.x = lambda_final1 - lambda.x;
+    deltaLambda.y = lambda_final2 - lambda.y;
+    lambda.x = lambda_final1;
+    lambda.y = lambda_final2;
+    unpack2(&bufLambda[i<<1], lambda);
+    bufResidual[i<<1] = deltaLambda.x * deltaLambda.x + deltaLambda.y * deltaLambda.y;
+    bufResidual[(i<<1) + 1] = lambda.x * lambda.x + lambda.y * lambda.y;
+
+    vec6 constNormalM = pack6(&bufConstNormalM_A[6 * i]);
+    vec6 constTangentM = pack6(&bufConstTangentM_A[6 * i]);
+    vec6 change;
+    change.vLin = add3(mul3s(constNormalM.vLin, deltaLambda.x), mul3s(constTangentM.vLin, deltaLambda.y));
+    change.vAng = add3(mul3s(constNormalM.vAng, deltaLambda.x), mul3s(constTangentM.vAng, deltaLambda.y));
+    deltaVelA.vLin = add3(deltaVelA.vLin, change.vLin); deltaVelA.vAng = add3(deltaVelA.vAng, change.vAng);
+    sumA.vLin = add3(sumA.vLin, change.vLin); sumA.vAng = add3(sumA.vAng, change.vAng);
+
+    constNormalM = pack6(&bufConstNormalM_B[6 * i]);
+    constTangentM = pack6(&bufConstTangentM_B[6 * i]);
+    change.vLin = add3(mul3s(constNormalM.vLin, deltaLambda.x), mul3s(constTangentM.vLin, deltaLambda.y));
+    change.vAng = add3(mul3s(constNormalM.vAng, deltaLambda.x), mul3s(constTangentM.vAng, deltaLambda.y));
+    deltaVelB.vLin = add3(deltaVelB.vLin, change.vLin); deltaVelB.vAng = add3(deltaVelB.vAng, change.vAng);
+    sumB.vLin = add3(sumB.vLin, change.vLin); sumB.vAng = add3(sumB.vAng, change.vAng);
+  }
+  store6(&manifoldDelta[12 * m], sumA);
+  store6(&manifoldDelta[12 * m + 6], sumB);
+}
+
+// Kernel 12
+/*
+ * Body half of the block Jacobi iteration, same gather as jacobi_body over bodyManifolds, which lists
+ * manifold index << 1 | side. One entry per manifold instead of one per point.
+ */
+__kernel void manifold_body(__global scalar *deltaVel, __global uint *bodyOffset, __global uint *bodyManifolds,
+	__global scalar *manifoldDelta, uint numBodies)
+{
+  size_t body = get_global_id(0);
+  if (body >= numBodies)
+    return;
+
+  uint begin = bodyOffset[body];
+  uint end = bodyOffset[body + 1];
+  if (begin == end)
+    return;
+
+  vec6 sum;
+  sum.vLin.ab.x = sum.vLin.ab.y = sum.vLin.c = 0;
+  sum.vAng.ab.x = sum.vAng.ab.y = sum.vAng.c = 0;
+  for (uint k = begin; k < end; k++) {
+    uint entry = bodyManifolds[k];
+    vec6 change = pack6(&manifoldDelta[12 * (entry >> 1) + 6 * (entry & 1)]);
+    sum.vLin = add3(sum.vLin, change.vLin);
+    sum.vAng = add3(sum.vAng, change.vAng);
+  }
+  add6(&deltaVel[6 * body], sum);
+}
+
+// Kernel 13
+/*
+ * Contact half of jacobi_contact over tiles of get_local_size(0) contacts. The group copies the rows, B,
+ * lambda and friction of a tile to local memory, consecutive work items reading consecutive scalars, then
+ * every work item solves its contact from there. Groups stride over the tiles, so the local arrays are sized
+ * by the tile and not by numContacts. s_pairs holds B, then lambda, then the material of the tile.
+ */
+__kernel void jacobi_tiled(__global scalar *deltaVel, __global uint *bufBodyIndex, __global scalar *bufConstNormalD_A,
+	__global scalar *bufConstTangentD_A, __global scalar *bufConstNormalD_B, __global scalar *bufConstTangentD_B,
+	__global scalar *bufB, __global scalar *bufLambda, __global scalar *bufDeltaLambda, __global scalar *bufMaterial,
+	__global scalar *bufResidual, uint numContacts, __local uint *s_bodyIndex, __local scalar *s_rows,
+	__local scalar *s_pairs)
+{
+  uint lid = get_local_id(0);
+  uint tileSize = get_local_size(0);
+  uint stride = get_num_groups(0) * tileSize;
+
+  // first is the same for the whole group, every work item reaches the barriers
+  for (uint first = get_group_id(0) * tileSize; first < numContacts; first += stride) {
+    uint count = (numContacts - first < tileSize) ? numContacts - first : tileSize;
+    uint s;
+
+    // The tile before is done with local memory
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (s = lid; s < 2 * count; s += tileSize) {
+      s_bodyIndex[s] = bufBodyIndex[2 * first + s];
+      s_pairs[s] = bufB[2 * first + s];
+      s_pairs[2 * tileSize + s] = bufLambda[2 * first + s];
+      s_pairs[4 * tileSize + s] = bufMaterial[2 * first + s];
+    }
+    for (s = lid; s < 6 * count; s += tileSize) {
+      s_rows[s] = bufConstNormalD_A[6 * first + s];
+      s_rows[6 * tileSize + s] = bufConstTangentD_A[6 * first + s];
+      s_rows[12 * tileSize + s] = bufConstNormalD_B[6 * first + s];
+      s_rows[18 * tileSize + s] = bufConstTangentD_B[6 * first + s];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (lid < count) {
+      size_t i = first + lid;
+      ivec2 bodyIndex = s_ipack2(&s_bodyIndex[lid<<1]);
+      vec6 constNormalD_A = s_pack6(&s_rows[6 * lid]);
+      vec6 constTangentD_A = s_pack6(&s_rows[6 * (tileSize + lid)]);
+      vec6 constNormalD_B = s_pack6(&s_rows[6 * (2 * tileSize + lid)]);
+      vec6 constTangentD_B = s_pack6(&s_rows[6 * (3 * tileSize + lid)]);
+      vec2 b, lambda;
+      b.x = s_pairs[lid<<1];
+      b.y = s_pairs[(lid<<1) + 1];
+      lambda.x = s_pairs[2 * tileSize + (lid<<1)];
+      lambda.y = s_pairs[2 * tileSize + (lid<<1) + 1];
+      vec6 deltaVelA = pack6(&deltaVel[6 * bodyIndex.x]);
+      vec6 deltaVelB = pack6(&deltaVel[6 * bodyIndex.y]);
+
+      scalar lambda_final1 = lambda.x - b.x - dot3(constNormalD_A.vLin, deltaVelA.vLin)
+      		- dot3(constNormalD_A.vAng, deltaVelA.vAng) - dot3(constNormalD_B.vLin, deltaVelB.vLin)
+      		- dot3(constNormalD_B.vAng, deltaVelB.vAng);
+      scalar lambda_final2 = lambda.y - b.y - dot3(constTangentD_A.vLin, deltaVelA.vLin)
+      		- dot3(constTangentD_A.vAng, deltaVelA.vAng) - dot3(constTangentD_B.vLin, deltaVelB.vLin)
+      		- dot3(constTangentD_B.vAng, deltaVelB.vAng);
+
+      lambda_final1 = (lambda_final1 < 0) ? 0 : lambda_final1;
+      scalar max_tangent1 = s_pairs[4 * tileSize + (lid<<1)] * lambda_final1;
+      lambda_final2 = (lambda_final2 < -max_tangent1) ? -max_tangent1 : lambda_final2;
+      lambda_final2 = (lambda_final2 > max_tangent1) ? max_tangent1 : lambda_final2;
+
+      vec2 deltaLambda;
+      deltaLambda.x = lambda_final1 - lambda.x;
+      deltaLambda.y = lambda_final2 - lambda.y;
+      lambda.x = lambda_final1;
+      lambda.y = lambda_final2;
+      unpack2(&bufDeltaLambda[i<<1], deltaLambda);
+      unpack2(&bufLambda[i<<1], lambda);
+
+      bufResidual[i<<1] = deltaLambda.x * deltaLambda.x + deltaLambda.y * deltaLambda.y;
+      bufResidual[(i<<1) + 1] = lambda.x * lambda.x + lambda.y * lambda.y;
+    }
+  }
+}
@@ -13,6 +13,12 @@
 #include <mat3x3.hpp>
 #include <gtc/quaternion.hpp>
 #include <gtx/quaternion.hpp>
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include "RigidBody.h"
+#include "DataType.h"
 
 #define isnZero(value, threshold) \
         (value <= -threshold || value >= threshold)
@@ -20,725 +26,352 @@
 #define isZero(value, threshold) \
         (value >= -threshold && value <= threshold)
 
-#define ITER_COUNT 60
-
-#define OCL_SOLVE
-#define PGS
-#ifndef OCL_SOLVE
-#ifdef PGS
-
-#ifdef USE_FULL_JACOBIAN // Reference implementation
-struct ContactJacobian {
-	/* Normal Constraints*/
-	glm::dvec3 linN, angN; // Normal constraints
-	glm::dvec3 linN_scaledD, angN_scaledD; // Normal constraints scaled by D_row1_inv
-	glm::dvec3 linN_scaledM, angN_scaledM; // Normal constraints scaled by inverse mass and inverse inertia
-
-	glm::dvec3 linT1, angT1;
-	glm::dvec3 linT1_scaledD, angT1_scaledD;
-	glm::dvec3 linT1_scaledM, angT1_scaledM;
-
-	glm::dvec3 linT2, angT2;
-	glm::dvec3 linT2_scaledD, angT2_scaledD;
-	glm::dvec3 linT2_scaledM, angT2_scaledM;
-};
-
-class Contact {
-	RigidBody *A;
-	RigidBody *B;
-public:
-	ContactJacobian jA;
-	ContactJacobian jB;
-	double b_row1_scaledD;
-	double b_row2_scaledD;
-	double b_row3_scaledD;
-
-	double lambda1;
-	double lambda2;
-	double lambda3;
-
-	bool processed;
-
-	Contact(RigidBody *A, RigidBody *B, const glm::dvec3 &contactPoint, const glm::dvec3 &contactNormal, double bounce, double dt) {
-		A->deltaV = glm::dvec3(0,0,0); A->deltaW = glm::dvec3(0,0,0);
-		B->deltaV = glm::dvec3(0,0,0); B->deltaW = glm::dvec3(0,0,0);
-
-		lambda1 = lambda2 = lambda3 = 0;
-
-		this->A = A;
-		this->B = B;
-
-		glm::dvec3 linImpA = A->getLinearImpulse(dt); glm::dvec3 angImpA = A->getAngularImpulse(dt);
-		glm::dvec3 linImpB = B->getLinearImpulse(dt); glm::dvec3 angImpB = B->getAngularImpulse(dt);
-
-		/* compute constraints for Normal direction*/
-		jA.linN = -contactNormal; jA.angN = -(A->getRcrossN(contactPoint, contactNormal));
-		jB.linN = contactNormal; jB.angN = B->getRcrossN(contactPoint, contactNormal);
-
-		jA.linN_scaledM = A->getScaledByMinv(jA.linN); jA.angN_scaledM = A->getScaledByIinv(jA.angN);
-		jB.linN_scaledM = B->getScaledByMinv(jB.linN); jB.angN_scaledM = B->getScaledByIinv(jB.angN);
-
-		double D_row1_inv = glm::dot(jA.linN, jA.linN_scaledM) + glm::dot(jA.angN, jA.angN_scaledM) +
-				glm::dot(jB.linN, jB.linN_scaledM) + glm::dot(jB.angN, jB.angN_scaledM);
-
-		if (isZero(D_row1_inv, 1e-6)) {
-			std::cerr<<"1:Two Constrained objects colliding..."<<std::endl;
-			exit(0);
-		}
-
-		D_row1_inv = 1.0 / D_row1_inv;
-
-		jA.linN_scaledD = jA.linN * D_row1_inv; jA.angN_scaledD = jA.angN * D_row1_inv;
-		jB.linN_scaledD = jB.linN * D_row1_inv; jB.angN_scaledD = jB.angN * D_row1_inv;
-
-		b_row1_scaledD = glm::dot(jA.linN, linImpA) + glm::dot(jA.angN, angImpA) +
-				glm::dot(jB.linN, linImpB) + glm::dot(jB.angN, angImpB) +
-		/*bounce*/ bounce * (A->getDotWithV(jA.linN) + A->getDotWithW(jA.angN) + B->getDotWithV(jB.linN) + B->getDotWithW(jB.angN));
-
-		b_row1_scaledD *= D_row1_inv;
-
-
-
-
-		/* Compute constraints for tangential direction 1*/
-		glm::dvec3 tangent1;
-		if (isnZero(contactNormal.x, 1e-3))
-			tangent1 = glm::dvec3(-contactNormal.y-contactNormal.z, contactNormal.x, contactNormal.x);
-		else if (isnZero(contactNormal.y, 1e-6))
-			tangent1 = glm::dvec3(contactNormal.y, -contactNormal.z - contactNormal.x, contactNormal.y);
-		else if (isnZero(contactNormal.z, 1e-16))
-			tangent1 = glm::dvec3(contactNormal.z, contactNormal.z, - contactNormal.x - contactNormal.y);
-		else {
-			std::cerr<<"Contact Normal is zero."<<std::endl;
-			exit(0);
-		}
-		tangent1 = glm::normalize(tangent1);
-
-		jA.linT1 = -tangent1; jA.angT1 = -(A->getRcrossN(contactPoint, tangent1));
-		jB.linT1 = tangent1; jB.angT1 = (B->getRcrossN(contactPoint, tangent1));
-
-		jA.linT1_scaledM = A->getScaledByMinv(jA.linT1); jA.angT1_scaledM = A->getScaledByIinv(jA.angT1);
-		jB.linT1_scaledM = B->getScaledByMinv(jB.linT1); jB.angT1_scaledM = B->getScaledByIinv(jB.angT1);
-
-		double D_row2_inv = glm::dot(jA.linT1, jA.linT1_scaledM) + glm::dot(jA.angT1, jA.angT1_scaledM) +
-						glm::dot(jB.linT1, jB.linT1_scaledM) + glm::dot(jB.angT1, jB.angT1_scaledM);
-
-		if (isZero(D_row2_inv, 1e-6)) {
-			std::cerr<<"2:Two Constrained objects colliding..."<<std::endl;
-			exit(0);
-		}
-
-		D_row2_inv = 1.0 / D_row2_inv;
-
-		jA.linT1_scaledD = jA.linT1 * D_row2_inv; jA.angT1_scaledD = jA.angT1 * D_row2_inv;
-		jB.linT1_scaledD = jB.linT1 * D_row2_inv; jB.angT1_scaledD = jB.angT1 * D_row2_inv;
-
-		b_row2_scaledD = glm::dot(jA.linT1, linImpA) + glm::dot(jA.angT1, angImpA) +
-						glm::dot(jB.linT1, linImpB) + glm::dot(jB.angT1, angImpB);
-
-		b_row2_scaledD *= D_row2_inv;
-
-
-
-
-		/* Compute constraints for tangential direction 2*/
-		glm::dvec3 tangent2 = glm::normalize(glm::cross(contactNormal, tangent1));
-
-		jA.linT2 = -tangent2; jA.angT2 = -(A->getRcrossN(contactPoint, tangent2));
-		jB.linT2 = tangent2;  jB.angT2 = (B->getRcrossN(contactPoint, tangent2));
-
-		jA.linT2_scaledM = A->getScaledByMinv(jA.linT2); jA.angT2_scaledM = A->getScaledByIinv(jA.angT2);
-		jB.linT2_scaledM = B->getScaledByMinv(jB.linT2); jB.angT2_scaledM = B->getScaledByIinv(jB.angT2);
-
-		double D_row3_inv = glm::dot(jA.linT2, jA.linT2_scaledM) + glm::dot(jA.angT2, jA.angT2_scaledM) +
-								glm::dot(jB.linT2, jB.linT2_scaledM) + glm::dot(jB.angT2, jB.angT2_scaledM);
-
-		if (isZero(D_row3_inv, 1e-6)) {
-			std::cerr<<"3:Two Constrained objects colliding..."<<std::endl;
-			exit(0);
-		}
-
-		D_row3_inv = 1.0 / D_row3_inv;
-
-		jA.linT2_scaledD = jA.linT2 * D_row3_inv; jA.angT2_scaledD = jA.angT2 * D_row3_inv;
-		jB.linT2_scaledD = jB.linT2 * D_row3_inv; jB.angT2_scaledD = jB.angT2 * D_row3_inv;
-
-		b_row3_scaledD = glm::dot(jA.linT2, linImpA) + glm::dot(jA.angT2, angImpA) +
-						glm::dot(jB.linT2, linImpB) + glm::dot(jB.angT2, angImpB);
-
-		b_row3_scaledD *= D_row3_inv;
+/*
+ * Friction direction in the contact plane, rotated by angle from a basis vector derived from the normal.
+ * New contacts get a random angle so tangent forces act from different directions over time; persistent
+ * contacts keep their angle so the warm started tangent impulse stays meaningful.
+ */
+inline glm::dvec3 contactTangent(const glm::dvec3 &contactNormal, double angle) {
+	glm::dvec3 u;
+	if (isnZero(contactNormal.x, 1e-3))
+		u = glm::dvec3(-contactNormal.y-contactNormal.z, contactNormal.x, contactNormal.x);
+	else if (isnZero(contactNormal.y, 1e-6))
+		u = glm::dvec3(contactNormal.y, -contactNormal.z - contactNormal.x, contactNormal.y);
+	else if (isnZero(contactNormal.z, 1e-16))
+		u = glm::dvec3(contactNormal.z, contactNormal.z, - contactNormal.x - contactNormal.y);
+	else {
+		std::cerr<<"Contact Normal is zero."<<std::endl;
+		exit(0);
 	}
-
-	void processContact(double mu) {
-
-	    	double lambda_final1 = lambda1 - b_row1_scaledD - glm::dot(jA.linN_scaledD, A->deltaV)
-	    		- glm::dot(jA.angN_scaledD, A->deltaW) - glm::dot(jB.linN_scaledD, B->deltaV)
-    			- glm::dot(jB.angN_scaledD, B->deltaW);
-
-	    	if (lambda_final1 < 0) lambda_final1 = 0;
-
-	    	double lambda_final2 = lambda2 - b_row2_scaledD - glm::dot(jA.linT1_scaledD, A->deltaV)
-    			- glm::dot(jA.angT1_scaledD, A->deltaW) - glm::dot(jB.linT1_scaledD, B->deltaV)
-	    		- glm::dot(jB.angT1_scaledD, B->deltaW);
-
-	    	double max_tangent1 = mu * lambda_final1;
-	    	if (lambda_final2 < - max_tangent1) lambda_final2 = - max_tangent1;
-	    	else if (lambda_final2 > max_tangent1) lambda_final2 = max_tangent1;
-
-	    	double lambda_final3 = lambda3 - b_row3_scaledD - glm::dot(jA.linT2_scaledD, A->deltaV)
-	    	    - glm::dot(jA.angT2_scaledD, A->deltaW) - glm::dot(jB.linT2_scaledD, B->deltaV)
-	    		- glm::dot(jB.angT2_scaledD, B->deltaW);
-
-	    	double max_tangent2 = mu * lambda_final1;
-	    	if (lambda_final3 < - max_tangent2) lambda_final3 = - max_tangent2;
-	    	else if (lambda_final3 > max_tangent2) lambda_final3 = max_tangent2;
-
-	    	double delta_lambda1 = lambda_final1 - lambda1;
-	    	double delta_lambda2 = lambda_final2 - lambda2;
-	    	double delta_lambda3 = lambda_final3 - lambda3;
-
-	    	A->deltaV += jA.linN_scaledM * delta_lambda1 + jA.linT1_scaledM * delta_lambda2 + jA.linT2_scaledM * delta_lambda3;
-	    	A->deltaW += jA.angN_scaledM * delta_lambda1 + jA.angT1_scaledM * delta_lambda2 + jA.angT2_scaledM * delta_lambda3;
-
-
-			B->deltaV += jB.linN_scaledM * delta_lambda1 + jB.linT1_scaledM * delta_lambda2 + jB.linT2_scaledM * delta_lambda3;
-	    	B->deltaW += jB.angN_scaledM * delta_lambda1 + jB.angT1_scaledM * delta_lambda2 + jB.angT2_scaledM * delta_lambda3;
-
-	    	lambda1 = lambda_final1;
-	    	lambda2 = lambda_final2;
-	    	lambda3 = lambda_final3;
-
-	    	processed = true;
+	u = glm::normalize(u);
+	glm::dvec3 v = glm::normalize(glm::cross(contactNormal, u));
+	return u * std::cos(angle) + v * std::sin(angle);
+}
+
+/* Squared norms of the change in lambda over one sweep and of lambda itself, used to stop iterating early */
+struct Residual {
+	double delta;
+	double norm;
+
+	Residual() : delta(0), norm(0) {}
+	inline void add(double deltaLambda1, double deltaLambda2, double lambda1, double lambda2) {
+		delta += deltaLambda1 * deltaLambda1 + deltaLambda2 * deltaLambda2;
+		norm += lambda1 * lambda1 + lambda2 * lambda2;
 	}
-
+	inline void add(const Residual &r) { delta += r.delta; norm += r.norm; }
+	/* Relative change below tolerance, also true when nothing is pushing */
+	inline bool converged(double tolerance) const { return delta <= tolerance * tolerance * norm; }
 };
-#else
-struct ContactJacobian {
-	/* Normal Constraints*/
-	glm::dvec3 linN_scaledD, angN_scaledD; // Normal constraints scaled by D_row1_inv
-	glm::dvec3 linN_scaledM, angN_scaledM; // Normal constraints scaled by inverse mass and inverse inertia
-
-	glm::dvec3 linT1_scaledD, angT1_scaledD;
-	glm::dvec3 linT1_scaledM, angT1_scaledM;
-};
-
-class Contact {
-	RigidBody *A;
-	RigidBody *B;
-public:
-	ContactJacobian jA;
-	ContactJacobian jB;
-	double b_row1_scaledD;
-	double b_row2_scaledD;
-
-	double lambda1;
-	double lambda2;
-
-	bool processed;
-
-	Contact(RigidBody *A, RigidBody *B, const glm::dvec3 &contactPoint, const glm::dvec3 &contactNormal, double bounce, double dt) {
-		A->deltaV = glm::dvec3(0,0,0); A->deltaW = glm::dvec3(0,0,0);
-		B->deltaV = glm::dvec3(0,0,0); B->deltaW = glm::dvec3(0,0,0);
-
-		lambda1 = lambda2 = 0;
-
-		glm::dvec3 linConstA, linConstB; //linear constraint
-		glm::dvec3 angConstA, angConstB; //angular constraint
-
-
-		this->A = A;
-		this->B = B;
-
-		glm::dvec3 linImpA = A->getLinearImpulse(dt); glm::dvec3 angImpA = A->getAngularImpulse(dt);
-		glm::dvec3 linImpB = B->getLinearImpulse(dt); glm::dvec3 angImpB = B->getAngularImpulse(dt);
-
-		/* compute constraints for Normal direction*/
-		linConstA = -contactNormal; angConstA = -(A->getRcrossN(contactPoint, contactNormal));
-		linConstB = contactNormal; angConstB = B->getRcrossN(contactPoint, contactNormal);
-
-		jA.linN_scaledM = A->getScaledByMinv(linConstA); jA.angN_scaledM = A->getScaledByIinv(angConstA);
-		jB.linN_scaledM = B->getScaledByMinv(linConstB); jB.angN_scaledM = B->getScaledByIinv(angConstB);
-
-		double D_row1_inv = glm::dot(linConstA, jA.linN_scaledM) + glm::dot(angConstA, jA.angN_scaledM) +
-				glm::dot(linConstB, jB.linN_scaledM) + glm::dot(angConstB, jB.angN_scaledM);
-
-		if (isZero(D_row1_inv, 1e-6)) {
-			std::cerr<<"1:Two Constrained objects colliding..."<<std::endl;
-			exit(0);
-		}
-
-		D_row1_inv = 1.0 / D_row1_inv;
 
-		jA.linN_scaledD = linConstA * D_row1_inv; jA.angN_scaledD = angConstA * D_row1_inv;
-		jB.linN_scaledD = linConstB * D_row1_inv; jB.angN_scaledD = angConstB * D_row1_inv;
+#define ITER_COUNT 60 // Default iteration cap of the solvers
 
-		b_row1_scaledD = glm::dot(linConstA, linImpA) + glm::dot(angConstA, angImpA) +
-				glm::dot(linConstB, linImpB) + glm::dot(angConstB, angImpB) +
-		/*bounce*/ bounce * (A->getDotWithV(linConstA) + A->getDotWithW(angConstA) + B->getDotWithV(linConstB) + B->getDotWithW(angConstB));
-
-		b_row1_scaledD *= D_row1_inv;
-
-
-
-
-		/* Compute constraints for tangential direction 1*/
-		glm::dvec3 tangent1(std::rand(), std::rand(), std::rand());
-		tangent1 = glm::normalize(tangent1);
-		if (isnZero(glm::dot(tangent1, contactNormal), 1e-4)) {
-			tangent1 = glm::cross(contactNormal, tangent1);
-			tangent1 = glm::normalize(tangent1);
-		}
-		else {
-			if (isnZero(contactNormal.x, 1e-3))
-				tangent1 = glm::dvec3(-contactNormal.y-contactNormal.z, contactNormal.x, contactNormal.x);
-			else if (isnZero(contactNormal.y, 1e-6))
-				tangent1 = glm::dvec3(contactNormal.y, -contactNormal.z - contactNormal.x, contactNormal.y);
-			else if (isnZero(contactNormal.z, 1e-16))
-				tangent1 = glm::dvec3(contactNormal.z, contactNormal.z, - contactNormal.x - contactNormal.y);
-			else {
-				std::cerr<<"Contact Normal is zero."<<std::endl;
-				exit(0);
-			}
-			tangent1 = glm::normalize(tangent1);
-		}
-
-		linConstA = -tangent1; angConstA = -(A->getRcrossN(contactPoint, tangent1));
-		linConstB = tangent1; angConstB = (B->getRcrossN(contactPoint, tangent1));
-
-		jA.linT1_scaledM = A->getScaledByMinv(linConstA); jA.angT1_scaledM = A->getScaledByIinv(angConstA);
-		jB.linT1_scaledM = B->getScaledByMinv(linConstB); jB.angT1_scaledM = B->getScaledByIinv(angConstB);
-
-		double D_row2_inv = glm::dot(linConstA, jA.linT1_scaledM) + glm::dot(angConstA, jA.angT1_scaledM) +
-						glm::dot(linConstB, jB.linT1_scaledM) + glm::dot(angConstB, jB.angT1_scaledM);
-
-		if (isZero(D_row2_inv, 1e-6)) {
-			std::cerr<<"2:Two Constrained objects colliding..."<<std::endl;
-			exit(0);
-		}
-
-		D_row2_inv = 1.0 / D_row2_inv;
-
-		jA.linT1_scaledD = linConstA * D_row2_inv; jA.angT1_scaledD = angConstA * D_row2_inv;
-		jB.linT1_scaledD = linConstB * D_row2_inv; jB.angT1_scaledD = angConstB * D_row2_inv;
-
-		b_row2_scaledD = glm::dot(linConstA, linImpA) + glm::dot(angConstA, angImpA) +
-						glm::dot(linConstB, linImpB) + glm::dot(angConstB, angImpB);
-
-		b_row2_scaledD *= D_row2_inv;
-
-		/* Compute constraints for tangential direction 2*/
-		// Just randomize the first tangent direction so that tangent forces act from different direction when new contacts are formed.
-		// When averaged over multiple time-steps, tangent forces should span the entire surface plane eliminating the need for second
-		// tangent.
+/*
+ * Row buffers of one precision, indexed by contact or, for deltaVel and pseudoVel, by body. PhysicsWorld
+ * keeps a float and a double set and solves in the one it is set to. The buffers are sized ahead of the
+ * contact count, rows past it are kept for contacts that come back.
+ */
+template <typename T>
+struct ContactRows {
+	typedef T scalar;
+	typedef glm::tvec3<T> vec3;
+	typedef tvec6<T> vec6;
+	typedef tvec2<T> vec2;
+
+	std::vector<vec6> deltaVel;
+
+	std::vector<ivec2> bodyIndex;
+	std::vector<vec6> bufConstNormalD_A;
+	std::vector<vec6> bufConstNormalM_A;
+	std::vector<vec6> bufConstTangentD_A;
+	std::vector<vec6> bufConstTangentM_A;
+	std::vector<vec6> bufConstNormalD_B;
+	std::vector<vec6> bufConstNormalM_B;
+	std::vector<vec6> bufConstTangentD_B;
+	std::vector<vec6> bufConstTangentM_B;
+	std::vector<vec2> bufB;
+	std::vector<vec2> bufLambda;
+	std::vector<vec2> bufDeltaLambda;
+	std::vector<vec2> bufMaterial; // Friction and restitution per contact
+	std::vector<vec6> pseudoVel; // Split impulse velocity per body
+	std::vector<scalar> bufPositionBias; // Penetration recovery speed per contact, scaled like bufB
+	std::vector<scalar> bufPseudoLambda;
+	std::vector<vec2> bufMassShare; // Part of the normal and tangent effective inverse mass that is A's
+	std::vector<vec2> bufRowScale; // Inverse effective mass of the normal and tangent rows, kept with reused rows
+
+	void resize(size_t numContacts) {
+		bodyIndex.resize(numContacts);
+		bufConstNormalD_A.resize(numContacts);
+		bufConstNormalM_A.resize(numContacts);
+		bufConstTangentD_A.resize(numContacts);
+		bufConstTangentM_A.resize(numContacts);
+		bufConstNormalD_B.resize(numContacts);
+		bufConstNormalM_B.resize(numContacts);
+		bufConstTangentD_B.resize(numContacts);
+		bufConstTangentM_B.resize(numContacts);
+		bufB.resize(numContacts);
+		bufLambda.resize(numContacts);
+		bufDeltaLambda.resize(numContacts);
+		bufMaterial.resize(numContacts);
+		bufPositionBias.resize(numContacts);
+		bufPseudoLambda.resize(numContacts);
+		bufMassShare.resize(numContacts);
+		bufRowScale.resize(numContacts);
 	}
-
-	void processContact(double mu) {
-
-		double lambda_final1 = lambda1 - b_row1_scaledD - glm::dot(jA.linN_scaledD, A->deltaV)
-			- glm::dot(jA.angN_scaledD, A->deltaW) - glm::dot(jB.linN_scaledD, B->deltaV)
-	   		- glm::dot(jB.angN_scaledD, B->deltaW);
-
-    	if (lambda_final1 < 0) lambda_final1 = 0;
-
-    	double lambda_final2 = lambda2 - b_row2_scaledD - glm::dot(jA.linT1_scaledD, A->deltaV)
-   			- glm::dot(jA.angT1_scaledD, A->deltaW) - glm::dot(jB.linT1_scaledD, B->deltaV)
-    		- glm::dot(jB.angT1_scaledD, B->deltaW);
-
-    	double max_tangent1 = mu * lambda_final1;
-    	if (lambda_final2 < - max_tangent1) lambda_final2 = - max_tangent1;
-    	else if (lambda_final2 > max_tangent1) lambda_final2 = max_tangent1;
-
-    	double delta_lambda1 = lambda_final1 - lambda1;
-    	double delta_lambda2 = lambda_final2 - lambda2;
-
-    	A->deltaV += jA.linN_scaledM * delta_lambda1 + jA.linT1_scaledM * delta_lambda2;
-    	A->deltaW += jA.angN_scaledM * delta_lambda1 + jA.angT1_scaledM * delta_lambda2;
-
-		B->deltaV += jB.linN_scaledM * delta_lambda1 + jB.linT1_scaledM * delta_lambda2;
-    	B->deltaW += jB.angN_scaledM * delta_lambda1 + jB.angT1_scaledM * delta_lambda2;
-
-    	lambda1 = lambda_final1;
-    	lambda2 = lambda_final2;
-
-    	processed = true;
+	void resizeBodies(size_t numBodies) {
+		deltaVel.resize(numBodies);
+		pseudoVel.resize(numBodies);
 	}
-
 };
-#endif //USE_FULL_JACOBIAN
-
-#else
-struct ContactJacobian {
-	/* Normal Constraints*/
-	glm::dvec3 linN_scaledD, angN_scaledD; // Normal constraints scaled by D_row1_inv
-	glm::dvec3 linN_scaledM, angN_scaledM; // Normal constraints scaled by inverse mass and inverse inertia
 
-	glm::dvec3 linT1_scaledD, angT1_scaledD;
-	glm::dvec3 linT1_scaledM, angT1_scaledM;
-};
+/* Row times the velocity of one body, in double */
+template <typename T>
+inline double rowDot(const tvec6<T> &row, const glm::dvec3 &lin, const glm::dvec3 &ang) {
+	return glm::dot(glm::dvec3(row.vLin), lin) + glm::dot(glm::dvec3(row.vAng), ang);
+}
 
 class Contact {
-	RigidBody *A;
-	RigidBody *B;
-public:
-	ContactJacobian jA;
-	ContactJacobian jB;
-	double b_row1_scaledD;
-	double b_row2_scaledD;
-
-	double lambda1;
-	double lambda2;
-
-	double delta_lambda1;
-	double delta_lambda2;
-
-	Contact(RigidBody *A, RigidBody *B, const glm::dvec3 &contactPoint, const glm::dvec3 &contactNormal, double bounce, double dt) {
-		A->deltaV = glm::dvec3(0,0,0); A->deltaW = glm::dvec3(0,0,0);
-		B->deltaV = glm::dvec3(0,0,0); B->deltaW = glm::dvec3(0,0,0);
-
-		lambda1 = lambda2 = 0;
-
-		glm::dvec3 linConstA, linConstB; //linear constraint
-		glm::dvec3 angConstA, angConstB; //angular constraint
-
-
-		this->A = A;
-		this->B = B;
-
-		glm::dvec3 linImpA = A->getLinearImpulse(dt); glm::dvec3 angImpA = A->getAngularImpulse(dt);
-		glm::dvec3 linImpB = B->getLinearImpulse(dt); glm::dvec3 angImpB = B->getAngularImpulse(dt);
-
-		/* compute constraints for Normal direction*/
-		linConstA = -contactNormal; angConstA = -(A->getRcrossN(contactPoint, contactNormal));
-		linConstB = contactNormal; angConstB = B->getRcrossN(contactPoint, contactNormal);
+	unsigned int numContactsA;
+	unsigned int numContactsB;
+	bool dynamicA;
+	bool dynamicB;
 
-		jA.linN_scaledM = A->getScaledByMinv(linConstA); jA.angN_scaledM = A->getScaledByIinv(angConstA);
-		jB.linN_scaledM = B->getScaledByMinv(linConstB); jB.angN_scaledM = B->getScaledByIinv(angConstB);
+public:
+	/* Placeholder for the contacts not yet solved, assigned before use */
+	Contact() : numContactsA(1), numContactsB(1), dynamicA(false), dynamicB(false) {}
+
+	/*
+	 * Rows are computed in the double precision of the bodies and rounded to T once, when stored.
+	 * Without buildRows the rows already at index are kept and only B and the position bias are updated.
+	 */
+	template <typename T>
+	Contact(ContactRows<T> &rows, unsigned int index, RigidBody *A, RigidBody *B, const glm::dvec3 &contactPoint, const glm::dvec3 &contactNormal,
+			double friction, double bounce, double dt, double lambdaN, double lambdaT, double tangentAngle, double positionBias, bool buildRows) {
+		typedef typename ContactRows<T>::vec3 vec3;
+		double sP = 1.0; // Decrease the value for stabilization
+
+		rows.bodyIndex[index].indexA = A->index;
+		rows.bodyIndex[index].indexB = B->index;
+
+		rows.bufLambda[index].s1 = lambdaN; rows.bufLambda[index].s2 = lambdaT;
+		rows.bufMaterial[index].s1 = friction; rows.bufMaterial[index].s2 = bounce;
+
+		dynamicA = !A->isConstrained();
+		dynamicB = !B->isConstrained();
+		numContactsA = A->numContacts != 0 ? A->numContacts : 1;
+		numContactsB = B->numContacts != 0 ? B->numContacts : 1;
+
+		if (buildRows) {
+			glm::dvec3 linConstA, linConstB; //linear constraint
+			glm::dvec3 angConstA, angConstB; //angular constraint
+			glm::dvec3 linConstM_A, linConstM_B; // Scaled by inverse mass
+			glm::dvec3 angConstM_A, angConstM_B; // Scaled by inverse inertia
+
+			/* compute constraints for Normal direction*/
+			linConstA = -contactNormal; angConstA = -(A->getRcrossN(contactPoint, contactNormal));
+			linConstB = contactNormal; angConstB = B->getRcrossN(contactPoint, contactNormal);
+
+			linConstM_A = A->getScaledByMinv(linConstA); angConstM_A = A->getScaledByIinv(angConstA);
+			linConstM_B = B->getScaledByMinv(linConstB); angConstM_B = B->getScaledByIinv(angConstB);
+			rows.bufConstNormalM_A[index].vLin = vec3(linConstM_A); rows.bufConstNormalM_A[index].vAng = vec3(angConstM_A);
+			rows.bufConstNormalM_B[index].vLin = vec3(linConstM_B); rows.bufConstNormalM_B[index].vAng = vec3(angConstM_B);
+
+			double K_row1_A = glm::dot(linConstA, linConstM_A) + glm::dot(angConstA, angConstM_A);
+			double D_row1_inv = K_row1_A + glm::dot(linConstB, linConstM_B) + glm::dot(angConstB, angConstM_B);
+
+			if (isZero(D_row1_inv, 1e-6)) {
+				std::cerr<<"1:Two Constrained objects colliding..."<<std::endl;
+				exit(0);
+			}
 
-		double D_row1_inv = glm::dot(linConstA, jA.linN_scaledM) + glm::dot(angConstA, jA.angN_scaledM) +
-				glm::dot(linConstB, jB.linN_scaledM) + glm::dot(angConstB, jB.angN_scaledM);
+			rows.bufMassShare[index].s1 = K_row1_A / D_row1_inv;
+			D_row1_inv = sP / D_row1_inv;
+			rows.bufRowScale[index].s1 = D_row1_inv;
 
-		if (isZero(D_row1_inv, 1e-6)) {
-			std::cerr<<"1:Two Constrained objects colliding..."<<std::endl;
-			exit(0);
-		}
+			rows.bufConstNormalD_A[index].vLin = vec3(linConstA * D_row1_inv); rows.bufConstNormalD_A[index].vAng = vec3(angConstA * D_row1_inv);
+			rows.bufConstNormalD_B[index].vLin = vec3(linConstB * D_row1_inv); rows.bufConstNormalD_B[index].vAng = vec3(angConstB * D_row1_inv);
 
-		D_row1_inv = 1.0 / D_row1_inv;
 
-		jA.linN_scaledD = linConstA * D_row1_inv; jA.angN_scaledD = angConstA * D_row1_inv;
-		jB.linN_scaledD = linConstB * D_row1_inv; jB.angN_scaledD = angConstB * D_row1_inv;
 
-		b_row1_scaledD = glm::dot(linConstA, linImpA) + glm::dot(angConstA, angImpA) +
-				glm::dot(linConstB, linImpB) + glm::dot(angConstB, angImpB) +
-		/*bounce*/ bounce * (A->getDotWithV(linConstA) + A->getDotWithW(angConstA) + B->getDotWithV(linConstB) + B->getDotWithW(angConstB));
 
-		b_row1_scaledD *= D_row1_inv;
+			/* Compute constraints for tangential direction 1*/
+			glm::dvec3 tangent1 = contactTangent(contactNormal, tangentAngle);
 
+			linConstA = -tangent1; angConstA = -(A->getRcrossN(contactPoint, tangent1));
+			linConstB = tangent1; angConstB = (B->getRcrossN(contactPoint, tangent1));
 
+			linConstM_A = A->getScaledByMinv(linConstA); angConstM_A = A->getScaledByIinv(angConstA);
+			linConstM_B = B->getScaledByMinv(linConstB); angConstM_B = B->getScaledByIinv(angConstB);
+			rows.bufConstTangentM_A[index].vLin = vec3(linConstM_A); rows.bufConstTangentM_A[index].vAng = vec3(angConstM_A);
+			rows.bufConstTangentM_B[index].vLin = vec3(linConstM_B); rows.bufConstTangentM_B[index].vAng = vec3(angConstM_B);
 
+			double K_row2_A = glm::dot(linConstA, linConstM_A) + glm::dot(angConstA, angConstM_A);
+			double D_row2_inv = K_row2_A + glm::dot(linConstB, linConstM_B) + glm::dot(angConstB, angConstM_B);
 
-		/* Compute constraints for tangential direction 1*/
-		glm::dvec3 tangent1(std::rand(), std::rand(), std::rand());
-		tangent1 = glm::normalize(tangent1);
-		if (isnZero(glm::dot(tangent1, contactNormal), 1e-4)) {
-			tangent1 = glm::cross(contactNormal, tangent1);
-			tangent1 = glm::normalize(tangent1);
-		}
-		else {
-			if (isnZero(contactNormal.x, 1e-3))
-				tangent1 = glm::dvec3(-contactNormal.y-contactNormal.z, contactNormal.x, contactNormal.x);
-			else if (isnZero(contactNormal.y, 1e-6))
-				tangent1 = glm::dvec3(contactNormal.y, -contactNormal.z - contactNormal.x, contactNormal.y);
-			else if (isnZero(contactNormal.z, 1e-16))
-				tangent1 = glm::dvec3(contactNormal.z, contactNormal.z, - contactNormal.x - contactNormal.y);
-			else {
-				std::cerr<<"Contact Normal is zero."<<std::endl;
+			if (isZero(D_row2_inv, 1e-6)) {
+				std::cerr<<"2:Two Constrained objects colliding..."<<std::endl;
 				exit(0);
 			}
-			tangent1 = glm::normalize(tangent1);
-		}
-
-		linConstA = -tangent1; angConstA = -(A->getRcrossN(contactPoint, tangent1));
-		linConstB = tangent1; angConstB = (B->getRcrossN(contactPoint, tangent1));
 
-		jA.linT1_scaledM = A->getScaledByMinv(linConstA); jA.angT1_scaledM = A->getScaledByIinv(angConstA);
-		jB.linT1_scaledM = B->getScaledByMinv(linConstB); jB.angT1_scaledM = B->getScaledByIinv(angConstB);
+			rows.bufMassShare[index].s2 = K_row2_A / D_row2_inv;
+			D_row2_inv = sP / D_row2_inv;
+			rows.bufRowScale[index].s2 = D_row2_inv;
 
-		double D_row2_inv = glm::dot(linConstA, jA.linT1_scaledM) + glm::dot(angConstA, jA.angT1_scaledM) +
-						glm::dot(linConstB, jB.linT1_scaledM) + glm::dot(angConstB, jB.angT1_scaledM);
+			rows.bufConstTangentD_A[index].vLin = vec3(linConstA * D_row2_inv); rows.bufConstTangentD_A[index].vAng = vec3(angConstA * D_row2_inv);
+			rows.bufConstTangentD_B[index].vLin = vec3(linConstB * D_row2_inv); rows.bufConstTangentD_B[index].vAng = vec3(angConstB * D_row2_inv);
 
-		if (isZero(D_row2_inv, 1e-6)) {
-			std::cerr<<"2:Two Constrained objects colliding..."<<std::endl;
-			exit(0);
+			//For stabilization
+			if (A->numContacts != 0) {
+				T factor = 1;
+				rows.bufConstNormalM_A[index].vLin = factor * rows.bufConstNormalM_A[index].vLin / (T)A->numContacts;
+				rows.bufConstNormalM_A[index].vAng = factor * rows.bufConstNormalM_A[index].vAng / (T)A->numContacts;
+			}
+			if (B->numContacts != 0) {
+				T factor = 1;
+				rows.bufConstNormalM_B[index].vLin = factor * rows.bufConstNormalM_B[index].vLin / (T)B->numContacts;
+				rows.bufConstNormalM_B[index].vAng = factor * rows.bufConstNormalM_B[index].vAng / (T)B->numContacts;
+			}
+			/* Compute constraints for tangential direction 2*/
+			// Just randomize the first tangent direction so that tangent forces act from different direction when new contacts are formed.
+			// When averaged over multiple time-steps, tangent forces should span the entire surface plane eliminating the need for second
+			// tangent.
 		}
 
-		D_row2_inv = 1.0 / D_row2_inv;
-
-		jA.linT1_scaledD = linConstA * D_row2_inv; jA.angT1_scaledD = angConstA * D_row2_inv;
-		jB.linT1_scaledD = linConstB * D_row2_inv; jB.angT1_scaledD = angConstB * D_row2_inv;
-
-		b_row2_scaledD = glm::dot(linConstA, linImpA) + glm::dot(angConstA, angImpA) +
-						glm::dot(linConstB, linImpB) + glm::dot(angConstB, angImpB);
+		/* The D rows are J / K, B follows from them whether they were just built or kept */
+		glm::dvec3 linImpA = A->getLinearImpulse(dt); glm::dvec3 angImpA = A->getAngularImpulse(dt);
+		glm::dvec3 linImpB = B->getLinearImpulse(dt); glm::dvec3 angImpB = B->getAngularImpulse(dt);
 
-		b_row2_scaledD *= D_row2_inv;
+		rows.bufB[index].s1 = rowDot(rows.bufConstNormalD_A[index], linImpA, angImpA) + rowDot(rows.bufConstNormalD_B[index], linImpB, angImpB) +
+		/*bounce*/ bounce * (A->getDotWithV(glm::dvec3(rows.bufConstNormalD_A[index].vLin)) + A->getDotWithW(glm::dvec3(rows.bufConstNormalD_A[index].vAng)) +
+				B->getDotWithV(glm::dvec3(rows.bufConstNormalD_B[index].vLin)) + B->getDotWithW(glm::dvec3(rows.bufConstNormalD_B[index].vAng)));
+		rows.bufB[index].s2 = rowDot(rows.bufConstTangentD_A[index], linImpA, angImpA) + rowDot(rows.bufConstTangentD_B[index], linImpB, angImpB);
 
-		//For stabilization
-		if (A->numContacts != 0) {
-			jA.linN_scaledM = jA.linN_scaledM / (double)A->numContacts;
-			jA.angN_scaledM = jA.angN_scaledM / (double)A->numContacts;
-		}
-		if (B->numContacts != 0) {
-			jB.linN_scaledM = jB.linN_scaledM / (double)B->numContacts;
-			jB.angN_scaledM = jB.angN_scaledM / (double)B->numContacts;
-		}
-		/* Compute constraints for tangential direction 2*/
-		// Just randomize the first tangent direction so that tangent forces act from different direction when new contacts are formed.
-		// When averaged over multiple time-steps, tangent forces should span the entire surface plane eliminating the need for second
-		// tangent.
+		rows.bufPositionBias[index] = positionBias * rows.bufRowScale[index].s1;
+		rows.bufPseudoLambda[index] = 0;
 	}
 	// Do Parallel
-	void processContact1(double mu) {
-
-	    	double lambda_final1 = lambda1 - b_row1_scaledD - glm::dot(jA.linN_scaledD, A->deltaV)
-	    		- glm::dot(jA.angN_scaledD, A->deltaW) - glm::dot(jB.linN_scaledD, B->deltaV)
-    			- glm::dot(jB.angN_scaledD, B->deltaW);
-
-	    	if (lambda_final1 < 0) lambda_final1 = 0;
-
-	    	double lambda_final2 = lambda2 - b_row2_scaledD - glm::dot(jA.linT1_scaledD, A->deltaV)
-    			- glm::dot(jA.angT1_scaledD, A->deltaW) - glm::dot(jB.linT1_scaledD, B->deltaV)
-	    		- glm::dot(jB.angT1_scaledD, B->deltaW);
-
-	    	double max_tangent1 = mu * lambda_final1;
-	    	if (lambda_final2 < - max_tangent1) lambda_final2 = - max_tangent1;
-	    	else if (lambda_final2 > max_tangent1) lambda_final2 = max_tangent1;
-
-	    	delta_lambda1 = lambda_final1 - lambda1;
-	    	delta_lambda2 = lambda_final2 - lambda2;
-
-	    	lambda1 = lambda_final1;
-	    	lambda2 = lambda_final2;
-
-	}
-	//Do Sequential
-	void processContact2() {
-
-	    	A->deltaV += jA.linN_scaledM * delta_lambda1 + jA.linT1_scaledM * delta_lambda2;
-	    	A->deltaW += jA.angN_scaledM * delta_lambda1 + jA.angT1_scaledM * delta_lambda2;
-
-			B->deltaV += jB.linN_scaledM * delta_lambda1 + jB.linT1_scaledM * delta_lambda2;
-	    	B->deltaW += jB.angN_scaledM * delta_lambda1 + jB.angT1_scaledM * delta_lambda2;
+	/* Apply the warm start impulse to deltaVel */
+	template <typename T>
+	void warmStart(ContactRows<T> &rows, unsigned int index) {
+		tvec6<T> &deltaA = rows.deltaVel[rows.bodyIndex[index].indexA];
+		tvec6<T> &deltaB = rows.deltaVel[rows.bodyIndex[index].indexB];
+		const tvec2<T> &lambda = rows.bufLambda[index];
+
+		deltaA.vLin += rows.bufConstNormalM_A[index].vLin * lambda.s1 + rows.bufConstTangentM_A[index].vLin * lambda.s2;
+		deltaA.vAng += rows.bufConstNormalM_A[index].vAng * lambda.s1 + rows.bufConstTangentM_A[index].vAng * lambda.s2;
+
+		deltaB.vLin += rows.bufConstNormalM_B[index].vLin * lambda.s1 + rows.bufConstTangentM_B[index].vLin * lambda.s2;
+		deltaB.vAng += rows.bufConstNormalM_B[index].vAng * lambda.s1 + rows.bufConstTangentM_B[index].vAng * lambda.s2;
 	}
 
-};
-#endif // PGS
-#else
-#include "DataType.h"
-
-std::vector<vec6> deltaVel;
-
-std::vector<ivec2> bodyIndex;
-std::vector<vec6> bufConstNormalD_A;
-std::vector<vec6> bufConstNormalM_A;
-std::vector<vec6> bufConstTangentD_A;
-std::vector<vec6> bufConstTangentM_A;
-std::vector<vec6> bufConstNormalD_B;
-std::vector<vec6> bufConstNormalM_B;
-std::vector<vec6> bufConstTangentD_B;
-std::vector<vec6> bufConstTangentM_B;
-std::vector<vec2> bufB;
-std::vector<vec2> bufLambda;
-std::vector<vec2> bufDeltaLambda;
-
-class Contact {
-	unsigned int numContactsA;
-	unsigned int numContactsB;
-
-public:
-	bool processed;
-	Contact(unsigned int index, RigidBody *A, RigidBody *B, const vec3 &contactPoint, const vec3 &contactNormal, scalar bounce, scalar dt) {
-		scalar sP = 1.0; // Decrease the value for stabilization
-
-		bodyIndex[index].indexA = A->index;
-		bodyIndex[index].indexB = B->index;
-
-		bufLambda[index].s1 = bufLambda[index].s2 = 0;
-
-		vec3 linConstA, linConstB; //linear constraint
-		vec3 angConstA, angConstB; //angular constraint
-
-		vec3 linImpA = A->getLinearImpulse(dt); vec3 angImpA = A->getAngularImpulse(dt);
-		vec3 linImpB = B->getLinearImpulse(dt); vec3 angImpB = B->getAngularImpulse(dt);
-
-		/* compute constraints for Normal direction*/
-		linConstA = -contactNormal; angConstA = -(A->getRcrossN(contactPoint, contactNormal));
-		linConstB = contactNormal; angConstB = B->getRcrossN(contactPoint, contactNormal);
-
-		bufConstNormalM_A[index].vLin = A->getScaledByMinv(linConstA); bufConstNormalM_A[index].vAng = A->getScaledByIinv(angConstA);
-		bufConstNormalM_B[index].vLin = B->getScaledByMinv(linConstB); bufConstNormalM_B[index].vAng = B->getScaledByIinv(angConstB);
-
-		scalar D_row1_inv = glm::dot(linConstA, bufConstNormalM_A[index].vLin) + glm::dot(angConstA, bufConstNormalM_A[index].vAng) +
-				glm::dot(linConstB, bufConstNormalM_B[index].vLin) + glm::dot(angConstB, bufConstNormalM_B[index].vAng);
-
-		if (isZero(D_row1_inv, 1e-6)) {
-			std::cerr<<"1:Two Constrained objects colliding..."<<std::endl;
-			exit(0);
-		}
-
-		D_row1_inv = sP / D_row1_inv;
-
-		bufConstNormalD_A[index].vLin = linConstA * D_row1_inv; bufConstNormalD_A[index].vAng = angConstA * D_row1_inv;
-		bufConstNormalD_B[index].vLin = linConstB * D_row1_inv; bufConstNormalD_B[index].vAng = angConstB * D_row1_inv;
-
-		bufB[index].s1 = glm::dot(linConstA, linImpA) + glm::dot(angConstA, angImpA) +
-				glm::dot(linConstB, linImpB) + glm::dot(angConstB, angImpB) +
-		/*bounce*/ bounce * (A->getDotWithV(linConstA) + A->getDotWithW(angConstA) + B->getDotWithV(linConstB) + B->getDotWithW(angConstB));
-
-		bufB[index].s1 *= D_row1_inv;
-
-
-
-
-		/* Compute constraints for tangential direction 1*/
-		vec3 tangent1(std::rand(), std::rand(), std::rand());
-		tangent1 = glm::normalize(tangent1);
-		if (isnZero(glm::dot(tangent1, contactNormal), 1e-4)) {
-			tangent1 = glm::cross(contactNormal, tangent1);
-			tangent1 = glm::normalize(tangent1);
-		}
-		else {
-			if (isnZero(contactNormal.x, 1e-3))
-				tangent1 = glm::dvec3(-contactNormal.y-contactNormal.z, contactNormal.x, contactNormal.x);
-			else if (isnZero(contactNormal.y, 1e-6))
-				tangent1 = glm::dvec3(contactNormal.y, -contactNormal.z - contactNormal.x, contactNormal.y);
-			else if (isnZero(contactNormal.z, 1e-16))
-				tangent1 = glm::dvec3(contactNormal.z, contactNormal.z, - contactNormal.x - contactNormal.y);
-			else {
-				std::cerr<<"Contact Normal is zero."<<std::endl;
-				exit(0);
-			}
-			tangent1 = glm::normalize(tangent1);
+	/*
+	 * Gauss-Seidel on both rows for PgsSolver, the rows are built without the Jacobi contact counts.
+	 * Constrained bodies are never written, so islands can run this concurrently.
+	 */
+	template <typename T>
+	void processContact(ContactRows<T> &rows, unsigned int index, Residual &residual) {
+		tvec6<T> &deltaA = rows.deltaVel[rows.bodyIndex[index].indexA];
+		tvec6<T> &deltaB = rows.deltaVel[rows.bodyIndex[index].indexB];
+
+		T lambda_final1 = rows.bufLambda[index].s1 - rows.bufB[index].s1 - glm::dot(rows.bufConstNormalD_A[index].vLin, deltaA.vLin)
+			- glm::dot(rows.bufConstNormalD_A[index].vAng, deltaA.vAng) - glm::dot(rows.bufConstNormalD_B[index].vLin, deltaB.vLin)
+			- glm::dot(rows.bufConstNormalD_B[index].vAng, deltaB.vAng);
+		if (lambda_final1 < 0) lambda_final1 = 0;
+
+		T lambda_final2 = rows.bufLambda[index].s2 - rows.bufB[index].s2 - glm::dot(rows.bufConstTangentD_A[index].vLin, deltaA.vLin)
+			- glm::dot(rows.bufConstTangentD_A[index].vAng, deltaA.vAng) - glm::dot(rows.bufConstTangentD_B[index].vLin, deltaB.vLin)
+			- glm::dot(rows.bufConstTangentD_B[index].vAng, deltaB.vAng);
+		T max_tangent1 = rows.bufMaterial[index].s1 * lambda_final1;
+		if (lambda_final2 < - max_tangent1) lambda_final2 = - max_tangent1;
+		else if (lambda_final2 > max_tangent1) lambda_final2 = max_tangent1;
+
+		T deltaLambda1 = lambda_final1 - rows.bufLambda[index].s1;
+		T deltaLambda2 = lambda_final2 - rows.bufLambda[index].s2;
+		rows.bufLambda[index].s1 = lambda_final1;
+		rows.bufLambda[index].s2 = lambda_final2;
+
+		if (dynamicA) {
+			deltaA.vLin += rows.bufConstNormalM_A[index].vLin * deltaLambda1 + rows.bufConstTangentM_A[index].vLin * deltaLambda2;
+			deltaA.vAng += rows.bufConstNormalM_A[index].vAng * deltaLambda1 + rows.bufConstTangentM_A[index].vAng * deltaLambda2;
 		}
-
-		linConstA = -tangent1; angConstA = -(A->getRcrossN(contactPoint, tangent1));
-		linConstB = tangent1; angConstB = (B->getRcrossN(contactPoint, tangent1));
-
-		bufConstTangentM_A[index].vLin = A->getScaledByMinv(linConstA); bufConstTangentM_A[index].vAng = A->getScaledByIinv(angConstA);
-		bufConstTangentM_B[index].vLin = B->getScaledByMinv(linConstB); bufConstTangentM_B[index].vAng = B->getScaledByIinv(angConstB);
-
-		scalar D_row2_inv = glm::dot(linConstA, bufConstTangentM_A[index].vLin) + glm::dot(angConstA, bufConstTangentM_A[index].vAng) +
-						glm::dot(linConstB, bufConstTangentM_B[index].vLin) + glm::dot(angConstB, bufConstTangentM_B[index].vAng);
-
-		if (isZero(D_row2_inv, 1e-6)) {
-			std::cerr<<"2:Two Constrained objects colliding..."<<std::endl;
-			exit(0);
+		if (dynamicB) {
+			deltaB.vLin += rows.bufConstNormalM_B[index].vLin * deltaLambda1 + rows.bufConstTangentM_B[index].vLin * deltaLambda2;
+			deltaB.vAng += rows.bufConstNormalM_B[index].vAng * deltaLambda1 + rows.bufConstTangentM_B[index].vAng * deltaLambda2;
 		}
 
-		D_row2_inv = sP / D_row2_inv;
-
-		bufConstTangentD_A[index].vLin = linConstA * D_row2_inv; bufConstTangentD_A[index].vAng = angConstA * D_row2_inv;
-		bufConstTangentD_B[index].vLin = linConstB * D_row2_inv; bufConstTangentD_B[index].vAng = angConstB * D_row2_inv;
-
-		bufB[index].s2 = glm::dot(linConstA, linImpA) + glm::dot(angConstA, angImpA) +
-						glm::dot(linConstB, linImpB) + glm::dot(angConstB, angImpB);
-
-		bufB[index].s2 *= D_row2_inv;
+		residual.add(deltaLambda1, deltaLambda2, lambda_final1, lambda_final2);
+	}
 
-		numContactsA = 1;
-		numContactsB = 1;
-		//For stabilization
-		if (A->numContacts != 0) {
-			scalar factor = 1;
-			bufConstNormalM_A[index].vLin = factor * bufConstNormalM_A[index].vLin / (scalar)A->numContacts;
-			bufConstNormalM_A[index].vAng = factor * bufConstNormalM_A[index].vAng / (scalar)A->numContacts;
-			numContactsA = A->numContacts;
+	/*
+	 * Shock propagation, Gauss-Seidel on both rows with a body of a lower layer frozen as if its mass were
+	 * infinite. The rows are scaled for both bodies, dividing by the mass share of the one that moves rescales
+	 * them to it. The normal M rows are scaled up again by the contact count the Jacobi solvers divided out.
+	 */
+	template <typename T>
+	void processShock(ContactRows<T> &rows, unsigned int index, bool frozenA, bool frozenB) {
+		T shareN = frozenA ? 1 - rows.bufMassShare[index].s1 : frozenB ? rows.bufMassShare[index].s1 : 1;
+		T shareT = frozenA ? 1 - rows.bufMassShare[index].s2 : frozenB ? rows.bufMassShare[index].s2 : 1;
+		if (shareN < (T)1e-6 || shareT < (T)1e-6)
+			return;
+
+		tvec6<T> &deltaA = rows.deltaVel[rows.bodyIndex[index].indexA];
+		tvec6<T> &deltaB = rows.deltaVel[rows.bodyIndex[index].indexB];
+
+		T lambda_final1 = rows.bufLambda[index].s1 + (- rows.bufB[index].s1 - glm::dot(rows.bufConstNormalD_A[index].vLin, deltaA.vLin)
+			- glm::dot(rows.bufConstNormalD_A[index].vAng, deltaA.vAng) - glm::dot(rows.bufConstNormalD_B[index].vLin, deltaB.vLin)
+			- glm::dot(rows.bufConstNormalD_B[index].vAng, deltaB.vAng)) / shareN;
+		if (lambda_final1 < 0) lambda_final1 = 0;
+
+		T lambda_final2 = rows.bufLambda[index].s2 + (- rows.bufB[index].s2 - glm::dot(rows.bufConstTangentD_A[index].vLin, deltaA.vLin)
+			- glm::dot(rows.bufConstTangentD_A[index].vAng, deltaA.vAng) - glm::dot(rows.bufConstTangentD_B[index].vLin, deltaB.vLin)
+			- glm::dot(rows.bufConstTangentD_B[index].vAng, deltaB.vAng)) / shareT;
+		T max_tangent1 = rows.bufMaterial[index].s1 * lambda_final1;
+		if (lambda_final2 < - max_tangent1) lambda_final2 = - max_tangent1;
+		else if (lambda_final2 > max_tangent1) lambda_final2 = max_tangent1;
+
+		T deltaLambda1 = lambda_final1 - rows.bufLambda[index].s1;
+		T deltaLambda2 = lambda_final2 - rows.bufLambda[index].s2;
+		rows.bufLambda[index].s1 = lambda_final1;
+		rows.bufLambda[index].s2 = lambda_final2;
+
+		if (dynamicA && !frozenA) {
+			deltaA.vLin += rows.bufConstNormalM_A[index].vLin * (deltaLambda1 * (T)numContactsA) + rows.bufConstTangentM_A[index].vLin * deltaLambda2;
+			deltaA.vAng += rows.bufConstNormalM_A[index].vAng * (deltaLambda1 * (T)numContactsA) + rows.bufConstTangentM_A[index].vAng * deltaLambda2;
 		}
-		if (B->numContacts != 0) {
-			scalar factor = 1;
-			bufConstNormalM_B[index].vLin = factor * bufConstNormalM_B[index].vLin / (scalar)B->numContacts;
-			bufConstNormalM_B[index].vAng = factor * bufConstNormalM_B[index].vAng / (scalar)B->numContacts;
-			numContactsB = B->numContacts;
+		if (dynamicB && !frozenB) {
+			deltaB.vLin += rows.bufConstNormalM_B[index].vLin * (deltaLambda1 * (T)numContactsB) + rows.bufConstTangentM_B[index].vLin * deltaLambda2;
+			deltaB.vAng += rows.bufConstNormalM_B[index].vAng * (deltaLambda1 * (T)numContactsB) + rows.bufConstTangentM_B[index].vAng * deltaLambda2;
 		}
-		/* Compute constraints for tangential direction 2*/
-		// Just randomize the first tangent direction so that tangent forces act from different direction when new contacts are formed.
-		// When averaged over multiple time-steps, tangent forces should span the entire surface plane eliminating the need for second
-		// tangent.
 	}
-	// Do Parallel
-	void processContact1(unsigned int index, double mu) {
-			vec3 deltaALin = deltaVel[bodyIndex[index].indexA].vLin;
-			vec3 deltaAAng = deltaVel[bodyIndex[index].indexA].vAng;
-			vec3 deltaBLin = deltaVel[bodyIndex[index].indexB].vLin;
-			vec3 deltaBAng = deltaVel[bodyIndex[index].indexB].vAng;
-
-	    	scalar lambda_final1 = bufLambda[index].s1 - bufB[index].s1 - glm::dot(bufConstNormalD_A[index].vLin, deltaALin)
-	    		- glm::dot(bufConstNormalD_A[index].vAng, deltaAAng) - glm::dot(bufConstNormalD_B[index].vLin, deltaBLin)
-    			- glm::dot(bufConstNormalD_B[index].vAng, deltaBAng);
-
-	    	if (lambda_final1 < 0) lambda_final1 = 0;
 
-	    	scalar lambda_final2 = bufLambda[index].s2 - bufB[index].s2 - glm::dot(bufConstTangentD_A[index].vLin, deltaALin)
-    			- glm::dot(bufConstTangentD_A[index].vAng, deltaAAng) - glm::dot(bufConstTangentD_B[index].vLin, deltaBLin)
-	    		- glm::dot(bufConstTangentD_B[index].vAng, deltaBAng);
+	/*
+	 * Gauss-Seidel on the normal row against pseudoVel, reusing the velocity pass rows. As in processShock
+	 * the normal M rows are scaled up again by the contact count the Jacobi solvers divided out. Constrained
+	 * bodies are never written, so islands can run this concurrently.
+	 */
+	template <typename T>
+	void processPosition(ContactRows<T> &rows, unsigned int index) {
+		tvec6<T> &pseudoA = rows.pseudoVel[rows.bodyIndex[index].indexA];
+		tvec6<T> &pseudoB = rows.pseudoVel[rows.bodyIndex[index].indexB];
 
-	    	scalar max_tangent1 = mu * lambda_final1;
-	    	if (lambda_final2 < - max_tangent1) lambda_final2 = - max_tangent1;
-	    	else if (lambda_final2 > max_tangent1) lambda_final2 = max_tangent1;
+		T lambda_final = rows.bufPseudoLambda[index] + rows.bufPositionBias[index] - glm::dot(rows.bufConstNormalD_A[index].vLin, pseudoA.vLin)
+			- glm::dot(rows.bufConstNormalD_A[index].vAng, pseudoA.vAng) - glm::dot(rows.bufConstNormalD_B[index].vLin, pseudoB.vLin)
+			- glm::dot(rows.bufConstNormalD_B[index].vAng, pseudoB.vAng);
 
-	    	bufDeltaLambda[index].s1 = lambda_final1 - bufLambda[index].s1;
-	    	bufDeltaLambda[index].s2 = lambda_final2 - bufLambda[index].s2;
+		if (lambda_final < 0) lambda_final = 0;
 
-	    	bufLambda[index].s1 = lambda_final1;
-	    	bufLambda[index].s2 = lambda_final2;
+		T deltaLambda = lambda_final - rows.bufPseudoLambda[index];
+		rows.bufPseudoLambda[index] = lambda_final;
 
-	}
-	//Do Sequential
-	void processContact2(unsigned int index) {
-		deltaVel[bodyIndex[index].indexA].vLin += bufConstNormalM_A[index].vLin * bufDeltaLambda[index].s1 + bufConstTangentM_A[index].vLin * bufDeltaLambda[index].s2;
-		deltaVel[bodyIndex[index].indexA].vAng += bufConstNormalM_A[index].vAng * bufDeltaLambda[index].s1 + bufConstTangentM_A[index].vAng * bufDeltaLambda[index].s2;
-
-		deltaVel[bodyIndex[index].indexB].vLin += bufConstNormalM_B[index].vLin * bufDeltaLambda[index].s1 + bufConstTangentM_B[index].vLin * bufDeltaLambda[index].s2;
-		deltaVel[bodyIndex[index].indexB].vAng += bufConstNormalM_B[index].vAng * bufDeltaLambda[index].s1 + bufConstTangentM_B[index].vAng * bufDeltaLambda[index].s2;
-	}
-
-	void processContactA(unsigned int index, double mu) {
-				vec3 deltaALin = deltaVel[bodyIndex[index].indexA].vLin;
-				vec3 deltaAAng = deltaVel[bodyIndex[index].indexA].vAng;
-				vec3 deltaBLin = deltaVel[bodyIndex[index].indexB].vLin;
-				vec3 deltaBAng = deltaVel[bodyIndex[index].indexB].vAng;
-
-		    	scalar lambda_final1 = bufLambda[index].s1 - bufB[index].s1 - glm::dot(bufConstNormalD_A[index].vLin, deltaALin)
-		    		- glm::dot(bufConstNormalD_A[index].vAng, deltaAAng) - glm::dot(bufConstNormalD_B[index].vLin, deltaBLin)
-	    			- glm::dot(bufConstNormalD_B[index].vAng, deltaBAng);
-
-		    	if (lambda_final1 < 0) lambda_final1 = 0;
-
-		    	scalar lambda_final2 = bufLambda[index].s2 - bufB[index].s2 - glm::dot(bufConstTangentD_A[index].vLin, deltaALin)
-	    			- glm::dot(bufConstTangentD_A[index].vAng, deltaAAng) - glm::dot(bufConstTangentD_B[index].vLin, deltaBLin)
-		    		- glm::dot(bufConstTangentD_B[index].vAng, deltaBAng);
-
-		    	scalar max_tangent1 = mu * lambda_final1;
-		    	if (lambda_final2 < - max_tangent1) lambda_final2 = - max_tangent1;
-		    	else if (lambda_final2 > max_tangent1) lambda_final2 = max_tangent1;
-
-		    	scalar deltaLambda1 = lambda_final1 - bufLambda[index].s1;
-		    	scalar deltaLambda2 = lambda_final2 - bufLambda[index].s2;
-
-		    	bufLambda[index].s1 = lambda_final1;
-		    	bufLambda[index].s2 = lambda_final2;
-
-		    	numContactsA = 1;
-		    	numContactsB = 1;
-		    	deltaVel[bodyIndex[index].indexA].vLin += bufConstNormalM_A[index].vLin * (deltaLambda1 * (scalar)numContactsA) + bufConstTangentM_A[index].vLin * (deltaLambda2 * (scalar)numContactsA);
-				deltaVel[bodyIndex[index].indexA].vAng += bufConstNormalM_A[index].vAng * (deltaLambda1 * (scalar)numContactsA) + bufConstTangentM_A[index].vAng * (deltaLambda2 * (scalar)numContactsA);
-
-				deltaVel[bodyIndex[index].indexB].vLin += bufConstNormalM_B[index].vLin * (deltaLambda1 * (scalar)numContactsB) + bufConstTangentM_B[index].vLin * (deltaLambda2 * (scalar)numContactsB);
-				deltaVel[bodyIndex[index].indexB].vAng += bufConstNormalM_B[index].vAng * (deltaLambda1 * (scalar)numContactsB) + bufConstTangentM_B[index].vAng * (deltaLambda2 * (scalar)numContactsB);
-
-				processed = true;
+		if (dynamicA) {
+			pseudoA.vLin += rows.bufConstNormalM_A[index].vLin * (deltaLambda * (T)numContactsA);
+			pseudoA.vAng += rows.bufConstNormalM_A[index].vAng * (deltaLambda * (T)numContactsA);
 		}
+		if (dynamicB) {
+			pseudoB.vLin += rows.bufConstNormalM_B[index].vLin * (deltaLambda * (T)numContactsB);
+			pseudoB.vAng += rows.bufConstNormalM_B[index].vAng * (deltaLambda * (T)numContactsB);
+		}
+	}
 
 };
 
-#endif // OCL_SOLVE
-
 #endif
@@ -0,0 +1,216 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+#include "ContactGraph.h"
+#include <algorithm>
+
+#define COLOR_UNASSIGNED 0xFFFFFFFF
+#define ISLAND_UNASSIGNED 0xFFFFFFFF
+
+void ContactGraph::build(const ivec2 *pairs, unsigned int numContacts, const std::vector<RigidBody> &bodies) {
+	color.assign(numContacts, COLOR_UNASSIGNED);
+	usedColors.resize(bodies.size());
+
+	/*
+	 * Colors are handed out 64 at a time using one bit mask per body. Contacts which find no free
+	 * color in a pass are left for the next pass, which starts over with empty masks.
+	 */
+	unsigned int base = 0;
+	unsigned int remaining = numContacts;
+	unsigned int maxColor = 0;
+	while (remaining) {
+		std::fill(usedColors.begin(), usedColors.end(), 0ULL);
+
+		for (unsigned int i = 0; i < numContacts; i++) {
+			if (color[i] != COLOR_UNASSIGNED)
+				continue;
+
+			unsigned int a = pairs[i].indexA, b = pairs[i].indexB;
+			bool dynamicA = !bodies[a].isConstrained(), dynamicB = !bodies[b].isConstrained();
+
+			unsigned long long used = (dynamicA ? usedColors[a] : 0) | (dynamicB ? usedColors[b] : 0);
+			if (used == ~0ULL)
+				continue;
+
+			unsigned int c = __builtin_ctzll(~used);
+			if (dynamicA) usedColors[a] |= 1ULL << c;
+			if (dynamicB) usedColors[b] |= 1ULL << c;
+
+			color[i] = base + c;
+			if (color[i] + 1 > maxColor) maxColor = color[i] + 1;
+			remaining--;
+		}
+		base += 64;
+	}
+
+	/* Counting sort by color */
+	colorOffset.assign(maxColor + 1, 0);
+	for (unsigned int i = 0; i < numContacts; i++)
+		colorOffset[color[i] + 1]++;
+	for (unsigned int c = 0; c < maxColor; c++)
+		colorOffset[c + 1] += colorOffset[c];
+
+	order.resize(numContacts);
+	std::vector<unsigned int> fill(colorOffset.begin(), colorOffset.end() - 1);
+	for (unsigned int i = 0; i < numContacts; i++)
+		order[fill[color[i]]++] = i;
+}
+
+/* Body to contact CSR shared by buildAdjacency and buildLayers */
+static void fillAdjacency(const ivec2 *pairs, unsigned int numContacts, const std::vector<RigidBody> &bodies,
+		std::vector<unsigned int> &offset, std::vector<unsigned int> &entries) {
+	offset.assign(bodies.size() + 1, 0);
+	for (unsigned int i = 0; i < numContacts; i++) {
+		if (!bodies[pairs[i].indexA].isConstrained()) offset[pairs[i].indexA + 1]++;
+		if (!bodies[pairs[i].indexB].isConstrained()) offset[pairs[i].indexB + 1]++;
+	}
+	for (size_t b = 0; b < bodies.size(); b++)
+		offset[b + 1] += offset[b];
+
+	entries.resize(offset.back());
+	std::vector<unsigned int> fill(offset.begin(), offset.end() - 1);
+	for (unsigned int i = 0; i < numContacts; i++) {
+		if (!bodies[pairs[i].indexA].isConstrained()) entries[fill[pairs[i].indexA]++] = i << 1;
+		if (!bodies[pairs[i].indexB].isConstrained()) entries[fill[pairs[i].indexB]++] = (i << 1) | 1;
+	}
+}
+
+void ContactGraph::buildAdjacency(const ivec2 *pairs, unsigned int numContacts, const std::vector<RigidBody> &bodies) {
+	fillAdjacency(pairs, numContacts, bodies, bodyOffset, bodyContacts);
+}
+
+void ContactGraph::buildIsland(unsigned int island, const ivec2 *pairs, const std::vector<RigidBody> &bodies) {
+	unsigned int first = islandOffset[island];
+	islandPairs.resize(islandSize(island));
+	for (unsigned int i = 0; i < islandPairs.size(); i++)
+		islandPairs[i] = pairs[islandContacts[first + i]];
+
+	build(islandPairs.data(), islandPairs.size(), bodies);
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = islandContacts[first + order[i]];
+}
+
+/* Root of x in the union-find forest, halving the path on the way */
+static inline unsigned int findRoot(std::vector<unsigned int> &parent, unsigned int x) {
+	while (parent[x] != x) {
+		parent[x] = parent[parent[x]];
+		x = parent[x];
+	}
+	return x;
+}
+
+void ContactGraph::buildIslands(const ivec2 *pairs, unsigned int numContacts, const std::vector<RigidBody> &bodies) {
+	parent.resize(bodies.size());
+	for (size_t b = 0; b < bodies.size(); b++)
+		parent[b] = b;
+
+	for (unsigned int i = 0; i < numContacts; i++) {
+		unsigned int a = pairs[i].indexA, b = pairs[i].indexB;
+		if (bodies[a].isConstrained() || bodies[b].isConstrained())
+			continue;
+		a = findRoot(parent, a);
+		b = findRoot(parent, b);
+		if (a != b)
+			parent[std::max(a, b)] = std::min(a, b);
+	}
+
+	/*
+	 * A contact belongs to the island of its dynamic body. Contacts between two constrained bodies
+	 * never move anything, they are grouped under the first body to keep every contact in an island.
+	 */
+	islandOf.assign(bodies.size(), ISLAND_UNASSIGNED);
+	std::vector<unsigned int> size;
+	for (unsigned int i = 0; i < numContacts; i++) {
+		unsigned int a = pairs[i].indexA;
+		unsigned int root = findRoot(parent, bodies[a].isConstrained() ? pairs[i].indexB : a);
+		if (islandOf[root] == ISLAND_UNASSIGNED) {
+			islandOf[root] = size.size();
+			size.push_back(0);
+		}
+		size[islandOf[root]]++;
+	}
+
+	/* Largest islands first, so the pool can take them together and hand out the small ones */
+	unsigned int count = size.size();
+	std::vector<unsigned int> rank(count);
+	for (unsigned int k = 0; k < count; k++)
+		rank[k] = k;
+	std::stable_sort(rank.begin(), rank.end(), [&](unsigned int x, unsigned int y) { return size[x] > size[y]; });
+	std::vector<unsigned int> position(count);
+	for (unsigned int k = 0; k < count; k++)
+		position[rank[k]] = k;
+
+	islandOffset.assign(count + 1, 0);
+	for (unsigned int k = 0; k < count; k++)
+		islandOffset[k + 1] = islandOffset[k] + size[rank[k]];
+
+	islandContacts.resize(numContacts);
+	std::vector<unsigned int> fill(islandOffset.begin(), islandOffset.end() - 1);
+	for (unsigned int i = 0; i < numContacts; i++) {
+		unsigned int a = pairs[i].indexA;
+		unsigned int root = findRoot(parent, bodies[a].isConstrained() ? pairs[i].indexB : a);
+		islandContacts[fill[position[islandOf[root]]]++] = i;
+	}
+
+	/* Dynamic bodies without contacts are in no island */
+	islandBodyOffset.assign(count + 1, 0);
+	for (size_t b = 0; b < bodies.size(); b++) {
+		unsigned int root = findRoot(parent, b);
+		if (!bodies[b].isConstrained() && islandOf[root] != ISLAND_UNASSIGNED)
+			islandBodyOffset[position[islandOf[root]] + 1]++;
+	}
+	for (unsigned int k = 0; k < count; k++)
+		islandBodyOffset[k + 1] += islandBodyOffset[k];
+
+	islandBodies.resize(islandBodyOffset[count]);
+	fill.assign(islandBodyOffset.begin(), islandBodyOffset.end() - 1);
+	for (size_t b = 0; b < bodies.size(); b++) {
+		unsigned int root = findRoot(parent, b);
+		if (!bodies[b].isConstrained() && islandOf[root] != ISLAND_UNASSIGNED)
+			islandBodies[fill[position[islandOf[root]]]++] = b;
+	}
+}
+
+void ContactGraph::buildLayers(const ivec2 *pairs, unsigned int numContacts, const std::vector<RigidBody> &bodies) {
+	// Own lists, bodyOffset may hold the manifold adjacency the solver uploads
+	fillAdjacency(pairs, numContacts, bodies, layerOffset, layerContacts);
+
+	/* Bodies resting on a constrained body start the search, islands floating free stay LAYER_NONE */
+	bodyLayer.assign(bodies.size(), LAYER_NONE);
+	std::vector<unsigned int> queue;
+	queue.reserve(bodies.size());
+	for (size_t b = 0; b < bodies.size(); b++)
+		if (bodies[b].isConstrained())
+			bodyLayer[b] = 0;
+	for (unsigned int i = 0; i < numContacts; i++) {
+		unsigned int a = pairs[i].indexA, b = pairs[i].indexB;
+		if (bodyLayer[a] == 0 && bodyLayer[b] == LAYER_NONE) { bodyLayer[b] = 1; queue.push_back(b); }
+		if (bodyLayer[b] == 0 && bodyLayer[a] == LAYER_NONE) { bodyLayer[a] = 1; queue.push_back(a); }
+	}
+	for (size_t head = 0; head < queue.size(); head++) {
+		unsigned int body = queue[head];
+		for (unsigned int k = layerOffset[body]; k < layerOffset[body + 1]; k++) {
+			const ivec2 &pair = pairs[layerContacts[k] >> 1];
+			unsigned int other = (layerContacts[k] & 1) ? pair.indexA : pair.indexB;
+			if (bodyLayer[other] == LAYER_NONE) {
+				bodyLayer[other] = bodyLayer[body] + 1;
+				queue.push_back(other);
+			}
+		}
+	}
+
+	contactLayer.resize(numContacts);
+	for (unsigned int i = 0; i < numContacts; i++) {
+		unsigned int a = bodyLayer[pairs[i].indexA], b = bodyLayer[pairs[i].indexB];
+		// LAYER_NONE is the largest value, so a contact with a floating body sorts last
+		contactLayer[i] = std::max(a, b);
+	}
+
+	layerOrder = islandContacts;
+	for (unsigned int k = 0; k < numIslands(); k++)
+		std::stable_sort(layerOrder.begin() + islandOffset[k], layerOrder.begin() + islandOffset[k + 1],
+			[&](unsigned int x, unsigned int y) { return contactLayer[x] < contactLayer[y]; });
+}
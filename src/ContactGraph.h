@@ -0,0 +1,76 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+#ifndef __ContactGraph_h_
+#define __ContactGraph_h_
+
+#include <vector>
+#include "DataType.h"
+#include "RigidBody.h"
+
+#define ISLAND_SPLIT_SIZE 256 // Islands with at least this many contacts are solved by the whole pool
+#define LAYER_NONE 0xFFFFFFFF // Body or contact not connected to a constrained body
+
+/*
+ * Greedy coloring of the contact graph. Two contacts conflict when they share a body that is not
+ * constrained; constrained bodies (ground) are never written by the solver, so they are ignored.
+ * Contacts of one color touch disjoint sets of dynamic bodies and can be solved concurrently.
+ * buildAdjacency() gives the same graph from the body side, for solvers that gather per body.
+ * buildIslands() splits it into connected components, which share no dynamic body and are solved
+ * independently. buildLayers() orders every island from the constrained bodies upward.
+ */
+class ContactGraph {
+	std::vector<unsigned long long> usedColors; // Per body, colors taken in the current pass of 64
+	std::vector<unsigned int> color; // Per contact
+	std::vector<unsigned int> parent; // Union-find over bodies
+	std::vector<unsigned int> islandOf; // Per root body
+	std::vector<ivec2> islandPairs; // Pairs of the island being colored
+	std::vector<unsigned int> layerOffset; // Per contact adjacency of buildLayers, same form as bodyOffset
+	std::vector<unsigned int> layerContacts;
+
+public:
+	/* Contact indices grouped by color, color c spans order[colorOffset[c]] to order[colorOffset[c + 1] - 1] */
+	std::vector<unsigned int> order;
+	std::vector<unsigned int> colorOffset;
+
+	/* Contacts of body b are bodyContacts[bodyOffset[b]] to bodyContacts[bodyOffset[b + 1] - 1], as index << 1 | side */
+	std::vector<unsigned int> bodyOffset;
+	std::vector<unsigned int> bodyContacts;
+
+	/*
+	 * Island k has contacts islandContacts[islandOffset[k]] to islandContacts[islandOffset[k + 1] - 1] and
+	 * dynamic bodies islandBodies[islandBodyOffset[k]] to islandBodies[islandBodyOffset[k + 1] - 1].
+	 * Islands are sorted by contact count, largest first.
+	 */
+	std::vector<unsigned int> islandOffset;
+	std::vector<unsigned int> islandContacts;
+	std::vector<unsigned int> islandBodyOffset;
+	std::vector<unsigned int> islandBodies;
+
+	/*
+	 * Contacts away from a constrained body, constrained bodies are layer 0. A contact is in the layer of its
+	 * upper body. layerOrder holds islandContacts with every island sorted by layer, same offsets.
+	 */
+	std::vector<unsigned int> bodyLayer;
+	std::vector<unsigned int> contactLayer;
+	std::vector<unsigned int> layerOrder;
+
+	inline unsigned int numColors() const { return colorOffset.empty() ? 0 : colorOffset.size() - 1; }
+	inline unsigned int numIslands() const { return islandOffset.empty() ? 0 : islandOffset.size() - 1; }
+	inline unsigned int islandSize(unsigned int island) const { return islandOffset[island + 1] - islandOffset[island]; }
+
+	void build(const ivec2 *pairs, unsigned int numContacts, const std::vector<RigidBody> &bodies);
+	/* Same as build() for the contacts of one island, order holds indices into pairs */
+	void buildIsland(unsigned int island, const ivec2 *pairs, const std::vector<RigidBody> &bodies);
+	/* Body to contact index in CSR form, side is 1 when the body is B. Constrained bodies get no entries. */
+	void buildAdjacency(const ivec2 *pairs, unsigned int numContacts, const std::vector<RigidBody> &bodies);
+	/* Constrained bodies do not join islands, so cubes resting on the same ground stay apart */
+	void buildIslands(const ivec2 *pairs, unsigned int numContacts, const std::vector<RigidBody> &bodies);
+	/* Breadth first from the constrained bodies, call after buildIslands. Leaves bodyOffset as it is. */
+	void buildLayers(const ivec2 *pairs, unsigned int numContacts, const std::vector<RigidBody> &bodies);
+};
+
+#endif
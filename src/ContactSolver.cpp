@@ -0,0 +1,186 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+#include "ContactSolver.h"
+#include "OclCompute.h"
+#include <algorithm>
+#include <atomic>
+
+ContactSolver *ContactSolver::create(SolverBackend backend, Precision precision) {
+	if (backend == SOLVER_PGS)
+		return new PgsSolver();
+	if (backend == SOLVER_CPU_JACOBI)
+		return new CpuJacobiSolver();
+	return new OclSolver(precision);
+}
+
+template <typename T>
+static unsigned int solvePgs(SolverContext<T> &context) {
+	ContactRows<T> &rows = context.rows;
+	ContactGraph &graph = context.graph;
+	ThreadPool &pool = context.pool;
+	std::vector<Contact> &contacts = context.contacts;
+	std::vector<unsigned int> islandIterations(graph.numIslands(), context.maxIterations);
+
+	/*
+	 * Contacts within a color share no dynamic body and are swept concurrently without atomics. Colors
+	 * are visited in order, the same update sequence as a serial sweep over graph.order.
+	 */
+	unsigned int numLarge = 0;
+	while (pool.size() > 1 && numLarge < graph.numIslands() && graph.islandSize(numLarge) >= ISLAND_SPLIT_SIZE)
+		numLarge++;
+	for (unsigned int k = 0; k < numLarge; k++) {
+		graph.buildIsland(k, rows.bodyIndex.data(), context.bodies);
+		SpinBarrier barrier(pool.size());
+		std::vector<Residual> partial(pool.size());
+		pool.run([&](unsigned int threadId, unsigned int nThreads) {
+			for (unsigned int j = 0; j < context.maxIterations; j++) {
+				Residual residual;
+				for (unsigned int c = 0; c < graph.numColors(); c++) {
+					unsigned int begin = graph.colorOffset[c];
+					unsigned int size = graph.colorOffset[c + 1] - begin;
+					unsigned int chunk = (size + nThreads - 1) / nThreads;
+					unsigned int end = begin + std::min(size, (threadId + 1) * chunk);
+					for (unsigned int i = begin + std::min(size, threadId * chunk); i < end; i++)
+						contacts[graph.order[i]].processContact(rows, graph.order[i], residual);
+					barrier.wait();
+				}
+
+				// Same decision on every thread, partial is next written behind at least one color barrier
+				partial[threadId] = residual;
+				barrier.wait();
+				Residual total;
+				for (unsigned int t = 0; t < nThreads; t++)
+					total.add(partial[t]);
+				if (total.converged(context.tolerance)) {
+					if (threadId == 0) islandIterations[k] = j + 1;
+					break;
+				}
+			}
+		});
+	}
+
+	std::atomic<unsigned int> nextIsland(numLarge);
+	if (numLarge < graph.numIslands()) {
+		pool.run([&](unsigned int threadId, unsigned int nThreads) {
+			for (unsigned int k = nextIsland++; k < graph.numIslands(); k = nextIsland++) {
+				for (unsigned int j = 0; j < context.maxIterations; j++) {
+					Residual residual;
+					for (unsigned int i = graph.islandOffset[k]; i < graph.islandOffset[k + 1]; i++)
+						contacts[graph.islandContacts[i]].processContact(rows, graph.islandContacts[i], residual);
+					if (residual.converged(context.tolerance)) {
+						islandIterations[k] = j + 1;
+						break;
+					}
+				}
+			}
+		});
+	}
+
+	unsigned int iterations = 0;
+	for (unsigned int k = 0; k < graph.numIslands(); k++)
+		iterations = std::max(iterations, islandIterations[k]);
+	return iterations;
+}
+
+unsigned int PgsSolver::solve(SolverContext<float> &context) {
+	return solvePgs(context);
+}
+
+unsigned int PgsSolver::solve(SolverContext<double> &context) {
+	return solvePgs(context);
+}
+
+template <typename T>
+static unsigned int solveJacobi(SolverContext<T> &context, SimdJacobi<T> &simdJacobi) {
+	ContactRows<T> &rows = context.rows;
+	simdJacobi.load(context.numContacts, rows.bodyIndex,
+		rows.bufConstNormalD_A, rows.bufConstNormalM_A,
+		rows.bufConstTangentD_A, rows.bufConstTangentM_A,
+		rows.bufConstNormalD_B, rows.bufConstNormalM_B,
+		rows.bufConstTangentD_B, rows.bufConstTangentM_B,
+		rows.bufB, rows.bufLambda, rows.bufMaterial, context.graph.islandOffset, context.graph.islandContacts);
+	return simdJacobi.solve(context.bodies.size(), rows.deltaVel, rows.bufLambda, context.maxIterations, context.tolerance,
+		context.acceleration, context.pool, context.graph.islandBodyOffset, context.graph.islandBodies);
+}
+
+unsigned int CpuJacobiSolver::solve(SolverContext<float> &context) {
+	return solveJacobi(context, floatJacobi);
+}
+
+unsigned int CpuJacobiSolver::solve(SolverContext<double> &context) {
+	return solveJacobi(context, doubleJacobi);
+}
+
+static bool oclInitialized = false;
+
+OclSolver::OclSolver(Precision precision) {
+	// The iteration count and tolerance are set again before every solve
+	if (!oclInitialized)
+		OclCompute::init(ITER_COUNT, 0, precision);
+	oclInitialized = true;
+}
+
+const char *OclSolver::name() const {
+	switch (OclCompute::solverMode) {
+	case OCL_JACOBI: return "OpenCL Jacobi";
+	case OCL_JACOBI_PERSISTENT: return "OpenCL persistent Jacobi";
+	case OCL_JACOBI_TILED: return "OpenCL tiled Jacobi";
+	case OCL_JACOBI_MANIFOLD: return "OpenCL block Jacobi";
+	case OCL_JACOBI_TUNED: return "OpenCL tuned Jacobi";
+	default: return "OpenCL Gauss-Seidel";
+	}
+}
+
+bool OclSolver::averagesRows() const {
+	return OclCompute::solverMode != OCL_GS_COLOR;
+}
+
+bool OclSolver::perManifold() const {
+	return OclCompute::solverMode == OCL_JACOBI_MANIFOLD;
+}
+
+template <typename T>
+unsigned int OclSolver::solveRows(SolverContext<T> &context) {
+	ContactRows<T> &rows = context.rows;
+	ContactGraph &graph = context.graph;
+	if (context.buildGraph && OclCompute::solverMode == OCL_GS_COLOR)
+		graph.build(rows.bodyIndex.data(), context.numContacts, context.bodies);
+	else if (context.buildGraph && perManifold()) {
+		manifoldPairs.resize(context.manifoldOffset.size() - 1);
+		for (size_t m = 0; m < manifoldPairs.size(); m++)
+			manifoldPairs[m] = rows.bodyIndex[context.manifoldOffset[m]];
+		graph.buildAdjacency(manifoldPairs.data(), manifoldPairs.size(), context.bodies);
+	}
+	else if (context.buildGraph)
+		graph.buildAdjacency(rows.bodyIndex.data(), context.numContacts, context.bodies);
+
+	// The device holds the rows of the last precision it ran, after a switch all of them go up
+	const std::vector<unsigned int> *rowRanges = &context.rowRanges;
+	if (OclCompute::setPrecision(PrecisionOf<T>::value)) {
+		allRows.assign(1, 0);
+		allRows.push_back(context.numContacts);
+		rowRanges = &allRows;
+	}
+
+	OclCompute::setSolverParams(context.maxIterations, context.tolerance, context.acceleration);
+	return OclCompute::_0_run(context.bodies.size(), context.numContacts,
+		rows.deltaVel, rows.bodyIndex,
+		rows.bufConstNormalD_A, rows.bufConstNormalM_A,
+		rows.bufConstTangentD_A, rows.bufConstTangentM_A,
+		rows.bufConstNormalD_B, rows.bufConstNormalM_B,
+		rows.bufConstTangentD_B, rows.bufConstTangentM_B,
+		rows.bufB, rows.bufLambda, rows.bufMaterial, graph.order, graph.colorOffset,
+		graph.bodyOffset, graph.bodyContacts, context.manifoldOffset, *rowRanges);
+}
+
+unsigned int OclSolver::solve(SolverContext<float> &context) {
+	return solveRows(context);
+}
+
+unsigned int OclSolver::solve(SolverContext<double> &context) {
+	return solveRows(context);
+}
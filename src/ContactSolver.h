@@ -0,0 +1,104 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+#ifndef __ContactSolver_h_
+#define __ContactSolver_h_
+
+#include "Contact.h"
+#include <vector>
+#include "ContactGraph.h"
+#include "ThreadPool.h"
+#include "SimdJacobi.h"
+#include "JacobiAccel.h"
+
+/* Velocity solvers, all of them work on the contact buffers of Contact.h */
+enum SolverBackend {
+	SOLVER_PGS, // Gauss-Seidel on the CPU, islands spread over the pool
+	SOLVER_CPU_JACOBI, // SimdJacobi on the CPU
+	SOLVER_OPENCL, // OclCompute, OclCompute::solverMode picks the kernels
+	SOLVER_COUNT
+};
+
+/*
+ * One velocity solve. The rows, B and the warm start are in rows, its deltaVel holds the warm start impulse.
+ * T is the precision of the PhysicsWorld.
+ */
+template <typename T>
+struct SolverContext {
+	ContactRows<T> &rows;
+	const std::vector<RigidBody> &bodies;
+	std::vector<Contact> &contacts;
+	unsigned int numContacts;
+	ContactGraph &graph; // Islands are built, the rest is up to the solver
+	ThreadPool &pool;
+	bool buildGraph; // First substep, the contacts changed since the last solve
+	const std::vector<unsigned int> &manifoldOffset;
+	const std::vector<unsigned int> &rowRanges; // Contacts whose rows changed since the last solve
+	unsigned int maxIterations;
+	double tolerance;
+	JacobiAccel acceleration;
+};
+
+class ContactSolver {
+public:
+	virtual ~ContactSolver() {}
+	virtual const char *name() const = 0;
+	/* Jacobi solvers average the normal rows over the contacts of a body, or over its manifolds */
+	virtual bool averagesRows() const = 0;
+	virtual bool perManifold() const { return false; }
+	/* The contacts are solved island by island, numIslands is reported */
+	virtual bool usesIslands() const = 0;
+	/* Solves into deltaVel and bufLambda, returns the iterations run, the most of any island */
+	virtual unsigned int solve(SolverContext<float> &context) = 0;
+	virtual unsigned int solve(SolverContext<double> &context) = 0;
+
+	/* precision is the one OpenCL builds its program for first, it is rebuilt when a solve needs the other */
+	static ContactSolver *create(SolverBackend backend, Precision precision);
+};
+
+/*
+ * Gauss-Seidel island by island, each stops once it converged. Large islands are colored and every color is
+ * split across the pool, small ones are swept whole by whichever thread is free.
+ */
+class PgsSolver : public ContactSolver {
+public:
+	const char *name() const { return "PGS"; }
+	bool averagesRows() const { return false; }
+	bool usesIslands() const { return true; }
+	unsigned int solve(SolverContext<float> &context);
+	unsigned int solve(SolverContext<double> &context);
+};
+
+/* Keeps the SoA copy of both precisions, AVX only runs on float rows */
+class CpuJacobiSolver : public ContactSolver {
+	SimdJacobi<float> floatJacobi;
+	SimdJacobi<double> doubleJacobi;
+public:
+	const char *name() const { return "CPU Jacobi"; }
+	bool averagesRows() const { return true; }
+	bool usesIslands() const { return true; }
+	unsigned int solve(SolverContext<float> &context);
+	unsigned int solve(SolverContext<double> &context);
+};
+
+/* Initializes OpenCL the first time one is made, the device keeps the rows only while this solver is in use */
+class OclSolver : public ContactSolver {
+	std::vector<ivec2> manifoldPairs; // Body indices per manifold, for the block solver adjacency
+	std::vector<unsigned int> allRows; // Row range of all contacts, for a device that just switched precision
+
+	template <typename T>
+	unsigned int solveRows(SolverContext<T> &context);
+public:
+	OclSolver(Precision precision);
+	const char *name() const;
+	bool averagesRows() const;
+	bool perManifold() const;
+	bool usesIslands() const { return false; }
+	unsigned int solve(SolverContext<float> &context);
+	unsigned int solve(SolverContext<double> &context);
+};
+
+#endif
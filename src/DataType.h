@@ -7,23 +7,16 @@
 #ifndef __DataType_h_
 #define __DataType_h_
 #include <vec3.hpp>
-//#define DP // double precision
 
-#ifdef DP
-
-typedef glm::dvec3 vec3;
-typedef double scalar;
-
-#else
-
-typedef glm::vec3 vec3;
-typedef float scalar;
-
-#endif
-
-struct vec6 {
-	vec3 vLin;
-	vec3 vAng;
+/*
+ * Solver buffers shared by the host, SimdJacobi and the OpenCL kernels. The layouts are templated on the
+ * component type so both precisions have the same shape, every PhysicsWorld picks the one it solves in.
+ * Rigid body state stays double, Contact rounds the rows once when it writes them.
+ */
+template <typename T>
+struct tvec6 {
+	glm::tvec3<T> vLin;
+	glm::tvec3<T> vAng;
 };
 
 struct ivec2 {
@@ -31,9 +24,24 @@ struct ivec2 {
 	unsigned int indexB;
 };
 
-struct vec2 {
-	scalar s1;
-	scalar s2;
+template <typename T>
+struct tvec2 {
+	T s1;
+	T s2;
+};
+
+/* Component type of the solver buffers, double builds the kernels with -D DP */
+enum Precision {
+	PRECISION_FLOAT,
+	PRECISION_DOUBLE
 };
 
+template <typename T> struct PrecisionOf;
+template <> struct PrecisionOf<float> { static const Precision value = PRECISION_FLOAT; };
+template <> struct PrecisionOf<double> { static const Precision value = PRECISION_DOUBLE; };
+
+inline const char *precisionName(Precision precision) {
+	return precision == PRECISION_DOUBLE ? "double" : "float";
+}
+
 #endif
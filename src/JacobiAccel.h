@@ -0,0 +1,85 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+#ifndef __JacobiAccel_h_
+#define __JacobiAccel_h_
+
+#define CHEBYSHEV_DELAY 4 // Plain sweeps before the Chebyshev weights start, the last two estimate the spectral radius
+#define CHEBYSHEV_RHO_MAX 0.99 // The weights approach 2 as the radius approaches 1 and overshoot the projection
+
+/*
+ * Step between the two halves of a Jacobi iteration. Both blend the sweep with the change of the iteration
+ * before, kept per contact as its direction, and hand the result to the body half as delta lambda.
+ */
+enum JacobiAccel {
+	ACCEL_NONE,
+	ACCEL_NNCG, // Nonsmooth nonlinear conjugate gradient momentum
+	ACCEL_CHEBYSHEV // Chebyshev semi-iterative weights from the estimated spectral radius
+};
+
+/*
+ * NNCG momentum factor from the squared lambda change of this sweep and of the one before. Restarts at 0
+ * when the change grows, which also covers the first sweep.
+ */
+inline double nncgBeta(double delta, double previous) {
+	if (previous <= 0 || delta > previous)
+		return 0;
+	return delta / previous;
+}
+
+/*
+ * Squared spectral radius of the Jacobi iteration from how much the squared lambda change shrank over the
+ * last sweep. 0 when it did not shrink, the projection is still switching contacts on and off then.
+ */
+inline double chebyshevRhoSq(double delta, double previous) {
+	if (previous <= 0 || delta >= previous)
+		return 0;
+	double rhoSq = delta / previous;
+	return rhoSq < CHEBYSHEV_RHO_MAX * CHEBYSHEV_RHO_MAX ? rhoSq : CHEBYSHEV_RHO_MAX * CHEBYSHEV_RHO_MAX;
+}
+
+/* Weight of sweep iter from the weight of the one before, 1 while the radius is being estimated */
+inline double chebyshevOmega(unsigned int iter, double rhoSq, double omega) {
+	if (iter < CHEBYSHEV_DELAY)
+		return 1;
+	if (iter == CHEBYSHEV_DELAY)
+		return 2 / (2 - rhoSq);
+	return 4 / (4 - rhoSq * omega);
+}
+
+/* Host side state of one solve, or of one island, over its iterations */
+struct AccelSchedule {
+	JacobiAccel mode;
+	unsigned int iter;
+	double previous; // Squared lambda change of the last sweep
+	double rhoSq;
+	double omega;
+
+	AccelSchedule(JacobiAccel mode) : mode(mode), iter(0), previous(0), rhoSq(0), omega(1) {}
+	/*
+	 * Call once per sweep with its squared lambda change, returns true when the step has to run over the
+	 * contacts with factor: beta for NNCG, which always runs to keep the direction, omega for Chebyshev.
+	 */
+	inline bool next(double delta, double &factor) {
+		bool run = false;
+		if (mode == ACCEL_NNCG) {
+			factor = nncgBeta(delta, previous);
+			run = true;
+		}
+		else if (mode == ACCEL_CHEBYSHEV) {
+			if (iter + 1 == CHEBYSHEV_DELAY)
+				rhoSq = chebyshevRhoSq(delta, previous);
+			omega = chebyshevOmega(iter, rhoSq, omega);
+			factor = omega;
+			run = iter + 1 >= CHEBYSHEV_DELAY && rhoSq > 0;
+		}
+		previous = delta;
+		iter++;
+		return run;
+	}
+};
+
+#endif
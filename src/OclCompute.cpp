@@ -9,6 +9,10 @@
 #include <fstream>
 #include <streambuf>
 #include <string>
+#include <chrono>
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
 
 // Bunch of static variables
 std::vector<cl_platform_id> OclCompute::platforms;
@@ -19,8 +23,13 @@ std::vector<cl_command_queue> OclCompute::cmdQs;
 std::vector<std::vector<cl_kernel>> OclCompute::kernels;
 std::vector<unsigned long> OclCompute::maxGlobalMemSz;
 std::vector<unsigned long> OclCompute::maxMemAllocSz;
+std::vector<cl_uint> OclCompute::computeUnits;
 unsigned int OclCompute::iterCount;
-scalar OclCompute::mu;
+double OclCompute::tolerance;
+Precision OclCompute::precision = PRECISION_FLOAT;
+JacobiAccel OclCompute::acceleration = ACCEL_NONE;
+OclSolverMode OclCompute::solverMode = OCL_GS_COLOR;
+std::vector<std::vector<OclTuning>> OclCompute::tuning;
 
 
 std::vector<cl_mem> OclCompute::clBufDeltaVel;
@@ -36,6 +45,17 @@ std::vector<cl_mem> OclCompute::clBufConstTangentM_B;
 std::vector<cl_mem> OclCompute::clBufB;
 std::vector<cl_mem> OclCompute::clBufLambda;
 std::vector<cl_mem> OclCompute::clBufDeltaLambda;
+std::vector<cl_mem> OclCompute::clBufDirection;
+std::vector<cl_mem> OclCompute::clBufColorOrder;
+std::vector<cl_mem> OclCompute::clBufResidual;
+std::vector<cl_mem> OclCompute::clBufResidualSum;
+std::vector<cl_mem> OclCompute::clBufMaterial;
+std::vector<cl_mem> OclCompute::clBufBodyOffset;
+std::vector<cl_mem> OclCompute::clBufBodyContacts;
+std::vector<cl_mem> OclCompute::clBufGroupResidual;
+std::vector<cl_mem> OclCompute::clBufSyncState;
+std::vector<cl_mem> OclCompute::clBufManifoldOffset;
+std::vector<cl_mem> OclCompute::clBufManifoldDelta;
 
 void OclCompute::test() {
 	cl_platform_id platform;
@@ -76,8 +96,8 @@ void OclCompute::test() {
 	buf = clCreateBuffer(context, CL_MEM_READ_WRITE, 32 * 1024 * 1024, NULL, &err);
 	HANDLE_CLERROR(err, "Error Building Buffer");
 
-	vec6 A;
-	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdq, buf, CL_TRUE, 0, sizeof(vec6), &A, 0, NULL, NULL), "Error writing to buffer");
+	tvec6<float> A;
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdq, buf, CL_TRUE, 0, sizeof(A), &A, 0, NULL, NULL), "Error writing to buffer");
 
 	std::cout<<"Test Passed"<<std::endl;
 }
@@ -156,6 +176,10 @@ void OclCompute::_1_activateDevices(const std::vector<unsigned int> &devList) {
 		HANDLE_CLERROR(clGetDeviceInfo(activeDevices[i], CL_DEVICE_MAX_MEM_ALLOC_SIZE,
 				sizeof(bytes), &bytes, NULL), "Error querying CL_DEVICE_MAX_MEM_ALLOC_SIZE");
 		maxMemAllocSz.push_back(bytes);
+		cl_uint units;
+		HANDLE_CLERROR(clGetDeviceInfo(activeDevices[i], CL_DEVICE_MAX_COMPUTE_UNITS,
+				sizeof(units), &units, NULL), "Error querying CL_DEVICE_MAX_COMPUTE_UNITS");
+		computeUnits.push_back(units);
 
 		HANDLE_CLERROR(clGetDeviceInfo(activeDevices[i], CL_DEVICE_NAME,
 				sizeof(infoStr), infoStr, NULL), "Error querying CL_DEVICE_NAME");
@@ -163,10 +187,81 @@ void OclCompute::_1_activateDevices(const std::vector<unsigned int> &devList) {
 	}
 }
 
+/* Double buffers need fp64, no kernel adds scalars atomically */
+bool OclCompute::supportsDouble(cl_device_id device) {
+	size_t extSize;
+	HANDLE_CLERROR(clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS,
+			0, NULL, &extSize), "Error querying CL_DEVICE_EXTENSIONS");
+	std::string extensions(extSize, '\0');
+	HANDLE_CLERROR(clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS,
+			extSize, &extensions[0], NULL), "Error querying CL_DEVICE_EXTENSIONS");
+	return extensions.find("cl_khr_fp64") != std::string::npos;
+}
+
+/* FNV-1a, stable across runs and compilers unlike std::hash */
+static unsigned long long hashString(const std::string &s) {
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t k = 0; k < s.size(); k++) {
+		hash ^= (unsigned char)s[k];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/* The file holds the key on its first line then the binary, NULL when it is missing or was made for another key */
+cl_program OclCompute::loadProgramBinary(size_t i, const std::string &key, const std::string &fileName) {
+	std::ifstream in(fileName, std::ios::in | std::ios::binary);
+	std::string fileKey;
+	if (!in || !std::getline(in, fileKey) || fileKey != key)
+		return NULL;
+	std::string binary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (binary.empty())
+		return NULL;
+
+	const unsigned char *binPtr[] = {(const unsigned char *)binary.data()};
+	size_t binSize = binary.size();
+	cl_int binStatus, err;
+	cl_program program = clCreateProgramWithBinary(contexts[i], 1, &activeDevices[i], &binSize, binPtr, &binStatus, &err);
+	if (err != CL_SUCCESS || binStatus != CL_SUCCESS) {
+		if (program)
+			clReleaseProgram(program);
+		return NULL;
+	}
+	return program;
+}
+
+/* A failed write only costs a source build on the next start */
+void OclCompute::saveProgramBinary(size_t i, cl_program program, const std::string &key, const std::string &fileName) {
+	size_t binSize;
+	HANDLE_CLERROR(clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES,
+			sizeof(binSize), &binSize, NULL), "Error querying CL_PROGRAM_BINARY_SIZES");
+	if (binSize == 0)
+		return;
+	std::vector<unsigned char> binary(binSize);
+	unsigned char *binPtr[] = {&binary[0]};
+	HANDLE_CLERROR(clGetProgramInfo(program, CL_PROGRAM_BINARIES,
+			sizeof(binPtr), binPtr, NULL), "Error querying CL_PROGRAM_BINARIES");
+
+	// Written aside and renamed, so a process starting at the same time never loads half a file
+	std::string tempName = fileName + "." + std::to_string(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+	std::ofstream out(tempName, std::ios::out | std::ios::binary | std::ios::trunc);
+	out<<key<<"\n";
+	out.write((const char *)&binary[0], binSize);
+	out.close();
+	if (!out || std::rename(tempName.c_str(), fileName.c_str())) {
+		std::remove(tempName.c_str());
+		std::cerr<<"Could not write "<<fileName<<", building from source on the next start."<<std::endl;
+	}
+}
+
 void OclCompute::_2_initKernels() {
 	cl_int err;
 
 	for (size_t i = 0; i < activeDevices.size(); i++) {
+		if (precision == PRECISION_DOUBLE && !supportsDouble(activeDevices[i])) {
+			std::cerr<<"Device does not support double precision, solve in float."<<std::endl;
+			exit(0);
+		}
 		std::vector<cl_kernel> kernelList;
 		do {
 			std::string kernelSource = readSource("kernel/jacobi.cl");
@@ -177,20 +272,36 @@ void OclCompute::_2_initKernels() {
 			cl::Program::Sources sources;
 			sources.push_back({kernelSource.c_str(), kernelSource.length()});
 			do {
-				const char *srcPtr[] = {kernelSource.c_str()};
-				cl_program program = clCreateProgramWithSource(contexts[i], 1, srcPtr, NULL, &err);
-				HANDLE_CLERROR(err, "Failed to create Program.");
-
 				std::string build_opts;
 				if (std::string(OCL_INCLUDE_PATH) != "")
 					build_opts = std::string("-I ") + std::string(OCL_INCLUDE_PATH);
-// Add build opts
-
-				build_opts += "-D ITER_COUNT=" + std::to_string(iterCount) +
-						" -D MU=" + std::to_string(mu);
+				if (precision == PRECISION_DOUBLE)
+					build_opts += " -D DP";
+				// Solver parameters are kernel arguments, changing them does not need a rebuild
+
+				// A binary is only reused for the same device, driver, source and options
+				std::ostringstream key, fileName;
+				key<<deviceKey(i)<<"|"<<std::hex<<hashString(kernelSource)<<"|"<<build_opts;
+				fileName<<OCL_BINARY_CACHE<<std::hex<<hashString(key.str())<<".bin";
+
+				cl_program program = loadProgramBinary(i, key.str(), fileName.str());
+				bool cached = program != NULL;
+				cl_int build_code = CL_SUCCESS;
+				if (cached) {
+					build_code = clBuildProgram(program, 0, NULL, build_opts.c_str(), NULL, NULL);
+					if (build_code != CL_SUCCESS) {
+						HANDLE_CLERROR(clReleaseProgram(program), "Failed to release Program.");
+						cached = false;
+					}
+				}
+				if (!cached) {
+					const char *srcPtr[] = {kernelSource.c_str()};
+					program = clCreateProgramWithSource(contexts[i], 1, srcPtr, NULL, &err);
+					HANDLE_CLERROR(err, "Failed to create Program.");
 
-				cl_int build_code = clBuildProgram(program, 0, NULL,
-						build_opts.c_str(), NULL, NULL);
+					build_code = clBuildProgram(program, 0, NULL,
+							build_opts.c_str(), NULL, NULL);
+				}
 
 				size_t logSize;
 				HANDLE_CLERROR(clGetProgramBuildInfo(program,
@@ -211,6 +322,10 @@ void OclCompute::_2_initKernels() {
 							<<"\n"<<build_log<<std::endl;
 					HANDLE_CLERROR(build_code, "clBuildProgram failed.");
 				}
+				delete[] build_log;
+				if (!cached)
+					saveProgramBinary(i, program, key.str(), fileName.str());
+				std::cout<<"Kernels "<<(cached ? "loaded from " : "built, saved to ")<<fileName.str()<<std::endl;
 
 				kernelList.push_back(clCreateKernel(program, "clearBuffer", &err));
 				HANDLE_CLERROR(err, "Failed to build kernel.");
@@ -218,28 +333,40 @@ void OclCompute::_2_initKernels() {
 				kernelList.push_back(clCreateKernel(program, "jacobi_parallel", &err));
 				HANDLE_CLERROR(err, "Failed to build kernel.");
 
-				kernelList.push_back(clCreateKernel(program, "jacobi_serial", &err));
+				kernelList.push_back(clCreateKernel(program, "jacobi_contact", &err));
 				HANDLE_CLERROR(err, "Failed to build kernel.");
 
-				kernelList.push_back(clCreateKernel(program, "jacobi_comb", &err));
+				kernelList.push_back(clCreateKernel(program, "jacobi_v3_split1", &err));
 				HANDLE_CLERROR(err, "Failed to build kernel.");
 
-				kernelList.push_back(clCreateKernel(program, "jacobi_v2", &err));
+				kernelList.push_back(clCreateKernel(program, "jacobi_norm", &err));
 				HANDLE_CLERROR(err, "Failed to build kernel.");
 
-				kernelList.push_back(clCreateKernel(program, "jacobi_v3", &err));
+				kernelList.push_back(clCreateKernel(program, "gs_color", &err));
 				HANDLE_CLERROR(err, "Failed to build kernel.");
 
-				kernelList.push_back(clCreateKernel(program, "jacobi_v3_split1", &err));
+				kernelList.push_back(clCreateKernel(program, "reduce_residual", &err));
 				HANDLE_CLERROR(err, "Failed to build kernel.");
 
-				kernelList.push_back(clCreateKernel(program, "jacobi_v3_split2", &err));
+				kernelList.push_back(clCreateKernel(program, "jacobi_body", &err));
 				HANDLE_CLERROR(err, "Failed to build kernel.");
 
-				kernelList.push_back(clCreateKernel(program, "jacobi_comb_v4", &err));
+				kernelList.push_back(clCreateKernel(program, "jacobi_persistent", &err));
 				HANDLE_CLERROR(err, "Failed to build kernel.");
 
-				kernelList.push_back(clCreateKernel(program, "jacobi_norm", &err));
+				kernelList.push_back(clCreateKernel(program, "nncg_momentum", &err));
+				HANDLE_CLERROR(err, "Failed to build kernel.");
+
+				kernelList.push_back(clCreateKernel(program, "chebyshev_weight", &err));
+				HANDLE_CLERROR(err, "Failed to build kernel.");
+
+				kernelList.push_back(clCreateKernel(program, "jacobi_manifold", &err));
+				HANDLE_CLERROR(err, "Failed to build kernel.");
+
+				kernelList.push_back(clCreateKernel(program, "manifold_body", &err));
+				HANDLE_CLERROR(err, "Failed to build kernel.");
+
+				kernelList.push_back(clCreateKernel(program, "jacobi_tiled", &err));
 				HANDLE_CLERROR(err, "Failed to build kernel.");
 
 				HANDLE_CLERROR(clReleaseProgram(program), "Failed to release Program.");
@@ -250,6 +377,13 @@ void OclCompute::_2_initKernels() {
 	}
 }
 
+void OclCompute::releaseKernels() {
+	for (size_t i = 0; i < kernels.size(); i++)
+		for (size_t k = 0; k < kernels[i].size(); k++)
+			HANDLE_CLERROR(clReleaseKernel(kernels[i][k]), "Failed to release kernel.");
+	kernels.clear();
+}
+
 /* Dumb way to create buffers!!*/
 void OclCompute::_3_createBuffer() {
 	cl_int err;
@@ -285,6 +419,32 @@ void OclCompute::_3_createBuffer() {
 		HANDLE_CLERROR(err, "Failed to create Buffer.");
 		clBufDeltaLambda.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_WRITE, 32 * 1024 * 1024, NULL, &err));
 		HANDLE_CLERROR(err, "Failed to create Buffer.");
+		clBufDirection.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_WRITE, 32 * 1024 * 1024, NULL, &err));
+		HANDLE_CLERROR(err, "Failed to create Buffer.");
+
+		clBufColorOrder.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_ONLY, 8 * 1024 * 1024, NULL, &err));
+		HANDLE_CLERROR(err, "Failed to create Buffer.");
+		clBufResidual.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_WRITE, 32 * 1024 * 1024, NULL, &err));
+		HANDLE_CLERROR(err, "Failed to create Buffer.");
+		// Sum of the last sweep, then the squared change of two iterations for nncg_momentum, room for double
+		clBufResidualSum.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_WRITE, 4 * sizeof(double), NULL, &err));
+		HANDLE_CLERROR(err, "Failed to create Buffer.");
+		clBufMaterial.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_ONLY, 32 * 1024 * 1024, NULL, &err));
+		HANDLE_CLERROR(err, "Failed to create Buffer.");
+		clBufBodyOffset.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_ONLY, 8 * 1024 * 1024, NULL, &err));
+		HANDLE_CLERROR(err, "Failed to create Buffer.");
+		clBufBodyContacts.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_ONLY, 8 * 1024 * 1024, NULL, &err));
+		HANDLE_CLERROR(err, "Failed to create Buffer.");
+		// Two residual partials per group, for two iterations
+		clBufGroupResidual.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_WRITE, 4 * sizeof(double) * computeUnits[i], NULL, &err));
+		HANDLE_CLERROR(err, "Failed to create Buffer.");
+		clBufSyncState.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_WRITE, 3 * sizeof(cl_uint), NULL, &err));
+		HANDLE_CLERROR(err, "Failed to create Buffer.");
+		clBufManifoldOffset.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_ONLY, 8 * 1024 * 1024, NULL, &err));
+		HANDLE_CLERROR(err, "Failed to create Buffer.");
+		// Two vec6 per manifold, as many manifolds as contacts at worst
+		clBufManifoldDelta.push_back(clCreateBuffer(contexts[i], CL_MEM_READ_WRITE, 64 * 1024 * 1024, NULL, &err));
+		HANDLE_CLERROR(err, "Failed to create Buffer.");
 	}
 }
 
@@ -308,14 +468,17 @@ void OclCompute::_4_setKernelArgsStatic() {
 		ctr = 0;
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufDeltaVel[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufBodyIndex[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufConstNormalM_A[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufConstTangentM_A[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufConstNormalM_B[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufConstTangentM_B[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufConstNormalD_A[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufConstTangentD_A[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufConstNormalD_B[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufConstTangentD_B[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufB[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufLambda[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufDeltaLambda[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufMaterial[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][2], ctr++, sizeof(cl_mem), &clBufResidual[i]), "Failed to set kernel args.");
 
 		ctr = 0;
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][3], ctr++, sizeof(cl_mem), &clBufDeltaVel[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][3], ctr++, sizeof(cl_mem), &clBufBodyIndex[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][3], ctr++, sizeof(cl_mem), &clBufConstNormalD_A[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][3], ctr++, sizeof(cl_mem), &clBufConstTangentD_A[i]), "Failed to set kernel args.");
@@ -325,10 +488,9 @@ void OclCompute::_4_setKernelArgsStatic() {
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][3], ctr++, sizeof(cl_mem), &clBufConstTangentM_A[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][3], ctr++, sizeof(cl_mem), &clBufConstNormalM_B[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][3], ctr++, sizeof(cl_mem), &clBufConstTangentM_B[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][3], ctr++, sizeof(cl_mem), &clBufB[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][3], ctr++, sizeof(cl_mem), &clBufDeltaLambda[i]), "Failed to set kernel args.");
 
 		ctr = 0;
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], ctr++, sizeof(cl_mem), &clBufDeltaVel[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], ctr++, sizeof(cl_mem), &clBufBodyIndex[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], ctr++, sizeof(cl_mem), &clBufConstNormalD_A[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], ctr++, sizeof(cl_mem), &clBufConstTangentD_A[i]), "Failed to set kernel args.");
@@ -338,8 +500,8 @@ void OclCompute::_4_setKernelArgsStatic() {
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], ctr++, sizeof(cl_mem), &clBufConstTangentM_A[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], ctr++, sizeof(cl_mem), &clBufConstNormalM_B[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], ctr++, sizeof(cl_mem), &clBufConstTangentM_B[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], ctr++, sizeof(cl_mem), &clBufDeltaLambda[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], ctr++, sizeof(cl_mem), &clBufB[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], ctr++, sizeof(cl_mem), &clBufLambda[i]), "Failed to set kernel args.");
 
 		ctr = 0;
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], ctr++, sizeof(cl_mem), &clBufDeltaVel[i]), "Failed to set kernel args.");
@@ -354,29 +516,23 @@ void OclCompute::_4_setKernelArgsStatic() {
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], ctr++, sizeof(cl_mem), &clBufConstTangentM_B[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], ctr++, sizeof(cl_mem), &clBufB[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], ctr++, sizeof(cl_mem), &clBufLambda[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], ctr++, sizeof(cl_mem), &clBufDeltaLambda[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], ctr++, sizeof(cl_mem), &clBufColorOrder[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], 15, sizeof(cl_mem), &clBufResidual[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], 16, sizeof(cl_mem), &clBufMaterial[i]), "Failed to set kernel args.");
 
 		ctr = 0;
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufBodyIndex[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufConstNormalD_A[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufConstTangentD_A[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufConstNormalD_B[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufConstTangentD_B[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufConstNormalM_A[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufConstTangentM_A[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufConstNormalM_B[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufConstTangentM_B[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufDeltaLambda[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufResidual[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], ctr++, sizeof(cl_mem), &clBufResidualSum[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], 3, 2 * scalarSize() * OCL_REDUCE_LWS, NULL), "Failed to set kernel args.");
 
 		ctr = 0;
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], ctr++, sizeof(cl_mem), &clBufDeltaVel[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], ctr++, sizeof(cl_mem), &clBufBodyIndex[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], ctr++, sizeof(cl_mem), &clBufBodyOffset[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], ctr++, sizeof(cl_mem), &clBufBodyContacts[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], ctr++, sizeof(cl_mem), &clBufConstNormalM_A[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], ctr++, sizeof(cl_mem), &clBufConstTangentM_A[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], ctr++, sizeof(cl_mem), &clBufConstNormalM_B[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], ctr++, sizeof(cl_mem), &clBufConstTangentM_B[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], ctr++, sizeof(cl_mem), &clBufB[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], ctr++, sizeof(cl_mem), &clBufLambda[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], ctr++, sizeof(cl_mem), &clBufDeltaLambda[i]), "Failed to set kernel args.");
 
 		ctr = 0;
@@ -392,60 +548,501 @@ void OclCompute::_4_setKernelArgsStatic() {
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][8], ctr++, sizeof(cl_mem), &clBufConstTangentM_B[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][8], ctr++, sizeof(cl_mem), &clBufB[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][8], ctr++, sizeof(cl_mem), &clBufLambda[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][8], ctr++, sizeof(cl_mem), &clBufDeltaLambda[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][8], ctr++, sizeof(cl_mem), &clBufMaterial[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][8], ctr++, sizeof(cl_mem), &clBufBodyOffset[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][8], ctr++, sizeof(cl_mem), &clBufBodyContacts[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][8], ctr++, sizeof(cl_mem), &clBufGroupResidual[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][8], ctr++, sizeof(cl_mem), &clBufSyncState[i]), "Failed to set kernel args.");
 
 		ctr = 0;
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufBodyIndex[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufConstNormalD_A[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufConstTangentD_A[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufConstNormalD_B[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufConstTangentD_B[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufConstNormalM_A[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufConstTangentM_A[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufConstNormalM_B[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufConstTangentM_B[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufLambda[i]), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufDeltaLambda[i]), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufB[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufDirection[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], ctr++, sizeof(cl_mem), &clBufResidualSum[i]), "Failed to set kernel args.");
+
+		ctr = 0;
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][10], ctr++, sizeof(cl_mem), &clBufLambda[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][10], ctr++, sizeof(cl_mem), &clBufDeltaLambda[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][10], ctr++, sizeof(cl_mem), &clBufDirection[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][10], ctr++, sizeof(cl_mem), &clBufMaterial[i]), "Failed to set kernel args.");
+
+		ctr = 0;
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufDeltaVel[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufBodyIndex[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufConstNormalD_A[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufConstTangentD_A[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufConstNormalD_B[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufConstTangentD_B[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufConstNormalM_A[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufConstTangentM_A[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufConstNormalM_B[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufConstTangentM_B[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufB[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufLambda[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufMaterial[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufResidual[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufManifoldOffset[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][11], ctr++, sizeof(cl_mem), &clBufManifoldDelta[i]), "Failed to set kernel args.");
+
+		ctr = 0;
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][12], ctr++, sizeof(cl_mem), &clBufDeltaVel[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][12], ctr++, sizeof(cl_mem), &clBufBodyOffset[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][12], ctr++, sizeof(cl_mem), &clBufBodyContacts[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][12], ctr++, sizeof(cl_mem), &clBufManifoldDelta[i]), "Failed to set kernel args.");
+
+		// Same buffers as jacobi_contact, the tiles are local arguments set per run
+		ctr = 0;
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], ctr++, sizeof(cl_mem), &clBufDeltaVel[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], ctr++, sizeof(cl_mem), &clBufBodyIndex[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], ctr++, sizeof(cl_mem), &clBufConstNormalD_A[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], ctr++, sizeof(cl_mem), &clBufConstTangentD_A[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], ctr++, sizeof(cl_mem), &clBufConstNormalD_B[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], ctr++, sizeof(cl_mem), &clBufConstTangentD_B[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], ctr++, sizeof(cl_mem), &clBufB[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], ctr++, sizeof(cl_mem), &clBufLambda[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], ctr++, sizeof(cl_mem), &clBufDeltaLambda[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], ctr++, sizeof(cl_mem), &clBufMaterial[i]), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], ctr++, sizeof(cl_mem), &clBufResidual[i]), "Failed to set kernel args.");
 	}
 }
 
-void show6(vec6 v) {
+template <typename T>
+void show6(const tvec6<T> &v) {
 	std::cout<<v.vLin.x<<" "<<v.vLin.y<<" "<<v.vLin.z<<" "<<v.vAng.x<<" "<<v.vAng.y<<" "<<v.vAng.z<<std::endl;
 }
 
-void OclCompute::_0_run(unsigned int nBody, unsigned int nContacts,
-			std::vector<vec6> &deltaVel, const std::vector<ivec2> &bodyIndex,
-			const std::vector<vec6> &bufConstNormalD_A, const std::vector<vec6> &bufConstNormalM_A,
-			const std::vector<vec6> &bufConstTangentD_A, const std::vector<vec6> &bufConstTangentM_A,
-			const std::vector<vec6> &bufConstNormalD_B, const std::vector<vec6> &bufConstNormalM_B,
-			const std::vector<vec6> &bufConstTangentD_B, const std::vector<vec6> &bufConstTangentM_B,
-			const std::vector<vec2> &bufB, std::vector<vec2> &bufLambda) {
+/* Bytes of one scalar in the program as built */
+size_t OclCompute::scalarSize() {
+	return precision == PRECISION_DOUBLE ? sizeof(double) : sizeof(float);
+}
+
+void OclCompute::setScalarArg(size_t i, size_t kernel, cl_uint index, double value) {
+	if (precision == PRECISION_DOUBLE) {
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][kernel], index, sizeof(value), &value), "Failed to set kernel args.");
+		return;
+	}
+	float single = value;
+	HANDLE_CLERROR(clSetKernelArg(kernels[i][kernel], index, sizeof(single), &single), "Failed to set kernel args.");
+}
+
+/*
+ * Sums the residual of the last sweep on device i unless that is already done, blocks until the squared
+ * lambda change and lambda norm are read back into residualSum
+ */
+void OclCompute::readResidual(size_t i, bool summed, double *residualSum) {
+	size_t reduceSize = OCL_REDUCE_LWS;
+	if (!summed)
+		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][6], 1, NULL, &reduceSize, &reduceSize, 0, NULL, NULL), "Failed to execute kernel");
+	if (precision == PRECISION_DOUBLE) {
+		HANDLE_CLERROR(clEnqueueReadBuffer(cmdQs[i], clBufResidualSum[i], CL_TRUE, 0, 2 * sizeof(double), residualSum, 0, NULL, NULL), "Error reading from buffer.");
+		return;
+	}
+	float sum[2];
+	HANDLE_CLERROR(clEnqueueReadBuffer(cmdQs[i], clBufResidualSum[i], CL_TRUE, 0, sizeof(sum), sum, 0, NULL, NULL), "Error reading from buffer.");
+	residualSum[0] = sum[0];
+	residualSum[1] = sum[1];
+}
+
+bool OclCompute::residualConverged(size_t i, bool summed) {
+	double residualSum[2];
+	readResidual(i, summed, residualSum);
+	return residualSum[0] <= tolerance * tolerance * residualSum[1];
+}
+
+/*
+ * jacobi_contact then jacobi_body per iteration, the in-order queue keeps the halves apart without host waits.
+ * With NNCG every sweep is summed on the device and nncg_momentum runs in between. Chebyshev reads back the
+ * two sweeps that estimate the spectral radius, after that chebyshev_weight runs in between with no waits.
+ */
+unsigned int OclCompute::runJacobi(size_t i, unsigned int nBody, unsigned int nContacts, size_t lws, bool tiled) {
+	size_t gwsContact = (nContacts + lws - 1) / lws * lws;
+	size_t gwsBody = (nBody + lws - 1) / lws * lws;
+	size_t reduceSize = OCL_REDUCE_LWS;
+	size_t contactKernel = tiled ? 13 : 2;
+	size_t gwsSweep = gwsContact;
+
+	HANDLE_CLERROR(clSetKernelArg(kernels[i][contactKernel], 11, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
+	if (tiled) {
+		// One tile per work group at a time, the groups stride over the rest
+		gwsSweep = std::min(gwsContact, (size_t)computeUnits[i] * OCL_TILED_GROUPS * lws);
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], 12, 2 * sizeof(cl_uint) * lws, NULL), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], 13, 24 * scalarSize() * lws, NULL), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][13], 14, 6 * scalarSize() * lws, NULL), "Failed to set kernel args.");
+	}
+	HANDLE_CLERROR(clSetKernelArg(kernels[i][7], 8, sizeof(cl_uint), &nBody), "Failed to set kernel args.");
+	if (acceleration == ACCEL_NNCG) {
+		cl_uint zero = 0; // All bits clear is 0 in either precision
+		HANDLE_CLERROR(clEnqueueFillBuffer(cmdQs[i], clBufResidualSum[i], &zero, sizeof(zero), 0, 4 * scalarSize(), 0, NULL, NULL), "Error filling buffer.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], 5, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
+	}
+	else if (acceleration == ACCEL_CHEBYSHEV)
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][10], 5, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
+	AccelSchedule schedule(acceleration);
+
+	for (unsigned int iter = 0; iter < iterCount; iter++) {
+		bool check = (iter + 1) % OCL_RESIDUAL_CHECK == 0 && iter + 1 < iterCount;
+		bool converged = false;
+		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][contactKernel], 1, NULL, &gwsSweep, &lws, 0, NULL, NULL), "Failed to execute kernel");
+		if (acceleration == ACCEL_NNCG) {
+			// Convergence is judged on the sweep alone, before the momentum is added
+			HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][6], 1, NULL, &reduceSize, &reduceSize, 0, NULL, NULL), "Failed to execute kernel");
+			converged = check && residualConverged(i, true);
+			if (!converged && iter + 1 < iterCount) {
+				cl_uint parity = iter & 1;
+				HANDLE_CLERROR(clSetKernelArg(kernels[i][9], 4, sizeof(cl_uint), &parity), "Failed to set kernel args.");
+				HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][9], 1, NULL, &gwsContact, &lws, 0, NULL, NULL), "Failed to execute kernel");
+			}
+		}
+		else if (acceleration == ACCEL_CHEBYSHEV && iter + 1 < iterCount) {
+			// Only the sweeps before CHEBYSHEV_DELAY need their change on the host
+			double residualSum[2] = {0, 0};
+			if (iter + 2 >= CHEBYSHEV_DELAY && iter < CHEBYSHEV_DELAY) {
+				readResidual(i, false, residualSum);
+				converged = residualSum[0] <= tolerance * tolerance * residualSum[1];
+			}
+			double omega;
+			if (!converged && schedule.next(residualSum[0], omega)) {
+				setScalarArg(i, 10, 4, omega);
+				HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][10], 1, NULL, &gwsContact, &lws, 0, NULL, NULL), "Failed to execute kernel");
+			}
+		}
+		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][7], 1, NULL, &gwsBody, &lws, 0, NULL, NULL), "Failed to execute kernel");
+
+		if (converged || (acceleration != ACCEL_NNCG && check && residualConverged(i)))
+			return iter + 1;
+	}
+	return iterCount;
+}
+
+/*
+ * All iterations in one jacobi_persistent launch. Its global barrier spins until every group arrives, which
+ * deadlocks if a group is waiting for a free compute unit, so there is at most one group per compute unit.
+ */
+unsigned int OclCompute::runJacobiPersistent(size_t i, unsigned int nBody, unsigned int nContacts, size_t lws) {
+	size_t items = std::max(nContacts, nBody);
+	size_t numGroups = std::min((size_t)computeUnits[i], (items + lws - 1) / lws);
+	if (numGroups == 0)
+		numGroups = 1;
+	size_t gws = numGroups * lws;
+
+	cl_uint zero = 0;
+	cl_uint syncState[3];
+	HANDLE_CLERROR(clEnqueueFillBuffer(cmdQs[i], clBufSyncState[i], &zero, sizeof(zero), 0, sizeof(syncState), 0, NULL, NULL), "Error filling buffer.");
+
+	HANDLE_CLERROR(clSetKernelArg(kernels[i][8], 18, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
+	HANDLE_CLERROR(clSetKernelArg(kernels[i][8], 19, sizeof(cl_uint), &nBody), "Failed to set kernel args.");
+	HANDLE_CLERROR(clSetKernelArg(kernels[i][8], 20, sizeof(cl_uint), &iterCount), "Failed to set kernel args.");
+	setScalarArg(i, 8, 21, tolerance);
+	HANDLE_CLERROR(clSetKernelArg(kernels[i][8], 22, 2 * scalarSize() * lws, NULL), "Failed to set kernel args.");
+	HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][8], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
+
+	HANDLE_CLERROR(clEnqueueReadBuffer(cmdQs[i], clBufSyncState[i], CL_TRUE, 0, sizeof(syncState), syncState, 0, NULL, NULL), "Error reading from buffer.");
+	return syncState[2];
+}
+
+/*
+ * jacobi_manifold then manifold_body per iteration. Same flow as runJacobi with one work item per manifold,
+ * the body adjacency lists manifolds. The accelerations need a delta lambda per point and are not applied.
+ */
+unsigned int OclCompute::runJacobiManifold(size_t i, unsigned int nBody, unsigned int nManifolds) {
+	size_t lws = OCL_JACOBI_LWS;
+	size_t gwsManifold = (nManifolds + lws - 1) / lws * lws;
+	size_t gwsBody = (nBody + lws - 1) / lws * lws;
+
+	HANDLE_CLERROR(clSetKernelArg(kernels[i][11], 16, sizeof(cl_uint), &nManifolds), "Failed to set kernel args.");
+	HANDLE_CLERROR(clSetKernelArg(kernels[i][12], 4, sizeof(cl_uint), &nBody), "Failed to set kernel args.");
+
+	for (unsigned int iter = 0; iter < iterCount; iter++) {
+		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][11], 1, NULL, &gwsManifold, &lws, 0, NULL, NULL), "Failed to execute kernel");
+		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][12], 1, NULL, &gwsBody, &lws, 0, NULL, NULL), "Failed to execute kernel");
 
+		if ((iter + 1) % OCL_RESIDUAL_CHECK == 0 && iter + 1 < iterCount && residualConverged(i))
+			return iter + 1;
+	}
+	return iterCount;
+}
+
+unsigned int OclCompute::runJacobiVariant(size_t i, OclSolverMode mode, size_t lws, unsigned int nBody, unsigned int nContacts) {
+	if (mode == OCL_JACOBI_PERSISTENT)
+		return runJacobiPersistent(i, nBody, nContacts, lws);
+	return runJacobi(i, nBody, nContacts, lws, mode == OCL_JACOBI_TILED);
+}
+
+/* Local memory jacobi_tiled needs for tiles of lws contacts with scalars of scalarSize bytes */
+static size_t tiledLocalSize(size_t lws, size_t scalarSize) {
+	return (2 * sizeof(cl_uint) + 30 * scalarSize) * lws;
+}
+
+/* Times the Jacobi variants from the same warm start, the caller uploads the warm start again afterwards */
+template <typename T>
+void OclCompute::benchmarkJacobi(size_t i, unsigned int nBody, unsigned int nContacts,
+			const std::vector<tvec6<T>> &deltaVel, const std::vector<tvec2<T>> &bufLambda) {
+	const OclSolverMode modes[] = {OCL_JACOBI, OCL_JACOBI_PERSISTENT, OCL_JACOBI_TILED};
+	const size_t lwsSizes[] = {OCL_JACOBI_LWS, OCL_PERSISTENT_LWS, OCL_TILED_LWS};
+	const char *names[] = {"launch per iteration", "persistent", "tiled"};
+	for (int variant = 0; variant < 3; variant++) {
+		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufDeltaVel[i], CL_FALSE, 0, sizeof(tvec6<T>) * nBody , &deltaVel[0], 0, NULL, NULL), "Error writing to buffer.");
+		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufLambda[i], CL_FALSE, 0, sizeof(tvec2<T>) * nContacts , &bufLambda[0], 0, NULL, NULL), "Error writing to buffer.");
+		HANDLE_CLERROR(clFinish(cmdQs[i]), "Failed to finish queue.");
+
+		auto start = std::chrono::high_resolution_clock::now();
+		unsigned int iterations = runJacobiVariant(i, modes[variant], lwsSizes[variant], nBody, nContacts);
+		HANDLE_CLERROR(clFinish(cmdQs[i]), "Failed to finish queue.");
+		auto end = std::chrono::high_resolution_clock::now();
+
+		std::cout<<"Jacobi "<<names[variant]<<": "<<std::chrono::duration<double, std::milli>(end - start).count()
+				<<" ms, "<<iterations<<" iterations, "<<nContacts<<" contacts"<<std::endl;
+	}
+}
+
+/* Device name, driver version and precision, a cached tuning only holds for the same three */
+std::string OclCompute::deviceKey(size_t i) {
+	char name[1024], version[1024];
+	HANDLE_CLERROR(clGetDeviceInfo(activeDevices[i], CL_DEVICE_NAME,
+			sizeof(name), name, NULL), "Error querying CL_DEVICE_NAME");
+	HANDLE_CLERROR(clGetDeviceInfo(activeDevices[i], CL_DRIVER_VERSION,
+			sizeof(version), version, NULL), "Error querying CL_DRIVER_VERSION");
+	return std::string(name) + "|" + version + "|" + precisionName(precision);
+}
+
+/* Milliseconds per iteration of one variant, from zero impulses on the workload already on the device */
+double OclCompute::timeJacobi(size_t i, const OclTuning &config, unsigned int nBody, unsigned int nContacts) {
+	cl_uint zero = 0;
+	double best = 0;
+	for (int repeat = 0; repeat < OCL_TUNE_REPEATS; repeat++) {
+		HANDLE_CLERROR(clEnqueueFillBuffer(cmdQs[i], clBufDeltaVel[i], &zero, sizeof(zero), 0, 6 * scalarSize() * nBody, 0, NULL, NULL), "Error filling buffer.");
+		HANDLE_CLERROR(clEnqueueFillBuffer(cmdQs[i], clBufLambda[i], &zero, sizeof(zero), 0, 2 * scalarSize() * nContacts, 0, NULL, NULL), "Error filling buffer.");
+		HANDLE_CLERROR(clFinish(cmdQs[i]), "Failed to finish queue.");
+
+		auto start = std::chrono::high_resolution_clock::now();
+		unsigned int iterations = runJacobiVariant(i, config.mode, config.lws, nBody, nContacts);
+		HANDLE_CLERROR(clFinish(cmdQs[i]), "Failed to finish queue.");
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count() / std::max(iterations, 1u);
+		if (repeat == 0 || ms < best)
+			best = ms;
+	}
+	return best;
+}
+
+/* Writes the rows of the synthetic pile _5_tuneJacobi times, nBody - 1 bodies of four contacts each on the ground */
+template <typename T>
+void OclCompute::writeTuningPile(size_t i, unsigned int nContacts, unsigned int nBody) {
+	// Contact c pushes body c / 4 + 1 up off body c / 4, body 0 is the ground
+	std::vector<ivec2> bodyIndex(nContacts);
+	std::vector<tvec6<T>> rowD_A(nContacts), rowM_A(nContacts), rowD_B(nContacts), rowM_B(nContacts);
+	std::vector<tvec6<T>> tangentD_A(nContacts), tangentM_A(nContacts), tangentD_B(nContacts), tangentM_B(nContacts);
+	std::vector<tvec2<T>> bufB(nContacts), bufMaterial(nContacts);
+	for (unsigned int c = 0; c < nContacts; c++) {
+		bodyIndex[c].indexA = c / 4;
+		bodyIndex[c].indexB = c / 4 + 1;
+		rowD_A[c].vLin = glm::tvec3<T>(0, -0.5, 0); rowD_A[c].vAng = glm::tvec3<T>(0, 0, 0);
+		rowD_B[c].vLin = glm::tvec3<T>(0, 0.5, 0); rowD_B[c].vAng = glm::tvec3<T>(0, 0, 0);
+		rowM_A[c].vLin = glm::tvec3<T>(0, -0.0625, 0); rowM_A[c].vAng = glm::tvec3<T>(0, 0, 0);
+		rowM_B[c].vLin = glm::tvec3<T>(0, 0.0625, 0); rowM_B[c].vAng = glm::tvec3<T>(0, 0, 0);
+		tangentD_A[c].vLin = glm::tvec3<T>(-0.5, 0, 0); tangentD_A[c].vAng = glm::tvec3<T>(0, 0, 0);
+		tangentD_B[c].vLin = glm::tvec3<T>(0.5, 0, 0); tangentD_B[c].vAng = glm::tvec3<T>(0, 0, 0);
+		tangentM_A[c].vLin = glm::tvec3<T>(-0.0625, 0, 0); tangentM_A[c].vAng = glm::tvec3<T>(0, 0, 0);
+		tangentM_B[c].vLin = glm::tvec3<T>(0.0625, 0, 0); tangentM_B[c].vAng = glm::tvec3<T>(0, 0, 0);
+		bufB[c].s1 = -1; bufB[c].s2 = 0.5;
+		bufMaterial[c].s1 = 0.5; bufMaterial[c].s2 = 0;
+	}
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufBodyIndex[i], CL_FALSE, 0, sizeof(ivec2) * nContacts, &bodyIndex[0], 0, NULL, NULL), "Error writing to buffer.");
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalD_A[i], CL_FALSE, 0, sizeof(tvec6<T>) * nContacts, &rowD_A[0], 0, NULL, NULL), "Error writing to buffer.");
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalM_A[i], CL_FALSE, 0, sizeof(tvec6<T>) * nContacts, &rowM_A[0], 0, NULL, NULL), "Error writing to buffer.");
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentD_A[i], CL_FALSE, 0, sizeof(tvec6<T>) * nContacts, &tangentD_A[0], 0, NULL, NULL), "Error writing to buffer.");
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentM_A[i], CL_FALSE, 0, sizeof(tvec6<T>) * nContacts, &tangentM_A[0], 0, NULL, NULL), "Error writing to buffer.");
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalD_B[i], CL_FALSE, 0, sizeof(tvec6<T>) * nContacts, &rowD_B[0], 0, NULL, NULL), "Error writing to buffer.");
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalM_B[i], CL_FALSE, 0, sizeof(tvec6<T>) * nContacts, &rowM_B[0], 0, NULL, NULL), "Error writing to buffer.");
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentD_B[i], CL_FALSE, 0, sizeof(tvec6<T>) * nContacts, &tangentD_B[0], 0, NULL, NULL), "Error writing to buffer.");
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentM_B[i], CL_FALSE, 0, sizeof(tvec6<T>) * nContacts, &tangentM_B[0], 0, NULL, NULL), "Error writing to buffer.");
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufB[i], CL_FALSE, 0, sizeof(tvec2<T>) * nContacts, &bufB[0], 0, NULL, NULL), "Error writing to buffer.");
+	// Blocking, the rows are gone on return
+	HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufMaterial[i], CL_TRUE, 0, sizeof(tvec2<T>) * nContacts, &bufMaterial[0], 0, NULL, NULL), "Error writing to buffer.");
+}
+
+/*
+ * Picks the Jacobi variant and work group size per contact band on every active device. Results are read
+ * from OCL_TUNE_CACHE when it has all bands for the device key, otherwise every candidate is timed on a
+ * synthetic pile: columns of bodies on a constrained ground body, four contacts between neighbours, the
+ * same body adjacency as ContactGraph::buildAdjacency. The winners replace the lines of the device key.
+ */
+void OclCompute::_5_tuneJacobi() {
+	static const unsigned int bandSizes[] = {512, 4096, 32768};
+	static const size_t lwsSizes[] = {32, 64, 128, 256};
+	const unsigned int numBands = sizeof(bandSizes) / sizeof(bandSizes[0]);
+	const OclSolverMode modes[] = {OCL_JACOBI, OCL_JACOBI_PERSISTENT, OCL_JACOBI_TILED};
+	const char *names[] = {"launch per iteration", "persistent", "tiled"};
+	const int numVariants = sizeof(modes) / sizeof(modes[0]);
+
+	tuning.resize(activeDevices.size());
 	for (size_t i = 0; i < activeDevices.size(); i++) {
-		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufBodyIndex[i], CL_FALSE, 0, sizeof(ivec2) * nContacts , &bodyIndex[0], 0, NULL, NULL), "Error writing to buffer.");
+		std::string key = deviceKey(i) + "|";
+		std::ifstream in(OCL_TUNE_CACHE);
+		std::string line;
+		std::vector<std::string> otherLines; // Other devices, kept when the file is written again
+		while (std::getline(in, line)) {
+			if (line.compare(0, key.size(), key)) {
+				otherLines.push_back(line);
+				continue;
+			}
+			std::istringstream fields(line.substr(key.size()));
+			OclTuning config;
+			unsigned int mode;
+			if (!(fields>>config.size>>mode>>config.lws) || (mode != OCL_JACOBI && mode != OCL_JACOBI_PERSISTENT && mode != OCL_JACOBI_TILED))
+				continue;
+			config.mode = (OclSolverMode)mode;
+
+			// A later line for the same band wins, only a known band counts
+			unsigned int band = 0;
+			while (band < numBands && config.size != (band + 1 == numBands ? 0xFFFFFFFF : bandSizes[band]))
+				band++;
+			if (band == numBands)
+				continue;
+			size_t k = 0;
+			while (k < tuning[i].size() && tuning[i][k].size != config.size)
+				k++;
+			if (k < tuning[i].size())
+				tuning[i][k] = config;
+			else
+				tuning[i].push_back(config);
+		}
+		in.close();
+		if (tuning[i].size() == numBands) {
+			std::sort(tuning[i].begin(), tuning[i].end(), [](const OclTuning &x, const OclTuning &y) { return x.size < y.size; });
+			std::cout<<"Jacobi tuning read from "<<OCL_TUNE_CACHE<<std::endl;
+			continue;
+		}
+		tuning[i].clear();
+
+		// Largest work group every kernel of a variant accepts
+		size_t deviceLws;
+		HANDLE_CLERROR(clGetDeviceInfo(activeDevices[i], CL_DEVICE_MAX_WORK_GROUP_SIZE,
+				sizeof(deviceLws), &deviceLws, NULL), "Error querying CL_DEVICE_MAX_WORK_GROUP_SIZE");
+		cl_ulong localMem;
+		HANDLE_CLERROR(clGetDeviceInfo(activeDevices[i], CL_DEVICE_LOCAL_MEM_SIZE,
+				sizeof(localMem), &localMem, NULL), "Error querying CL_DEVICE_LOCAL_MEM_SIZE");
+		size_t maxLws[] = {deviceLws, deviceLws, deviceLws};
+		const int variantKernels[][4] = {{2, 7, 9, 10}, {8, 8, 8, 8}, {13, 7, 9, 10}};
+		for (int variant = 0; variant < numVariants; variant++)
+			for (int k = 0; k < 4; k++) {
+				size_t kernelLws;
+				HANDLE_CLERROR(clGetKernelWorkGroupInfo(kernels[i][variantKernels[variant][k]], activeDevices[i],
+						CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernelLws), &kernelLws, NULL), "Error querying CL_KERNEL_WORK_GROUP_SIZE");
+				maxLws[variant] = std::min(maxLws[variant], kernelLws);
+			}
 
-		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalD_A[i], CL_FALSE, 0, sizeof(vec6) * nContacts , &bufConstNormalD_A[0], 0, NULL, NULL), "Error writing to buffer.");
-		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalM_A[i], CL_FALSE, 0, sizeof(vec6) * nContacts , &bufConstNormalM_A[0], 0, NULL, NULL), "Error writing to buffer.");
-		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentD_A[i], CL_FALSE, 0, sizeof(vec6) * nContacts , &bufConstTangentD_A[0], 0, NULL, NULL), "Error writing to buffer.");
-		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentM_A[i], CL_FALSE, 0, sizeof(vec6) * nContacts , &bufConstTangentM_A[0], 0, NULL, NULL), "Error writing to buffer.");
+		unsigned int savedIter = iterCount;
+		double savedTolerance = tolerance;
+		JacobiAccel savedAccel = acceleration;
+		iterCount = OCL_TUNE_ITERATIONS;
+		tolerance = 0;
+		acceleration = ACCEL_NONE;
+
+		std::cout<<"Tuning Jacobi for "<<key.substr(0, key.size() - 1)<<std::endl;
+		for (unsigned int band = 0; band < numBands; band++) {
+			unsigned int nContacts = bandSizes[band];
+			unsigned int nBody = nContacts / 4 + 1;
+
+			if (precision == PRECISION_DOUBLE)
+				writeTuningPile<double>(i, nContacts, nBody);
+			else
+				writeTuningPile<float>(i, nContacts, nBody);
+			std::vector<unsigned int> bodyOffset(nBody + 1, 0), bodyContacts;
+			for (unsigned int b = 1; b < nBody; b++)
+				bodyOffset[b + 1] = bodyOffset[b] + (b + 1 < nBody ? 8 : 4);
+			for (unsigned int b = 1; b < nBody; b++) {
+				for (unsigned int c = (b - 1) * 4; c < b * 4; c++)
+					bodyContacts.push_back((c << 1) | 1);
+				for (unsigned int c = b * 4; c < (b + 1) * 4 && c < nContacts; c++)
+					bodyContacts.push_back(c << 1);
+			}
 
-		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalD_B[i], CL_FALSE, 0, sizeof(vec6) * nContacts , &bufConstNormalD_B[0], 0, NULL, NULL), "Error writing to buffer.");
-		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalM_B[i], CL_FALSE, 0, sizeof(vec6) * nContacts , &bufConstNormalM_B[0], 0, NULL, NULL), "Error writing to buffer.");
-		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentD_B[i], CL_FALSE, 0, sizeof(vec6) * nContacts , &bufConstTangentD_B[0], 0, NULL, NULL), "Error writing to buffer.");
-		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentM_B[i], CL_FALSE, 0, sizeof(vec6) * nContacts , &bufConstTangentM_B[0], 0, NULL, NULL), "Error writing to buffer.");
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufBodyOffset[i], CL_FALSE, 0, sizeof(cl_uint) * (nBody + 1), &bodyOffset[0], 0, NULL, NULL), "Error writing to buffer.");
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufBodyContacts[i], CL_TRUE, 0, sizeof(cl_uint) * bodyContacts.size(), &bodyContacts[0], 0, NULL, NULL), "Error writing to buffer.");
+			HANDLE_CLERROR(clSetKernelArg(kernels[i][6], 2, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
+
+			OclTuning best = {nContacts, OCL_JACOBI, OCL_JACOBI_LWS};
+			int bestVariant = 0;
+			double bestMs = -1;
+			for (int variant = 0; variant < numVariants; variant++)
+				for (size_t l = 0; l < sizeof(lwsSizes) / sizeof(lwsSizes[0]) && lwsSizes[l] <= maxLws[variant]; l++) {
+					if (modes[variant] == OCL_JACOBI_TILED && tiledLocalSize(lwsSizes[l], scalarSize()) > localMem)
+						break;
+					OclTuning config = {nContacts, modes[variant], lwsSizes[l]};
+					timeJacobi(i, config, nBody, nContacts); // Warm up, the first launch may compile
+					double ms = timeJacobi(i, config, nBody, nContacts);
+					if (bestMs < 0 || ms < bestMs) {
+						bestMs = ms;
+						best = config;
+						bestVariant = variant;
+					}
+				}
+			// The last band stands for everything larger
+			if (band + 1 == numBands)
+				best.size = 0xFFFFFFFF;
+			tuning[i].push_back(best);
+			std::cout<<"  up to "<<nContacts<<" contacts: "<<names[bestVariant]<<", lws "<<best.lws
+					<<", "<<bestMs<<" ms per iteration"<<std::endl;
+		}
 
-		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufB[i], CL_TRUE, 0, sizeof(vec2) * nContacts , &bufB[0], 0, NULL, NULL), "Error writing to buffer.");
+		iterCount = savedIter;
+		tolerance = savedTolerance;
+		acceleration = savedAccel;
+
+		// Written aside and renamed like the program binaries, a second start tuning at the same time replaces it whole
+		std::string tempName = std::string(OCL_TUNE_CACHE) + "." + std::to_string(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+		std::ofstream out(tempName, std::ios::out | std::ios::trunc);
+		for (size_t l = 0; l < otherLines.size(); l++)
+			out<<otherLines[l]<<"\n";
+		for (size_t band = 0; band < tuning[i].size(); band++)
+			out<<key<<tuning[i][band].size<<" "<<tuning[i][band].mode<<" "<<tuning[i][band].lws<<"\n";
+		out.close();
+		if (!out || std::rename(tempName.c_str(), OCL_TUNE_CACHE)) {
+			std::remove(tempName.c_str());
+			std::cerr<<"Could not write "<<OCL_TUNE_CACHE<<", tuning again on the next start."<<std::endl;
+		}
+	}
+}
 
-		scalar f = 0;
-		HANDLE_CLERROR(clEnqueueFillBuffer(cmdQs[i], clBufDeltaVel[i], &f, sizeof(f), 0, sizeof(vec6) * nBody, 0, NULL, NULL), "Error filling buffer.");
-		HANDLE_CLERROR(clEnqueueFillBuffer(cmdQs[i], clBufLambda[i], &f, sizeof(f), 0, sizeof(vec2) * nContacts, 0, NULL, NULL), "Error filling buffer.");
+template <typename T>
+unsigned int OclCompute::_0_run(unsigned int nBody, unsigned int nContacts,
+			std::vector<tvec6<T>> &deltaVel, const std::vector<ivec2> &bodyIndex,
+			const std::vector<tvec6<T>> &bufConstNormalD_A, const std::vector<tvec6<T>> &bufConstNormalM_A,
+			const std::vector<tvec6<T>> &bufConstTangentD_A, const std::vector<tvec6<T>> &bufConstTangentM_A,
+			const std::vector<tvec6<T>> &bufConstNormalD_B, const std::vector<tvec6<T>> &bufConstNormalM_B,
+			const std::vector<tvec6<T>> &bufConstTangentD_B, const std::vector<tvec6<T>> &bufConstTangentM_B,
+			const std::vector<tvec2<T>> &bufB, std::vector<tvec2<T>> &bufLambda, const std::vector<tvec2<T>> &bufMaterial,
+			const std::vector<unsigned int> &colorOrder, const std::vector<unsigned int> &colorOffset,
+			const std::vector<unsigned int> &bodyOffset, const std::vector<unsigned int> &bodyContacts,
+			const std::vector<unsigned int> &manifoldOffset, const std::vector<unsigned int> &rowRanges) {
+
+	unsigned int iterations = iterCount;
+	for (size_t i = 0; i < activeDevices.size(); i++) {
+		for (size_t r = 0; r < rowRanges.size(); r += 2) {
+			size_t first = rowRanges[r], count = rowRanges[r + 1] - rowRanges[r];
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufBodyIndex[i], CL_FALSE, sizeof(ivec2) * first, sizeof(ivec2) * count , &bodyIndex[first], 0, NULL, NULL), "Error writing to buffer.");
+
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalD_A[i], CL_FALSE, sizeof(tvec6<T>) * first, sizeof(tvec6<T>) * count , &bufConstNormalD_A[first], 0, NULL, NULL), "Error writing to buffer.");
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalM_A[i], CL_FALSE, sizeof(tvec6<T>) * first, sizeof(tvec6<T>) * count , &bufConstNormalM_A[first], 0, NULL, NULL), "Error writing to buffer.");
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentD_A[i], CL_FALSE, sizeof(tvec6<T>) * first, sizeof(tvec6<T>) * count , &bufConstTangentD_A[first], 0, NULL, NULL), "Error writing to buffer.");
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentM_A[i], CL_FALSE, sizeof(tvec6<T>) * first, sizeof(tvec6<T>) * count , &bufConstTangentM_A[first], 0, NULL, NULL), "Error writing to buffer.");
+
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalD_B[i], CL_FALSE, sizeof(tvec6<T>) * first, sizeof(tvec6<T>) * count , &bufConstNormalD_B[first], 0, NULL, NULL), "Error writing to buffer.");
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstNormalM_B[i], CL_FALSE, sizeof(tvec6<T>) * first, sizeof(tvec6<T>) * count , &bufConstNormalM_B[first], 0, NULL, NULL), "Error writing to buffer.");
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentD_B[i], CL_FALSE, sizeof(tvec6<T>) * first, sizeof(tvec6<T>) * count , &bufConstTangentD_B[first], 0, NULL, NULL), "Error writing to buffer.");
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufConstTangentM_B[i], CL_FALSE, sizeof(tvec6<T>) * first, sizeof(tvec6<T>) * count , &bufConstTangentM_B[first], 0, NULL, NULL), "Error writing to buffer.");
+		}
 
-		//HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 12, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
-		//HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 13, 2 * sizeof(uint) * nContacts, NULL), "Failed to set kernel args.");
+		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufMaterial[i], CL_FALSE, 0, sizeof(tvec2<T>) * nContacts , &bufMaterial[0], 0, NULL, NULL), "Error writing to buffer.");
+		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufB[i], CL_TRUE, 0, sizeof(tvec2<T>) * nContacts , &bufB[0], 0, NULL, NULL), "Error writing to buffer.");
+
+		// Warm start, initial impulses and the matching velocity change come from the host
+		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufDeltaVel[i], CL_FALSE, 0, sizeof(tvec6<T>) * nBody , &deltaVel[0], 0, NULL, NULL), "Error writing to buffer.");
+		HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufLambda[i], CL_FALSE, 0, sizeof(tvec2<T>) * nContacts , &bufLambda[0], 0, NULL, NULL), "Error writing to buffer.");
 
-		//HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 14, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		//HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 15, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		//HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 16, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		//HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 17, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
 		/*HANDLE_CLERROR(clSetKernelArg(kernels[i][0], 2, sizeof(cl_uint), &nBody), "Failed to set kernel args.");
 		HANDLE_CLERROR(clSetKernelArg(kernels[i][0], 3, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");*/
 
@@ -456,61 +1053,106 @@ void OclCompute::_0_run(unsigned int nBody, unsigned int nContacts,
 
 		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][0], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
 */
-		size_t gws;
-		size_t lws = 32;
-		gws = nContacts;
-		/*for (int j = 0; j < 500; j++) {
-			HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][1], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
-			HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][2], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
-		}*/
-
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][3], 11, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
-		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][3], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
-		//HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][4], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
-
-		/*
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], 13, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], 14, 2 * sizeof(uint) * nContacts, NULL), "Failed to set kernel args.");
-        HANDLE_CLERROR(clSetKernelArg(kernels[i][5], 15, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], 16, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], 17, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][5], 18, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][5], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
-		*/
-		/*HANDLE_CLERROR(clSetKernelArg(kernels[i][6], 10, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], 11, 2 * sizeof(uint) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], 12, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], 13, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], 14, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], 15, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][7], 9, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
-		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][6], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
-		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][7], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
-		*/
-		//HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][8], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
-		//HANDLE_CLERROR(clEnqueueReadBuffer(cmdQs[i], clBufLambda[i], CL_FALSE, 0, sizeof(vec2) * nContacts , &bufLambda[0], 0, NULL, NULL), "Error reading from buffer.");
-
-		/*HANDLE_CLERROR(clSetKernelArg(kernels[i][9], 11, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], 12, 2 * sizeof(uint) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], 13, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], 14, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], 15, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-		HANDLE_CLERROR(clSetKernelArg(kernels[i][9], 16, 6 * sizeof(scalar) * nContacts, NULL), "Failed to set kernel args.");
-
-		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][9], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
-		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][3], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][6], 2, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
+
+		if (solverMode == OCL_GS_COLOR) {
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufColorOrder[i], CL_FALSE, 0, sizeof(cl_uint) * nContacts , &colorOrder[0], 0, NULL, NULL), "Error writing to buffer.");
+
+			// Colors must run in order, the in-order queue serializes the launches
+			size_t lws = OCL_GS_LWS;
+			for (unsigned int iter = 0; iter < iterCount; iter++) {
+				for (size_t c = 0; c + 1 < colorOffset.size(); c++) {
+					cl_uint offset = colorOffset[c];
+					cl_uint size = colorOffset[c + 1] - colorOffset[c];
+					size_t gws = (size + lws - 1) / lws * lws;
+					HANDLE_CLERROR(clSetKernelArg(kernels[i][5], 13, sizeof(cl_uint), &offset), "Failed to set kernel args.");
+					HANDLE_CLERROR(clSetKernelArg(kernels[i][5], 14, sizeof(cl_uint), &size), "Failed to set kernel args.");
+					HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][5], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
+				}
+
+				if ((iter + 1) % OCL_RESIDUAL_CHECK == 0 && iter + 1 < iterCount && residualConverged(i)) {
+					iterations = iter + 1;
+					break;
+				}
+			}
+		}
+		else {
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufBodyOffset[i], CL_FALSE, 0, sizeof(cl_uint) * (nBody + 1) , &bodyOffset[0], 0, NULL, NULL), "Error writing to buffer.");
+			HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufBodyContacts[i], CL_FALSE, 0, sizeof(cl_uint) * bodyOffset[nBody] , &bodyContacts[0], 0, NULL, NULL), "Error writing to buffer.");
+
+
+			if (solverMode == OCL_JACOBI_MANIFOLD) {
+				unsigned int nManifolds = manifoldOffset.size() - 1;
+				HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufManifoldOffset[i], CL_FALSE, 0, sizeof(cl_uint) * (nManifolds + 1) , &manifoldOffset[0], 0, NULL, NULL), "Error writing to buffer.");
+				iterations = runJacobiManifold(i, nBody, nManifolds);
+			}
+			else {
+#if OCL_BENCHMARK
+				benchmarkJacobi(i, nBody, nContacts, deltaVel, bufLambda);
+				HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufDeltaVel[i], CL_FALSE, 0, sizeof(tvec6<T>) * nBody , &deltaVel[0], 0, NULL, NULL), "Error writing to buffer.");
+				HANDLE_CLERROR(clEnqueueWriteBuffer(cmdQs[i], clBufLambda[i], CL_FALSE, 0, sizeof(tvec2<T>) * nContacts , &bufLambda[0], 0, NULL, NULL), "Error writing to buffer.");
+#endif
+				if (solverMode == OCL_JACOBI_TUNED) {
+					// Bands are sorted by size, past the largest the largest one holds
+					size_t band = 0;
+					while (band + 1 < tuning[i].size() && tuning[i][band].size < nContacts)
+						band++;
+					iterations = runJacobiVariant(i, tuning[i][band].mode, tuning[i][band].lws, nBody, nContacts);
+				}
+				else if (solverMode == OCL_JACOBI_PERSISTENT)
+					iterations = runJacobiPersistent(i, nBody, nContacts, OCL_PERSISTENT_LWS);
+				else if (solverMode == OCL_JACOBI_TILED)
+					iterations = runJacobi(i, nBody, nContacts, OCL_TILED_LWS, true);
+				else
+					iterations = runJacobi(i, nBody, nContacts, OCL_JACOBI_LWS, false);
+			}
+		}
+		//HANDLE_CLERROR(clEnqueueReadBuffer(cmdQs[i], clBufLambda[i], CL_FALSE, 0, sizeof(tvec2<T>) * nContacts , &bufLambda[0], 0, NULL, NULL), "Error reading from buffer.");
+
+		/*HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 11, sizeof(cl_uint), &nContacts), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 12, 2 * sizeof(uint) * nContacts, NULL), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 13, 6 * sizeof(T) * nContacts, NULL), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 14, 6 * sizeof(T) * nContacts, NULL), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 15, 6 * sizeof(T) * nContacts, NULL), "Failed to set kernel args.");
+		HANDLE_CLERROR(clSetKernelArg(kernels[i][4], 16, 6 * sizeof(T) * nContacts, NULL), "Failed to set kernel args.");
+
+		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][4], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
+		HANDLE_CLERROR(clEnqueueNDRangeKernel (cmdQs[i], kernels[i][2], 1, NULL, &gws, &lws, 0, NULL, NULL), "Failed to execute kernel");
 */
 
 
-		HANDLE_CLERROR(clEnqueueReadBuffer(cmdQs[i], clBufDeltaVel[i], CL_TRUE, 0, sizeof(vec6) * nBody , &deltaVel[0], 0, NULL, NULL), "Error reading from buffer.");
+		HANDLE_CLERROR(clEnqueueReadBuffer(cmdQs[i], clBufLambda[i], CL_FALSE, 0, sizeof(tvec2<T>) * nContacts , &bufLambda[0], 0, NULL, NULL), "Error reading from buffer.");
+		HANDLE_CLERROR(clEnqueueReadBuffer(cmdQs[i], clBufDeltaVel[i], CL_TRUE, 0, sizeof(tvec6<T>) * nBody , &deltaVel[0], 0, NULL, NULL), "Error reading from buffer.");
 	}
+	return iterations;
 }
 
+/* The two precisions a PhysicsWorld solves in */
+template unsigned int OclCompute::_0_run<float>(unsigned int, unsigned int,
+			std::vector<tvec6<float>>&, const std::vector<ivec2>&,
+			const std::vector<tvec6<float>>&, const std::vector<tvec6<float>>&, const std::vector<tvec6<float>>&, const std::vector<tvec6<float>>&,
+			const std::vector<tvec6<float>>&, const std::vector<tvec6<float>>&, const std::vector<tvec6<float>>&, const std::vector<tvec6<float>>&,
+			const std::vector<tvec2<float>>&, std::vector<tvec2<float>>&, const std::vector<tvec2<float>>&,
+			const std::vector<unsigned int>&, const std::vector<unsigned int>&, const std::vector<unsigned int>&,
+			const std::vector<unsigned int>&, const std::vector<unsigned int>&, const std::vector<unsigned int>&);
+template unsigned int OclCompute::_0_run<double>(unsigned int, unsigned int,
+			std::vector<tvec6<double>>&, const std::vector<ivec2>&,
+			const std::vector<tvec6<double>>&, const std::vector<tvec6<double>>&, const std::vector<tvec6<double>>&, const std::vector<tvec6<double>>&,
+			const std::vector<tvec6<double>>&, const std::vector<tvec6<double>>&, const std::vector<tvec6<double>>&, const std::vector<tvec6<double>>&,
+			const std::vector<tvec2<double>>&, std::vector<tvec2<double>>&, const std::vector<tvec2<double>>&,
+			const std::vector<unsigned int>&, const std::vector<unsigned int>&, const std::vector<unsigned int>&,
+			const std::vector<unsigned int>&, const std::vector<unsigned int>&, const std::vector<unsigned int>&);
+
+void OclCompute::setSolverParams(unsigned int iter, double tol, JacobiAccel accel) {
+	iterCount = iter;
+	tolerance = tol;
+	acceleration = accel;
+}
 
-
-void OclCompute::init(unsigned int iter, scalar frictionCoeff) {
+void OclCompute::init(unsigned int iter, double tol, Precision prec) {
 	iterCount = iter;
-	mu = frictionCoeff;
+	tolerance = tol;
+	precision = prec;
 
 	_0_checkDevices();
 
@@ -521,6 +1163,23 @@ void OclCompute::init(unsigned int iter, scalar frictionCoeff) {
 	_2_initKernels();
 	_3_createBuffer();
 	_4_setKernelArgsStatic();
+	if (solverMode == OCL_JACOBI_TUNED)
+		_5_tuneJacobi();
+}
+
+bool OclCompute::setPrecision(Precision prec) {
+	if (prec == precision)
+		return false;
+	precision = prec;
+	releaseKernels();
+	_2_initKernels();
+	_4_setKernelArgsStatic();
+	if (solverMode == OCL_JACOBI_TUNED) {
+		// The cache keys the tuning by precision
+		tuning.clear();
+		_5_tuneJacobi();
+	}
+	return true;
 }
 
 std::string OclCompute::readSource(std::string fName) {
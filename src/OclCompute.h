@@ -8,9 +8,40 @@
 #define __OclCompute_h_
 #include <CL/cl.hpp>
 #include "DataType.h"
+#include "JacobiAccel.h"
 
 #define OCL_EXTRA_INFO 1
 #define OCL_INCLUDE_PATH ""
+#define OCL_BINARY_CACHE "kernel/jacobi_" // Built programs go to this prefix plus the key hash and .bin, delete to rebuild
+#define OCL_REDUCE_LWS 128 // Work group size of reduce_residual, power of two
+#define OCL_GS_LWS 32 // Work group size of gs_color, a color is rounded up to a multiple of it
+#define OCL_RESIDUAL_CHECK 4 // Gauss-Seidel iterations between convergence checks, each check is a blocking read
+#define OCL_PERSISTENT_LWS 64 // Work group size of jacobi_persistent, power of two
+#define OCL_JACOBI_LWS 32 // Work group size of the other Jacobi kernels
+#define OCL_TILED_LWS 64 // Contacts per tile of jacobi_tiled, each takes 30 scalars and 2 uints of local memory
+#define OCL_TILED_GROUPS 4 // jacobi_tiled groups per compute unit, each streams its share of the tiles
+#define OCL_TUNE_CACHE "ocl_tuning.txt" // Autotuner results, one line per device and contact band, delete to tune again
+#define OCL_TUNE_ITERATIONS 20 // Sweeps of every timed run, the best of OCL_TUNE_REPEATS runs counts
+#define OCL_TUNE_REPEATS 3
+#define OCL_BENCHMARK 0 // 1 to time the Jacobi variants from the same warm start on every _0_run
+#define OCL_UPLOAD_GAP 64 // Unchanged contacts between two row ranges below which both go up in one write
+
+/* Solver kernel used by _0_run */
+enum OclSolverMode {
+	OCL_JACOBI, // jacobi_contact then jacobi_body per iteration, bodies gather their contacts, no atomics
+	OCL_JACOBI_PERSISTENT, // Same iteration in one jacobi_persistent launch, groups meet at a global barrier
+	OCL_JACOBI_TILED, // jacobi_tiled then jacobi_body per iteration, contact rows go through local memory in tiles
+	OCL_JACOBI_MANIFOLD, // jacobi_manifold then manifold_body, one work item solves all points of a manifold
+	OCL_GS_COLOR, // gs_color, one launch per color per iteration, Gauss-Seidel without atomics
+	OCL_JACOBI_TUNED // OCL_JACOBI, OCL_JACOBI_PERSISTENT or OCL_JACOBI_TILED and the work group size the autotuner picked
+};
+
+/* Jacobi variant and work group size for up to size contacts */
+struct OclTuning {
+	unsigned int size;
+	OclSolverMode mode;
+	size_t lws;
+};
 
 class OclCompute {
 	static void test();
@@ -35,10 +66,15 @@ class OclCompute {
 	static std::vector<std::vector<cl_kernel>> kernels; // Multiple kernels per device
 	static std::vector<cl_ulong> maxGlobalMemSz; // Store max global memory for each device
 	static std::vector<cl_ulong> maxMemAllocSz; // Store max memory object size
+	static std::vector<cl_uint> computeUnits; // Bounds the work groups of jacobi_persistent
 
 	static void _0_checkDevices();
 	static void _1_activateDevices(const std::vector<unsigned int> &devList);
 	static void _2_initKernels();
+	static void releaseKernels();
+	static cl_program loadProgramBinary(size_t device, const std::string &key, const std::string &fileName);
+	static void saveProgramBinary(size_t device, cl_program program, const std::string &key, const std::string &fileName);
+	static void _5_tuneJacobi();
 
 	/* Application Specific*/
 	static std::vector<cl_mem> clBufDeltaVel;
@@ -54,21 +90,72 @@ class OclCompute {
 	static std::vector<cl_mem> clBufB;
 	static std::vector<cl_mem> clBufLambda;
 	static std::vector<cl_mem> clBufDeltaLambda;
+	static std::vector<cl_mem> clBufDirection; // Lambda change of the last iteration, for JacobiAccel
+	static std::vector<cl_mem> clBufColorOrder;
+	static std::vector<cl_mem> clBufResidual;
+	static std::vector<cl_mem> clBufResidualSum;
+	static std::vector<cl_mem> clBufMaterial;
+	static std::vector<cl_mem> clBufBodyOffset;
+	static std::vector<cl_mem> clBufBodyContacts;
+	static std::vector<cl_mem> clBufGroupResidual;
+	static std::vector<cl_mem> clBufSyncState;
+	static std::vector<cl_mem> clBufManifoldOffset;
+	static std::vector<cl_mem> clBufManifoldDelta; // Summed change of both bodies per manifold
 
 	static unsigned int iterCount;
-	static scalar mu;
+	static double tolerance;
+	static Precision precision; // The program and the scalar kernel arguments are built for it
+	static JacobiAccel acceleration; // Step between the sweeps of runJacobi
+	static std::vector<std::vector<OclTuning>> tuning; // Per device, by increasing size, the last one has no limit
 	static void _3_createBuffer();
 	static void _4_setKernelArgsStatic();
+	static size_t scalarSize();
+	static void setScalarArg(size_t device, size_t kernel, cl_uint index, double value);
+	static void readResidual(size_t device, bool summed, double *residualSum);
+	static bool residualConverged(size_t device, bool summed = false);
+	/* The Jacobi variants start from deltaVel and lambda on the device and return the iterations run */
+	static unsigned int runJacobi(size_t device, unsigned int nBody, unsigned int nContacts, size_t lws, bool tiled);
+	static unsigned int runJacobiPersistent(size_t device, unsigned int nBody, unsigned int nContacts, size_t lws);
+	static unsigned int runJacobiVariant(size_t device, OclSolverMode mode, size_t lws, unsigned int nBody, unsigned int nContacts);
+	static unsigned int runJacobiManifold(size_t device, unsigned int nBody, unsigned int nManifolds);
+	template <typename T>
+	static void benchmarkJacobi(size_t device, unsigned int nBody, unsigned int nContacts,
+				const std::vector<tvec6<T>> &deltaVel, const std::vector<tvec2<T>> &bufLambda);
+	static std::string deviceKey(size_t device);
+	static bool supportsDouble(cl_device_id device);
+	static double timeJacobi(size_t device, const OclTuning &config, unsigned int nBody, unsigned int nContacts);
+	template <typename T>
+	static void writeTuningPile(size_t device, unsigned int nContacts, unsigned int nBody);
 public:
-	static void init(unsigned int iterCount, scalar mu);
+	static OclSolverMode solverMode;
 
-	static void _0_run(unsigned int nBody, unsigned int nContacts,
-				std::vector<vec6> &deltaVel, const std::vector<ivec2> &bodyIndex,
-				const std::vector<vec6> &bufConstNormalD_A, const std::vector<vec6> &bufConstNormalM_A,
-				const std::vector<vec6> &bufConstTangentD_A, const std::vector<vec6> &bufConstTangentM_A,
-				const std::vector<vec6> &bufConstNormalD_B, const std::vector<vec6> &bufConstNormalM_B,
-				const std::vector<vec6> &bufConstTangentD_B, const std::vector<vec6> &bufConstTangentM_B,
-				const std::vector<vec2> &bufB, std::vector<vec2> &bufLambda);
+	static void init(unsigned int iterCount, double tolerance, Precision precision);
+	/* Takes effect on the next _0_run without rebuilding the program, acceleration applies to OCL_JACOBI */
+	static void setSolverParams(unsigned int iterCount, double tolerance, JacobiAccel acceleration);
+	/*
+	 * Builds the program for precision unless it already is, returns true when it was rebuilt. The rows on
+	 * the device are then of the other precision and have to be written again.
+	 */
+	static bool setPrecision(Precision precision);
+
+	/*
+	 * Returns the number of iterations run. Contacts of a manifold are contiguous, manifold m spans
+	 * manifoldOffset[m] to manifoldOffset[m + 1] - 1. For OCL_JACOBI_MANIFOLD the body adjacency lists
+	 * manifolds instead of contacts. Body indices and rows are only written for the begin and end pairs in
+	 * rowRanges, the other contacts have the same ones as on the last call. T has to be the precision the
+	 * program was built for.
+	 */
+	template <typename T>
+	static unsigned int _0_run(unsigned int nBody, unsigned int nContacts,
+				std::vector<tvec6<T>> &deltaVel, const std::vector<ivec2> &bodyIndex,
+				const std::vector<tvec6<T>> &bufConstNormalD_A, const std::vector<tvec6<T>> &bufConstNormalM_A,
+				const std::vector<tvec6<T>> &bufConstTangentD_A, const std::vector<tvec6<T>> &bufConstTangentM_A,
+				const std::vector<tvec6<T>> &bufConstNormalD_B, const std::vector<tvec6<T>> &bufConstNormalM_B,
+				const std::vector<tvec6<T>> &bufConstTangentD_B, const std::vector<tvec6<T>> &bufConstTangentM_B,
+				const std::vector<tvec2<T>> &bufB, std::vector<tvec2<T>> &bufLambda, const std::vector<tvec2<T>> &bufMaterial,
+				const std::vector<unsigned int> &colorOrder, const std::vector<unsigned int> &colorOffset,
+				const std::vector<unsigned int> &bodyOffset, const std::vector<unsigned int> &bodyContacts,
+				const std::vector<unsigned int> &manifoldOffset, const std::vector<unsigned int> &rowRanges);
 };
 
 #define HANDLE_CLERROR(cl_error, message)	  \
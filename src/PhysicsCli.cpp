@@ -0,0 +1,240 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+
+/*
+ * Headless driver: builds a pile of cubes on the ground and steps the PhysicsWorld for a fixed
+ * number of frames without Ogre, printing per frame contact statistics and step times.
+ * Only compiled when HEADLESS is defined, see Readme.txt.
+ */
+#ifdef HEADLESS
+#include "PhysicsWorld.h"
+#include "OclCompute.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+
+/* Unit cube, same geometry as MeshObjects::cubeObject() */
+static const glm::dvec3 cubeVertices[8] = {
+		glm::dvec3(-0.5, 0.5, -0.5),
+		glm::dvec3(0.5, 0.5, -0.5),
+		glm::dvec3(0.5, -0.5, -0.5),
+		glm::dvec3(-0.5, -0.5, -0.5),
+		glm::dvec3(-0.5, 0.5, 0.5),
+		glm::dvec3(0.5, 0.5, 0.5),
+		glm::dvec3(0.5, -0.5, 0.5),
+		glm::dvec3(-0.5, -0.5, 0.5)
+};
+
+static const unsigned long cubeIndices[36] = {
+		0,2,3,
+		0,1,2,
+		1,6,2,
+		1,5,6,
+		4,6,5,
+		4,7,6,
+		0,7,4,
+		0,3,7,
+		0,5,1,
+		0,4,5,
+		2,7,3,
+		2,6,7
+};
+
+static void addGround(PhysicsWorld &world) {
+	std::vector<RigidBody> &bodies = world.getBodies();
+	try {
+		bodies.push_back(RigidBody(bodies.size(), cubeVertices, 8, cubeIndices, 36, glm::dvec3(2000.0, 1.0, 2000.0),
+				1.0/300.0, 1.0/300.0, glm::dvec3(0), world.getCollisionWorld(), true));
+	} catch(std::bad_alloc &xa) {
+		std::cerr<<"Couldn't Reallocate RigidBody stack"<<std::endl;
+		exit(0);
+	}
+}
+
+static bool mixedMaterials = false;
+
+/* Same placement as RigidBodySystem::addCube(), 10 x 10 cubes per layer */
+static void addCube(PhysicsWorld &world) {
+	static int i = 0;
+	std::vector<RigidBody> &bodies = world.getBodies();
+	int posX = -200 + (i % 10) * 40;
+	int posZ = -200 + ((i/10) % 10) * 40;
+	int posY = 250 + ((i/100) % 10) * 40;
+	i++;
+	try {
+		bodies.push_back(RigidBody(bodies.size(), cubeVertices, 8, cubeIndices, 36, glm::dvec3(30.0),
+				20.0, 1.0, glm::dvec3(posX, posY, posZ), world.getCollisionWorld(), false));
+		// Every other cube is slippery and bouncy, the rest use the world defaults
+		if (mixedMaterials && (i & 1))
+			bodies.back().setMaterial(0.05, 0.3);
+	} catch(std::bad_alloc &xa) {
+		std::cerr<<"Couldn't Reallocate RigidBody stack"<<std::endl;
+		exit(0);
+	}
+}
+
+static void usage(const char *name) {
+	std::cout<<"Usage: "<<name<<" [-f frames] [-c cubes] [-p printInterval] [-t threads] [-s gs|jacobi|persistent|tiled|manifold|auto|cpu|pgs] [-x scalar|avx2] [-q float|double] [-w 0|1] [-e tolerance] [-i iterations] [-m 0|1] [-z 0|1] [-k 0|1] [-n iterations] [-a none|nncg|chebyshev] [-l sweeps] [-r points] [-u tolerance] [-d substeps]"<<std::endl;
+	std::cout<<"  -f  Number of frames to simulate (default 1000)"<<std::endl;
+	std::cout<<"  -c  Number of cubes dropped on the ground (default 100, max 1000)"<<std::endl;
+	std::cout<<"  -p  Print statistics every N frames, 0 prints only the summary (default 100)"<<std::endl;
+	std::cout<<"  -t  CPU solver threads, 0 uses all hardware threads (default 0)"<<std::endl;
+	std::cout<<"  -s  Color batched Gauss-Seidel, gather Jacobi, single launch Jacobi, local memory tiled Jacobi, per manifold block Jacobi or the autotuned Jacobi on OpenCL, or SIMD Jacobi or island Gauss-Seidel on the CPU (default gs)"<<std::endl;
+	std::cout<<"  -x  Limit the CPU Jacobi instruction set, widest supported is used by default"<<std::endl;
+	std::cout<<"  -w  Warm start contact impulses from the previous step (default 1)"<<std::endl;
+	std::cout<<"  -e  Relative lambda change at which the solver stops iterating (default 1e-3)"<<std::endl;
+	std::cout<<"  -i  Maximum solver iterations per step (default "<<ITER_COUNT<<")"<<std::endl;
+	std::cout<<"  -m  Alternate cubes between the default and a low friction material (default 0)"<<std::endl;
+	std::cout<<"  -z  Put islands that stay at rest to sleep (default 1)"<<std::endl;
+	std::cout<<"  -k  Correct penetration with a separate split impulse pass (default 1)"<<std::endl;
+	std::cout<<"  -n  Iterations of the split impulse pass (default 10)"<<std::endl;
+	std::cout<<"  -a  Step between Jacobi sweeps: none, conjugate gradient momentum or Chebyshev weights (default none)"<<std::endl;
+	std::cout<<"  -l  Shock propagation sweeps per pile layer after the velocity solve, 0 turns it off (default 0)"<<std::endl;
+	std::cout<<"  -r  Contact points kept per manifold, 1 to "<<MANIFOLD_CACHE_SIZE<<" (default "<<MANIFOLD_CACHE_SIZE<<")"<<std::endl;
+	std::cout<<"  -u  Relative motion before the rows of a persistent contact are built again, 0 builds them every step (default 1e-3)"<<std::endl;
+	std::cout<<"  -d  Substeps per time step, all solving the contacts of one collision pass (default 1)"<<std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	unsigned long numFrames = 1000;
+	unsigned long numCubes = 100;
+	unsigned long printInterval = 100;
+
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 < argc && !strcmp(argv[i], "-f"))
+			numFrames = std::strtoul(argv[++i], NULL, 10);
+		else if (i + 1 < argc && !strcmp(argv[i], "-c"))
+			numCubes = std::strtoul(argv[++i], NULL, 10);
+		else if (i + 1 < argc && !strcmp(argv[i], "-p"))
+			printInterval = std::strtoul(argv[++i], NULL, 10);
+		else if (i + 1 < argc && !strcmp(argv[i], "-t"))
+			PhysicsWorld::numThreads = std::strtoul(argv[++i], NULL, 10);
+		else if (i + 1 < argc && !strcmp(argv[i], "-e"))
+			PhysicsWorld::tolerance = std::strtod(argv[++i], NULL);
+		else if (i + 1 < argc && !strcmp(argv[i], "-w"))
+			PhysicsWorld::warmStart = std::strtoul(argv[++i], NULL, 10) != 0;
+		else if (i + 1 < argc && !strcmp(argv[i], "-i"))
+			PhysicsWorld::maxIterations = std::strtoul(argv[++i], NULL, 10);
+		else if (i + 1 < argc && !strcmp(argv[i], "-m"))
+			mixedMaterials = std::strtoul(argv[++i], NULL, 10) != 0;
+		else if (i + 1 < argc && !strcmp(argv[i], "-z"))
+			PhysicsWorld::sleeping = std::strtoul(argv[++i], NULL, 10) != 0;
+		else if (i + 1 < argc && !strcmp(argv[i], "-k"))
+			PhysicsWorld::splitImpulse = std::strtoul(argv[++i], NULL, 10) != 0;
+		else if (i + 1 < argc && !strcmp(argv[i], "-n"))
+			PhysicsWorld::positionIterations = std::strtoul(argv[++i], NULL, 10);
+		else if (i + 1 < argc && !strcmp(argv[i], "-r"))
+			PhysicsWorld::maxManifoldPoints = std::max(1UL, std::min((unsigned long)MANIFOLD_CACHE_SIZE, std::strtoul(argv[++i], NULL, 10)));
+		else if (i + 1 < argc && !strcmp(argv[i], "-d"))
+			PhysicsWorld::substeps = std::max(1UL, std::strtoul(argv[++i], NULL, 10));
+		else if (i + 1 < argc && !strcmp(argv[i], "-u"))
+			PhysicsWorld::rowTolerance = std::strtod(argv[++i], NULL);
+		else if (i + 1 < argc && !strcmp(argv[i], "-l"))
+			PhysicsWorld::shockIterations = std::strtoul(argv[++i], NULL, 10);
+		else if (i + 1 < argc && !strcmp(argv[i], "-a") && !strcmp(argv[i + 1], "none")) {
+			PhysicsWorld::acceleration = ACCEL_NONE;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-a") && !strcmp(argv[i + 1], "nncg")) {
+			PhysicsWorld::acceleration = ACCEL_NNCG;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-a") && !strcmp(argv[i + 1], "chebyshev")) {
+			PhysicsWorld::acceleration = ACCEL_CHEBYSHEV;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-s") && !strcmp(argv[i + 1], "gs")) {
+			OclCompute::solverMode = OCL_GS_COLOR;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-s") && !strcmp(argv[i + 1], "jacobi")) {
+			OclCompute::solverMode = OCL_JACOBI;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-s") && !strcmp(argv[i + 1], "manifold")) {
+			OclCompute::solverMode = OCL_JACOBI_MANIFOLD;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-s") && !strcmp(argv[i + 1], "persistent")) {
+			OclCompute::solverMode = OCL_JACOBI_PERSISTENT;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-s") && !strcmp(argv[i + 1], "tiled")) {
+			OclCompute::solverMode = OCL_JACOBI_TILED;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-s") && !strcmp(argv[i + 1], "auto")) {
+			OclCompute::solverMode = OCL_JACOBI_TUNED;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-s") && !strcmp(argv[i + 1], "cpu")) {
+			PhysicsWorld::backend = SOLVER_CPU_JACOBI;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-s") && !strcmp(argv[i + 1], "pgs")) {
+			PhysicsWorld::backend = SOLVER_PGS;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-x") && (!strcmp(argv[i + 1], "scalar") ||
+				(!strcmp(argv[i + 1], "avx2") && SimdTarget::isa >= SIMD_AVX2))) {
+			SimdTarget::isa = strcmp(argv[i + 1], "scalar") ? SIMD_AVX2 : SIMD_SCALAR;
+			i++;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-q") && (!strcmp(argv[i + 1], "float") || !strcmp(argv[i + 1], "double"))) {
+			PhysicsWorld::precision = strcmp(argv[i + 1], "float") ? PRECISION_DOUBLE : PRECISION_FLOAT;
+			i++;
+		}
+		else {
+			usage(argv[0]);
+			return 0;
+		}
+	}
+	if (numCubes > 1000)
+		numCubes = 1000;
+
+	PhysicsWorld world;
+	world.init(numCubes + 1);
+
+	addGround(world);
+	for (unsigned long i = 0; i < numCubes; i++)
+		addCube(world);
+
+	std::cout<<"Bodies: "<<world.numBodies()<<", Frames: "<<numFrames<<", Time Step: "<<PhysicsWorld::dt
+			<<", Solver Precision: "<<precisionName(world.getPrecision())<<std::endl;
+
+	double totalTime = 0;
+	unsigned long totalContacts = 0;
+	unsigned long totalIterations = 0;
+	unsigned long totalRebuilt = 0;
+	for (unsigned long frame = 1; frame <= numFrames; frame++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		ContactInfo cInfo = world.step();
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double stepTime = std::chrono::duration<double, std::milli>(end - start).count();
+		totalTime += stepTime;
+		totalContacts += cInfo.numContacts;
+		totalIterations += cInfo.iterations;
+		totalRebuilt += cInfo.numRebuilt;
+
+		if (printInterval && frame % printInterval == 0)
+			std::cout<<"Frame: "<<frame<<", Contacts: "<<cInfo.numContacts<<", Rebuilt: "<<cInfo.numRebuilt
+				<<", Penetration Error: "<<(cInfo.numContacts ? cInfo.pentrationError : 0)
+				<<", Iterations: "<<cInfo.iterations<<", Islands: "<<cInfo.numIslands<<", Sleeping: "<<cInfo.numSleeping
+				<<", Step: "<<std::fixed<<std::setprecision(3)<<stepTime<<" ms"<<std::defaultfloat<<std::endl;
+	}
+
+	std::cout<<"Total: "<<totalTime<<" ms, Avg Step: "<<totalTime / (numFrames ? numFrames : 1)<<" ms, Avg Contacts: "
+			<<totalContacts / (numFrames ? numFrames : 1)<<", Avg Rebuilt: "<<totalRebuilt / (numFrames ? numFrames : 1)<<", Avg Iterations: "<<totalIterations / (double)(numFrames ? numFrames : 1)
+			<<", Physics FPS: "<<(totalTime > 0 ? numFrames * 1000.0 / totalTime : 0)<<std::endl;
+	return 0;
+}
+#endif
@@ -0,0 +1,535 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+#include "PhysicsWorld.h"
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include <cmath>
+#include "OclCompute.h"
+
+double PhysicsWorld::dt = 0.05;
+double PhysicsWorld::bounce = 0.0;
+double PhysicsWorld::mu = 0.33;
+double PhysicsWorld::gravity = -0.1;
+unsigned int PhysicsWorld::maxIterations = ITER_COUNT;
+double PhysicsWorld::tolerance = 1e-3;
+unsigned int PhysicsWorld::numThreads = 0;
+bool PhysicsWorld::warmStart = true;
+JacobiAccel PhysicsWorld::acceleration = ACCEL_NONE;
+bool PhysicsWorld::sleeping = true;
+double PhysicsWorld::sleepLinearVelocity = 0.1;
+double PhysicsWorld::sleepAngularVelocity = 0.01;
+double PhysicsWorld::sleepTime = 2.0;
+bool PhysicsWorld::splitImpulse = true;
+double PhysicsWorld::positionCorrection = 0.2;
+double PhysicsWorld::penetrationSlop = 0.1;
+unsigned int PhysicsWorld::positionIterations = 10;
+unsigned int PhysicsWorld::shockIterations = 0;
+unsigned int PhysicsWorld::maxManifoldPoints = MANIFOLD_CACHE_SIZE;
+unsigned int PhysicsWorld::substeps = 1;
+double PhysicsWorld::rowTolerance = 1e-3;
+SolverBackend PhysicsWorld::backend = SOLVER_OPENCL;
+Precision PhysicsWorld::precision = PRECISION_FLOAT;
+
+/*
+ * Bullet keeps a btManifoldPoint alive while the contact persists, so its impulse slots carry lambda from
+ * the previous step. There is a single friction direction, m_appliedImpulseLateral2 holds its angle
+ * instead, zero marks a new point.
+ */
+static double persistentTangentAngle(btManifoldPoint &pt) {
+	if (pt.m_appliedImpulseLateral2 == 0)
+		pt.m_appliedImpulseLateral2 = (std::rand() + 1.0) / (RAND_MAX + 1.0) * 2.0 * M_PI;
+	return pt.m_appliedImpulseLateral2;
+}
+
+/*
+ * Friction is the geometric mean, so a frictionless body slides on anything. Restitution is the larger
+ * of the two, a bouncy ball bounces off a dead floor.
+ */
+static void combineMaterial(const RigidBody *A, const RigidBody *B, double &friction, double &restitution) {
+	double frictionA = A->getFriction() < 0 ? PhysicsWorld::mu : A->getFriction();
+	double frictionB = B->getFriction() < 0 ? PhysicsWorld::mu : B->getFriction();
+	double restitutionA = A->getRestitution() < 0 ? PhysicsWorld::bounce : A->getRestitution();
+	double restitutionB = B->getRestitution() < 0 ? PhysicsWorld::bounce : B->getRestitution();
+
+	friction = std::sqrt(frictionA * frictionB);
+	restitution = std::max(restitutionA, restitutionB);
+}
+
+/*
+ * Separation speed that removes positionCorrection of the depth beyond the slop in one step of length h.
+ * Bullet reports penetration as a negative distance.
+ */
+static inline double positionBias(double distance, double h) {
+	if (!PhysicsWorld::splitImpulse)
+		return 0;
+	return std::max(0.0, -distance - PhysicsWorld::penetrationSlop) * PhysicsWorld::positionCorrection / h;
+}
+
+static inline RigidBody *getBody(const btCollisionObject *ob) {
+	return (RigidBody *)ob->getUserPointer();
+}
+
+static inline bool isAwake(const RigidBody *body) {
+	return !body->isConstrained() && !body->isSleeping();
+}
+
+/* Bullet keeps the manifolds of sleeping bodies, they produce no contacts until one side wakes */
+static inline bool isActive(const btPersistentManifold *contactManifold) {
+	return isAwake(getBody(contactManifold->getBody0())) || isAwake(getBody(contactManifold->getBody1()));
+}
+
+/*
+ * Rows built from cached still hold for key while the contact stayed at the same manifold point between
+ * the same bodies and neither lever arm moved by more than rowTolerance of its length, nor did the normal
+ * or either body turn by more than rowTolerance radians. For unit quaternions 1 - |dot| is angle^2 / 8.
+ */
+static bool rowsMatch(const ContactRowKey &cached, const ContactRowKey &key) {
+	double tolerance = PhysicsWorld::rowTolerance;
+	if (cached.point != key.point || cached.indexA != key.indexA || cached.indexB != key.indexB ||
+			cached.numContactsA != key.numContactsA || cached.numContactsB != key.numContactsB ||
+			cached.tangentAngle != key.tangentAngle)
+		return false;
+	return glm::length(key.normal - cached.normal) < tolerance &&
+		glm::length(key.rA - cached.rA) < tolerance * glm::length(cached.rA) &&
+		glm::length(key.rB - cached.rB) < tolerance * glm::length(cached.rB) &&
+		1 - std::abs(glm::dot(key.rotA, cached.rotA)) < 0.125 * tolerance * tolerance &&
+		1 - std::abs(glm::dot(key.rotB, cached.rotB)) < 0.125 * tolerance * tolerance;
+}
+
+static inline btScalar triangleArea(const btVector3 &a, const btVector3 &b, const btVector3 &c) {
+	return (b - a).cross(c - a).length();
+}
+
+/*
+ * Picks at most PhysicsWorld::maxManifoldPoints well spread points of a manifold: the deepest, the one
+ * farthest from it, the one spanning the largest triangle with both and the one adding the most area to
+ * that triangle. Returns the count, selected holds point indices in manifold order.
+ */
+static int reduceManifold(btPersistentManifold *contactManifold, int *selected) {
+	int numPoints = contactManifold->getNumContacts();
+	int maxPoints = (int)PhysicsWorld::maxManifoldPoints;
+	if (numPoints <= maxPoints) {
+		for (int j = 0; j < numPoints; j++)
+			selected[j] = j;
+		return numPoints;
+	}
+
+	bool taken[MANIFOLD_CACHE_SIZE] = {false};
+	btVector3 p[MANIFOLD_CACHE_SIZE];
+	for (int j = 0; j < numPoints; j++)
+		p[j] = contactManifold->getContactPoint(j).getPositionWorldOnB();
+
+	int chosen[MANIFOLD_CACHE_SIZE];
+	for (int k = 0; k < maxPoints; k++) {
+		int best = -1;
+		btScalar bestScore = 0;
+		for (int j = 0; j < numPoints; j++) {
+			if (taken[j])
+				continue;
+			btScalar score;
+			if (k == 0)
+				score = -contactManifold->getContactPoint(j).getDistance();
+			else if (k == 1)
+				score = p[j].distance2(p[chosen[0]]);
+			else if (k == 2)
+				score = triangleArea(p[chosen[0]], p[chosen[1]], p[j]);
+			else
+				// Inside the triangle the three areas add up to it, outside they exceed it
+				score = triangleArea(p[chosen[0]], p[chosen[1]], p[j]) + triangleArea(p[chosen[1]], p[chosen[2]], p[j]) +
+					triangleArea(p[chosen[2]], p[chosen[0]], p[j]);
+			if (best < 0 || score > bestScore) {
+				best = j;
+				bestScore = score;
+			}
+		}
+		chosen[k] = best;
+		taken[best] = true;
+	}
+
+	int count = 0;
+	for (int j = 0; j < numPoints; j++)
+		if (taken[j])
+			selected[count++] = j;
+	return count;
+}
+
+/* Refreshes the active manifolds and lists the points that become contacts, in contact order */
+void PhysicsWorld::gatherContactPoints() {
+	contactPoints.clear();
+	manifoldOffset.assign(1, 0);
+	int numManifolds = collisionWorld->getDispatcher()->getNumManifolds();
+	for (int i = 0; i < numManifolds; i++) {
+		btPersistentManifold* contactManifold = collisionWorld->getDispatcher()->getManifoldByIndexInternal(i);
+		if (!isActive(contactManifold))
+			continue;
+		const btCollisionObject* obA = static_cast<const btCollisionObject*>(contactManifold->getBody0());
+		const btCollisionObject* obB = static_cast<const btCollisionObject*>(contactManifold->getBody1());
+		contactManifold->refreshContactPoints(obA->getWorldTransform(), obB->getWorldTransform());
+
+		int selected[MANIFOLD_CACHE_SIZE];
+		int count = reduceManifold(contactManifold, selected);
+		for (int j = 0; j < count; j++) {
+			ManifoldPoint mp;
+			mp.manifold = contactManifold;
+			mp.point = &contactManifold->getContactPoint(selected[j]);
+			contactPoints.push_back(mp);
+		}
+		if (count)
+			manifoldOffset.push_back(contactPoints.size());
+	}
+}
+
+void PhysicsWorld::init(size_t maxBodies) {
+	setPrecision(solverPrecision);
+	setSolver(backend);
+
+	broadphase = new btDbvtBroadphase();
+	collisionConfiguration = new btDefaultCollisionConfiguration();
+	dispatcher = new btCollisionDispatcher(collisionConfiguration);
+	collisionWorld = new btCollisionWorld(dispatcher, broadphase, collisionConfiguration);
+	// Sleeping bodies do not move, only active objects need new AABBs
+	collisionWorld->setForceUpdateAllAabbs(false);
+
+	pool = new ThreadPool(numThreads);
+
+	contacts.reserve(500);
+	bodies.reserve(maxBodies);
+}
+
+void PhysicsWorld::setSolver(SolverBackend backend) {
+	delete solver;
+	solver = ContactSolver::create(backend, solverPrecision);
+	PhysicsWorld::backend = backend;
+	// Another solver may have left different rows on the device, or none
+	rowKeys.clear();
+	std::cout<<"Solver: "<<solver->name();
+	if (backend == SOLVER_CPU_JACOBI)
+		std::cout<<", "<<SimdTarget::isaName(solverPrecision == PRECISION_FLOAT ? SimdTarget::isa : SIMD_SCALAR);
+	std::cout<<std::endl;
+}
+
+void PhysicsWorld::setPrecision(Precision precision) {
+	solverPrecision = precision;
+	// The rows kept so far are in the other set
+	rowKeys.clear();
+	std::cout<<"Solver Precision: "<<precisionName(precision)<<std::endl;
+}
+
+void PhysicsWorld::integrate() {
+	for (size_t i = 0; i < bodies.size(); i++) {
+		if (bodies[i].isSleeping())
+			continue;
+		if (substeps > 1) {
+			bodies[i].advanceSubstep(dt / substeps);
+			bodies[i].applySubsteps();
+			continue;
+		}
+		bodies[i].advanceTime(dt);
+	}
+}
+
+/*
+ * A sleeping body touching an awake one wakes up, and so does everything resting on it in the same step.
+ * Every pass wakes one more layer of the sleeping island, until a pass wakes nothing.
+ */
+void PhysicsWorld::wakeTouching() {
+	bool woke = true;
+	while (woke) {
+		woke = false;
+		int numManifolds = collisionWorld->getDispatcher()->getNumManifolds();
+		for (int i = 0; i < numManifolds; i++) {
+			btPersistentManifold* contactManifold = collisionWorld->getDispatcher()->getManifoldByIndexInternal(i);
+			if (contactManifold->getNumContacts() == 0)
+				continue;
+			RigidBody *A = getBody(contactManifold->getBody0());
+			RigidBody *B = getBody(contactManifold->getBody1());
+			RigidBody *sleeper = (A->isSleeping() && isAwake(B)) ? A : ((B->isSleeping() && isAwake(A)) ? B : NULL);
+			if (sleeper) {
+				sleeper->wake();
+				sleeper->applyForce(glm::dvec3(0, gravity, 0));
+				woke = true;
+			}
+		}
+	}
+}
+
+/*
+ * Bodies below both velocity thresholds collect idle time. An island goes to sleep as a whole once all of
+ * its bodies have been idle for sleepTime, so a pile stays awake while one cube on it still moves. Returns
+ * the number of sleeping bodies.
+ */
+unsigned int PhysicsWorld::updateSleeping() {
+	for (size_t i = 0; i < bodies.size(); i++) {
+		if (!isAwake(&bodies[i]))
+			continue;
+		if (bodies[i].isResting(sleepLinearVelocity, sleepAngularVelocity))
+			bodies[i].idleTime += dt;
+		else
+			bodies[i].idleTime = 0;
+	}
+
+	for (unsigned int k = 0; k < graph.numIslands() && sleeping; k++) {
+		bool idle = true;
+		for (unsigned int j = graph.islandBodyOffset[k]; j < graph.islandBodyOffset[k + 1] && idle; j++)
+			idle = bodies[graph.islandBodies[j]].idleTime >= sleepTime;
+		for (unsigned int j = graph.islandBodyOffset[k]; j < graph.islandBodyOffset[k + 1] && idle; j++)
+			bodies[graph.islandBodies[j]].sleep();
+	}
+
+	unsigned int numSleeping = 0;
+	for (size_t i = 0; i < bodies.size(); i++)
+		numSleeping += bodies[i].isSleeping();
+	return numSleeping;
+}
+
+/* Write the solved impulses back to the manifold points the contacts were built from */
+template <typename T>
+void PhysicsWorld::storeImpulses(ContactRows<T> &rows) {
+	for (size_t index = 0; index < contactPoints.size(); index++) {
+		btManifoldPoint& pt = *contactPoints[index].point;
+		pt.m_appliedImpulse = rows.bufLambda[index].s1;
+		pt.m_appliedImpulseLateral1 = rows.bufLambda[index].s2;
+	}
+}
+
+/*
+ * Split impulse. The velocity pass has no penetration term, overlap is removed here by solving the normal
+ * rows again for pseudo velocities which move the bodies in integrate() and are then dropped, so pushing a
+ * cube out of the ground does not launch it. Islands share no dynamic body and are swept concurrently.
+ */
+template <typename T>
+void PhysicsWorld::correctPositions(ContactRows<T> &rows, unsigned int numContacts) {
+	for (size_t i = 0; i < bodies.size(); i++)
+		rows.pseudoVel[i].vLin = rows.pseudoVel[i].vAng = glm::tvec3<T>(0, 0, 0);
+	std::atomic<unsigned int> nextIsland(0);
+	pool->run([&](unsigned int threadId, unsigned int nThreads) {
+		for (unsigned int k = nextIsland++; k < graph.numIslands(); k = nextIsland++) {
+			for (unsigned int j = 0; j < positionIterations; j++) {
+				for (unsigned int i = graph.islandOffset[k]; i < graph.islandOffset[k + 1]; i++)
+					contacts[graph.islandContacts[i]].processPosition(rows, graph.islandContacts[i]);
+			}
+		}
+	});
+	for (size_t i = 0; i < bodies.size(); i++) {
+		bodies[i].pseudoV = glm::dvec3(rows.pseudoVel[i].vLin);
+		bodies[i].pseudoW = glm::dvec3(rows.pseudoVel[i].vAng);
+	}
+}
+
+/*
+ * Shock propagation after the velocity solve. Layers are swept from the ground up, every one shockIterations
+ * times with the layers below frozen, so a body resting on a pile sees it as ground and the weight of the
+ * pile does not have to travel down through many Jacobi iterations. Islands are swept concurrently.
+ */
+template <typename T>
+void PhysicsWorld::propagateShock(ContactRows<T> &rows, unsigned int numContacts) {
+	graph.buildLayers(rows.bodyIndex.data(), numContacts, bodies);
+
+	std::atomic<unsigned int> nextIsland(0);
+	pool->run([&](unsigned int threadId, unsigned int nThreads) {
+		for (unsigned int k = nextIsland++; k < graph.numIslands(); k = nextIsland++) {
+			unsigned int begin = graph.islandOffset[k], end = graph.islandOffset[k + 1];
+			while (begin < end && graph.contactLayer[graph.layerOrder[begin]] == 0)
+				begin++;
+			while (begin < end) {
+				unsigned int layer = graph.contactLayer[graph.layerOrder[begin]];
+				if (layer == LAYER_NONE)
+					break;
+				unsigned int layerEnd = begin;
+				while (layerEnd < end && graph.contactLayer[graph.layerOrder[layerEnd]] == layer)
+					layerEnd++;
+
+				for (unsigned int j = 0; j < shockIterations; j++) {
+					for (unsigned int i = begin; i < layerEnd; i++) {
+						unsigned int c = graph.layerOrder[i];
+						contacts[c].processShock(rows, c, graph.bodyLayer[rows.bodyIndex[c].indexA] < layer,
+							graph.bodyLayer[rows.bodyIndex[c].indexB] < layer);
+					}
+				}
+				begin = layerEnd;
+			}
+		}
+	});
+}
+
+/*
+ * Builds the contacts of one substep of length h and solves them into the body velocities. Substeps after
+ * the first reuse the manifold points of the collision pass, their depth is corrected by how far the
+ * bodies moved since, so the split impulse does not push them out once per substep.
+ */
+template <typename T>
+void PhysicsWorld::solveContacts(ContactRows<T> &rows, unsigned int substep, double h, ContactInfo &cInfo) {
+	/*
+	 * Contact counts scale down the normal rows for Jacobi, Gauss-Seidel converges without it. The block
+	 * solver is Gauss-Seidel within a manifold, only the manifolds of a body are averaged.
+	 */
+	bool jacobi = solver->averagesRows();
+	bool blockJacobi = solver->perManifold();
+	for (size_t i = 0; i < contactPoints.size() && jacobi; i++) {
+		if (blockJacobi && i > 0 && contactPoints[i].manifold == contactPoints[i - 1].manifold)
+			continue;
+		getBody(contactPoints[i].manifold->getBody0())->numContacts++;
+		getBody(contactPoints[i].manifold->getBody1())->numContacts++;
+	}
+
+	/*
+	 * Contacts of a resting pile come back at the same index every step. Their rows stay in the buffers
+	 * and on the device until the bodies move, only the rebuilt ranges are uploaded.
+	 */
+	size_t numKeys = rowKeys.size();
+	rowKeys.resize(contactPoints.size());
+	rowRanges.clear();
+
+	cInfo.numContacts = 0;
+	for (size_t i = 0; i < contactPoints.size(); i++) {
+		const btCollisionObject* obA = static_cast<const btCollisionObject*>(contactPoints[i].manifold->getBody0());
+		const btCollisionObject* obB = static_cast<const btCollisionObject*>(contactPoints[i].manifold->getBody1());
+		btManifoldPoint& pt = *contactPoints[i].point;
+		// if (pt.getDistance() < 0.0f) {
+			btVector3 contactPoint = (pt.getPositionWorldOnB());
+			double tangentAngle = persistentTangentAngle(pt);
+			double friction, restitution;
+			combineMaterial((RigidBody *)obA->getUserPointer(), (RigidBody *)obB->getUserPointer(), friction, restitution);
+
+			RigidBody *A = getBody(obA), *B = getBody(obB);
+			ContactRowKey key;
+			key.point = &pt;
+			key.indexA = A->index; key.indexB = B->index;
+			key.numContactsA = A->numContacts; key.numContactsB = B->numContacts;
+			key.tangentAngle = tangentAngle;
+			key.normal = glm::dvec3(-pt.m_normalWorldOnB.getX(), -pt.m_normalWorldOnB.getY(), -pt.m_normalWorldOnB.getZ());
+			key.rA = glm::dvec3(contactPoint.getX(), contactPoint.getY(), contactPoint.getZ()) - A->getPosition();
+			key.rB = glm::dvec3(contactPoint.getX(), contactPoint.getY(), contactPoint.getZ()) - B->getPosition();
+			key.rotA = A->getOrientation(); key.rotB = B->getOrientation();
+			bool buildRows = i >= numKeys || !rowsMatch(rowKeys[i], key);
+
+			// Bullet measured the depth before the first substep, the motion since then changes it along the normal
+			double distance = pt.getDistance();
+			if (substep > 0)
+				distance -= glm::dot(A->moved + glm::cross(A->turned, key.rA) - B->moved - glm::cross(B->turned, key.rB), key.normal);
+			if (buildRows) {
+				rowKeys[i] = key;
+				cInfo.numRebuilt++;
+				// Short runs of kept rows go up with their neighbours, saving a write per buffer
+				if (!rowRanges.empty() && i - rowRanges.back() <= OCL_UPLOAD_GAP)
+					rowRanges.back() = i + 1;
+				else {
+					rowRanges.push_back(i);
+					rowRanges.push_back(i + 1);
+				}
+			}
+
+			contacts[cInfo.numContacts] = Contact(rows, cInfo.numContacts, A, B,
+				glm::dvec3(contactPoint.getX(), contactPoint.getY(), contactPoint.getZ()),
+				key.normal, friction, restitution, h,
+				warmStart ? pt.m_appliedImpulse : 0, warmStart ? pt.m_appliedImpulseLateral1 : 0, tangentAngle,
+				positionBias(distance, h), buildRows);
+			cInfo.numContacts++;
+		//  }
+	}
+
+	for (size_t i = 0; i < bodies.size(); i++)
+		rows.deltaVel[i].vLin = rows.deltaVel[i].vAng = glm::tvec3<T>(0, 0, 0);
+	for (unsigned int i = 0; i < cInfo.numContacts && warmStart; i++)
+		contacts[i].warmStart(rows, i);
+
+	// The OpenCL solver takes all contacts at once, islands are only needed for sleeping and the position pass
+	if (substep == 0 && (solver->usesIslands() || sleeping || splitImpulse || shockIterations))
+		graph.buildIslands(rows.bodyIndex.data(), cInfo.numContacts, bodies);
+	if (cInfo.numContacts > 0) {
+		// Substeps reuse the contacts of the collision pass and with them the graphs
+		SolverContext<T> context = {rows, bodies, contacts, cInfo.numContacts, graph, *pool, substep == 0,
+			manifoldOffset, rowRanges, maxIterations, tolerance, acceleration};
+		if (solver->usesIslands())
+			cInfo.numIslands = graph.numIslands();
+		cInfo.iterations += solver->solve(context);
+	}
+	if (shockIterations && cInfo.numContacts)
+		propagateShock(rows, cInfo.numContacts);
+	storeImpulses(rows);
+	if (splitImpulse && cInfo.numContacts)
+		correctPositions(rows, cInfo.numContacts);
+
+	for (size_t i = 0; i < bodies.size() && cInfo.numContacts; i++) {
+		bodies[i].updateVelocity(glm::dvec3(rows.deltaVel[i].vLin), glm::dvec3(rows.deltaVel[i].vAng));
+		rows.deltaVel[i].vLin = rows.deltaVel[i].vAng = glm::tvec3<T>(0, 0, 0);
+	}
+}
+
+/* Grows the buffers of one precision, growing copies the rows kept so far */
+template <typename T>
+void PhysicsWorld::reserveRows(ContactRows<T> &rows, size_t numContacts) {
+	if (numContacts > rows.bodyIndex.size() || rows.bodyIndex.empty()) {
+		try {
+			size_t size = rows.bodyIndex.empty() ? 500 : rows.bodyIndex.size() * 2;
+			size = size > numContacts ? size : 2 * numContacts;
+			if (contacts.size() < size)
+				contacts.resize(size);
+			rows.resize(size);
+		} catch(std::bad_alloc &xa) {
+			std::cerr<<"Couldn't Reallocate Contact stack"<<std::endl;
+			exit(0);
+		}
+	}
+	if (bodies.size() > rows.deltaVel.size()) {
+		try {
+			rows.resizeBodies(bodies.size() * 2);
+			for (size_t i = 0; i < bodies.size(); i++)
+				rows.deltaVel[i].vLin = rows.deltaVel[i].vAng = glm::tvec3<T>(0, 0, 0);
+		} catch(std::bad_alloc &xa) {
+			std::cerr<<"Couldn't Reallocate Delta Velocity stack"<<std::endl;
+			exit(0);
+		}
+	}
+}
+
+/*
+ * Substeps solve the same contacts with a shorter time step, bodies collect their motion in between and
+ * are moved once by integrate(). Stacks get stiffer per unit of work than with more iterations.
+ */
+template <typename T>
+void PhysicsWorld::solveSubsteps(ContactRows<T> &rows, ContactInfo &cInfo) {
+	reserveRows(rows, cInfo.numContacts);
+	for (unsigned int substep = 0; substep < substeps; substep++) {
+		for (size_t i = 0; i < bodies.size() && substep > 0; i++)
+			if (!bodies[i].isSleeping())
+				bodies[i].advanceSubstep(dt / substeps);
+		solveContacts(rows, substep, dt / substeps, cInfo);
+	}
+}
+
+ContactInfo PhysicsWorld::solve() {
+	ContactInfo cInfo;
+
+	for (size_t i = 0; i < bodies.size(); i++)
+		if (!bodies[i].isSleeping())
+			bodies[i].applyForce(glm::dvec3(0, gravity, 0));
+
+	collisionWorld->performDiscreteCollisionDetection();
+	wakeTouching();
+
+	gatherContactPoints();
+	cInfo.numContacts = contactPoints.size();
+
+	cInfo.iterations = 0;
+	cInfo.numIslands = 0;
+	cInfo.numRebuilt = 0;
+	cInfo.pentrationError = 0;
+	for (size_t i = 0; i < contactPoints.size(); i++)
+		if (contactPoints[i].point->getDistance() < 0.0f)
+			cInfo.pentrationError += contactPoints[i].point->getDistance();
+
+	if (solverPrecision == PRECISION_DOUBLE)
+		solveSubsteps(doubleRows, cInfo);
+	else
+		solveSubsteps(floatRows, cInfo);
+	cInfo.numSleeping = updateSleeping();
+
+	cInfo.pentrationError /= (float) cInfo.numContacts * -1.0f;
+	return cInfo;
+}
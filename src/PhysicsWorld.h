@@ -0,0 +1,148 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+#ifndef __PhysicsWorld_h_
+#define __PhysicsWorld_h_
+
+#include "RigidBody.h"
+#include "Contact.h"
+#include "ContactGraph.h"
+#include "ThreadPool.h"
+#include "SimdJacobi.h"
+#include "ContactSolver.h"
+#include <vector>
+#include <btBulletDynamicsCommon.h>
+
+struct ContactInfo {
+	float pentrationError;
+	unsigned int numContacts;
+	unsigned int iterations; // Solver iterations run, the most of any island, summed over the substeps
+	unsigned int numIslands; // Islands solved independently, 0 when the solver takes all contacts at once
+	unsigned int numSleeping; // Bodies asleep after this step
+	unsigned int numRebuilt; // Contacts whose rows were built this step, the others kept the rows of the last one
+};
+
+/* Manifold point a contact is built from, after reduction */
+struct ManifoldPoint {
+	btPersistentManifold *manifold;
+	btManifoldPoint *point;
+};
+
+/* What the rows of a contact were built from, compared against PhysicsWorld::rowTolerance */
+struct ContactRowKey {
+	const btManifoldPoint *point;
+	unsigned long indexA, indexB;
+	unsigned int numContactsA, numContactsB;
+	double tangentAngle;
+	glm::dvec3 normal;
+	glm::dvec3 rA, rB; // Contact point relative to the centers of mass
+	glm::dquat rotA, rotB;
+};
+
+/*
+ * Collision detection, contact generation, constraint solve and integration for a set of rigid bodies.
+ * Nothing in here touches Ogre or the render thread, so the same pipeline is stepped by the interactive
+ * application (RigidBodySystem) and by the headless driver (PhysicsCli.cpp).
+ */
+class PhysicsWorld {
+	std::vector<RigidBody> bodies;
+	std::vector<Contact> contacts;
+	std::vector<ManifoldPoint> contactPoints; // Per contact
+	std::vector<unsigned int> manifoldOffset; // Manifold m has contacts manifoldOffset[m] to manifoldOffset[m + 1] - 1
+	ContactGraph graph;
+	ThreadPool *pool;
+	ContactSolver *solver;
+	std::vector<ContactRowKey> rowKeys; // Per contact, the rows at that index in the buffers were built from it
+	std::vector<unsigned int> rowRanges; // Begin and end pairs of the contacts whose rows were built this step
+	Precision solverPrecision; // Which of the row sets below the solvers run on
+	ContactRows<float> floatRows;
+	ContactRows<double> doubleRows;
+
+	void gatherContactPoints();
+	template <typename T> void reserveRows(ContactRows<T> &rows, size_t numContacts);
+	template <typename T> void storeImpulses(ContactRows<T> &rows);
+	template <typename T> void correctPositions(ContactRows<T> &rows, unsigned int numContacts);
+	template <typename T> void propagateShock(ContactRows<T> &rows, unsigned int numContacts);
+	template <typename T> void solveContacts(ContactRows<T> &rows, unsigned int substep, double h, ContactInfo &cInfo);
+	template <typename T> void solveSubsteps(ContactRows<T> &rows, ContactInfo &cInfo);
+	void wakeTouching();
+	unsigned int updateSleeping();
+
+	btBroadphaseInterface* broadphase;
+	btDefaultCollisionConfiguration* collisionConfiguration;
+	btCollisionDispatcher* dispatcher;
+	btCollisionWorld* collisionWorld;
+
+public:
+	PhysicsWorld() {
+		broadphase = 0;
+		collisionConfiguration = 0;
+		dispatcher = 0;
+		collisionWorld = 0;
+		pool = 0;
+		solver = 0;
+		solverPrecision = precision;
+	};
+	~PhysicsWorld() {
+		// Bodies remove themselves from the collision world
+		bodies.clear();
+		delete collisionWorld;
+		delete dispatcher;
+		delete collisionConfiguration;
+		delete broadphase;
+		delete pool;
+		delete solver;
+	};
+	static double dt;
+	static double bounce; // Restitution of bodies without a material
+	static double mu; // Friction of bodies without a material
+	static double gravity;
+	static unsigned int maxIterations; // Iteration cap of the solvers
+	static double tolerance; // Stop iterating once |delta lambda| / |lambda| falls below this
+	static unsigned int numThreads; // Solver threads, 0 uses all hardware threads
+	static bool warmStart; // Start each solve from the previous step's impulses
+	static JacobiAccel acceleration; // Step between the sweeps of the Jacobi solvers, GS ignores it
+	static bool sleeping; // Deactivate islands that stay at rest
+	static double sleepLinearVelocity; // Bodies slower than both thresholds are resting
+	static double sleepAngularVelocity;
+	static double sleepTime; // Resting time after which a whole island goes to sleep
+	static bool splitImpulse; // Push penetrating bodies apart with pseudo velocities that add no momentum
+	static double positionCorrection; // Fraction of the penetration removed per step
+	static double penetrationSlop; // Depth left uncorrected so resting contacts are not pushed out of range
+	static unsigned int positionIterations; // Sweeps of the position pass
+	static unsigned int maxManifoldPoints; // Contacts per manifold, 1 to MANIFOLD_CACHE_SIZE, well spread points are kept
+	static unsigned int shockIterations; // Sweeps per layer of the shock propagation pass, 0 turns it off
+	static unsigned int substeps; // Velocity solves per step on the contacts of one collision pass
+	static double rowTolerance; // Relative motion up to which a persistent contact keeps its rows, 0 builds them every step
+	static SolverBackend backend; // Solver init() starts with, OpenCL is only initialized once it is used
+	static Precision precision; // Precision new worlds solve in, setPrecision() changes it for one world
+
+	/* Creates the collision world and initializes the solver backend */
+	void init(size_t maxBodies);
+	/* Switches the velocity solver between steps, the next step builds and uploads all rows again */
+	void setSolver(SolverBackend backend);
+	inline const char *solverName() const { return solver->name(); }
+	/* Switches the solver buffers between float and double between steps, all rows are built again */
+	void setPrecision(Precision precision);
+	inline Precision getPrecision() const { return solverPrecision; }
+
+	inline btCollisionWorld* getCollisionWorld() { return collisionWorld; }
+	inline std::vector<RigidBody>& getBodies() { return bodies; }
+	inline size_t numBodies() const { return bodies.size(); }
+
+	/* Gravity, collision detection, contact and position solve and velocity update. Bodies are not moved. */
+	ContactInfo solve();
+	/* Advance all bodies by dt using the solved velocities */
+	void integrate();
+
+	inline ContactInfo step() {
+		ContactInfo cInfo = solve();
+		integrate();
+		return cInfo;
+	}
+};
+
+#endif
@@ -6,6 +6,7 @@
  */
 #include "RigidBody.h"
 
+#ifndef HEADLESS
 static void getMeshInformation(Ogre::Mesh* mesh,
                         size_t &vertex_count,
                         Ogre::Vector3* &vertices,
@@ -20,6 +21,43 @@ RigidBody::RigidBody(unsigned long int index, Ogre::Entity *entity, bool showEnt
 
 	getMeshInformation((entity->getMesh()).get(), vertex_count, vertices, index_count, indices, Ogre::Vector3(0, 0, 0), Ogre::Quaternion::IDENTITY, Ogre::Vector3(1,1,1));
 
+	glm::dvec3 *meshVertices = new glm::dvec3[vertex_count];
+	for (size_t i = 0; i < vertex_count; i++)
+		meshVertices[i] = glm::dvec3(vertices[i].x, vertices[i].y, vertices[i].z);
+	delete[] vertices;
+
+	glm::dvec3 cm = initBody(meshVertices, scale, linMassScale, angMassScale, initPos, cW, constrained);
+	delete[] meshVertices;
+
+	node = sceneMgr->getRootSceneNode()->createChildSceneNode();
+	Ogre::SceneNode *n = node->createChildSceneNode(Ogre::Vector3(-cm.x, -cm.y, -cm.z));
+	node->scale(scale.x, scale.y, scale.z);
+	if (showEntity) {
+		n->attachObject(entity);
+		n->showBoundingBox(showBBox);
+	}
+
+	this->index = index;
+}
+#endif
+
+RigidBody::RigidBody(unsigned long int index, const glm::dvec3 *meshVertices, size_t vertexCount,
+		const unsigned long *meshIndices, size_t indexCount, const glm::dvec3 &scale,
+		double linMassScale, double angMassScale, glm::dvec3 initPos, btCollisionWorld *cW, bool constrained) {
+	vertex_count = vertexCount;
+	index_count = indexCount;
+	indices = new unsigned long[index_count];
+	memcpy(indices, meshIndices, index_count * sizeof(unsigned long));
+
+	initBody(meshVertices, scale, linMassScale, angMassScale, initPos, cW, constrained);
+#ifndef HEADLESS
+	node = NULL;
+#endif
+	this->index = index;
+}
+
+glm::dvec3 RigidBody::initBody(const glm::dvec3 *meshVertices, const glm::dvec3 &scale, double linMassScale,
+		double angMassScale, const glm::dvec3 &initPos, btCollisionWorld *cW, bool constrained) {
 	glm::dvec3 cm(0.0, 0.0, 0.0);
 	double mass = 0;
 
@@ -28,15 +66,15 @@ RigidBody::RigidBody(unsigned long int index, Ogre::Entity *entity, bool showEnt
 		unsigned long t2 = indices[i + 1];
 		unsigned long t3 = indices[i + 2];
 
-		Ogre::Vector3 v1 = vertices[t1];
-		Ogre::Vector3 v2 = vertices[t2];
-		Ogre::Vector3 v3 = vertices[t3];
+		glm::dvec3 v1 = meshVertices[t1];
+		glm::dvec3 v2 = meshVertices[t2];
+		glm::dvec3 v3 = meshVertices[t3];
 
-		Ogre::Vector3 centroid((v1+v2+v3)/3.0);
-		double area = 0.5 * ((v1 - v2).crossProduct(v1 - v3)).length() * linMassScale;
+		glm::dvec3 centroid((v1+v2+v3)/3.0);
+		double area = 0.5 * glm::length(glm::cross(v1 - v2, v1 - v3)) * linMassScale;
 		area = area > 0 ? area: -area;
 		mass += area;
-		cm += glm::dvec3(area * centroid.x, area * centroid.y, area * centroid.z);
+		cm += area * centroid;
 	}
 
 	iMass = 1/mass;
@@ -48,7 +86,7 @@ RigidBody::RigidBody(unsigned long int index, Ogre::Entity *entity, bool showEnt
 	this->vertices = new glm::dvec3[vertex_count];
 
 	for (size_t i = 0; i < vertex_count; i++) {
-		this->vertices[i] = glm::dvec3(vertices[i].x - cm.x, vertices[i].y - cm.y, vertices[i].z - cm.z) * scale;
+		this->vertices[i] = (meshVertices[i] - cm) * scale;
 	}
 
 	double Ixx = 0;
@@ -90,22 +128,20 @@ RigidBody::RigidBody(unsigned long int index, Ogre::Entity *entity, bool showEnt
 	f = glm::dvec3(0,0,0);
 	t = glm::dvec3(0,0,0);
 
-	deltaV = glm::dvec3(0,0,0);
-	deltaW = glm::dvec3(0,0,0);
+	pseudoV = glm::dvec3(0,0,0);
+	pseudoW = glm::dvec3(0,0,0);
+	moved = glm::dvec3(0,0,0);
+	turned = glm::dvec3(0,0,0);
 	numContacts = 0;
 
-	delete[] vertices;
+	this->constrained = constrained;
 
-	node = sceneMgr->getRootSceneNode()->createChildSceneNode();
-	Ogre::SceneNode *n = node->createChildSceneNode(Ogre::Vector3(-cm.x, -cm.y, -cm.z));
-	node->scale(scale.x, scale.y, scale.z);
-	if (showEntity) {
-		n->attachObject(entity);
-		n->showBoundingBox(showBBox);
-	}
+	// Negative picks the world default when contacts are generated
+	friction = -1;
+	restitution = -1;
 
-	this->constrained = constrained;
-	this->index = index;
+	sleeping = false;
+	idleTime = 0;
 
 	std::cout<<"Vertices in mesh:"<< vertex_count<<std::endl;
 	std::cout<<"Triangles in mesh:"<< index_count / 3<<std::endl;
@@ -133,6 +169,18 @@ RigidBody::RigidBody(unsigned long int index, Ogre::Entity *entity, bool showEnt
 	collisionWorld = cW;
 
 	updateTransform();
+
+	/*
+	 * Bullet only collides a pair when one of the objects is active, so the ground is marked static and
+	 * inactive the way btDiscreteDynamicsWorld does it. Its AABB is never updated again, set it here.
+	 */
+	if (constrained) {
+		collisionObject->setCollisionFlags(collisionObject->getCollisionFlags() | btCollisionObject::CF_STATIC_OBJECT);
+		collisionObject->setActivationState(ISLAND_SLEEPING);
+		cW->updateSingleAabb(collisionObject);
+	}
+
+	return cm;
 }
 
 void RigidBody::updateTransform() {
@@ -152,19 +200,62 @@ void RigidBody::advanceTime(double dt) {
 	v += f * iMass * dt;
 	w += dt * iiT * t;
 
-	p += dt * v;
-	b2w_rot += dt * glm::dquat(0.5 * glm::dot(glm::dvec3(-b2w_rot.x, -b2w_rot.y, -b2w_rot.z) , w),
-				0.5 * glm::dot(glm::dvec3(b2w_rot.w, b2w_rot.z, -b2w_rot.y) , w),
-				0.5 * glm::dot(glm::dvec3(-b2w_rot.z, b2w_rot.w, b2w_rot.x) , w),
-				0.5 * glm::dot(glm::dvec3(b2w_rot.y, -b2w_rot.x, b2w_rot.w) , w));
+	// Pseudo velocities only move the body, they never become momentum
+	glm::dvec3 moveV = v + pseudoV;
+	glm::dvec3 moveW = w + pseudoW;
+	pseudoV = pseudoW = glm::dvec3(0,0,0);
+
+	move(dt * moveV, dt * moveW);
+
+	f = glm::dvec3(0,0,0);
+	t = glm::dvec3(0,0,0);
+}
+
+void RigidBody::move(const glm::dvec3 &distance, const glm::dvec3 &angle) {
+	p += distance;
+	b2w_rot += glm::dquat(0.5 * glm::dot(glm::dvec3(-b2w_rot.x, -b2w_rot.y, -b2w_rot.z) , angle),
+				0.5 * glm::dot(glm::dvec3(b2w_rot.w, b2w_rot.z, -b2w_rot.y) , angle),
+				0.5 * glm::dot(glm::dvec3(-b2w_rot.z, b2w_rot.w, b2w_rot.x) , angle),
+				0.5 * glm::dot(glm::dvec3(b2w_rot.y, -b2w_rot.x, b2w_rot.w) , angle));
 
 	glm::normalize(b2w_rot);
 	updateTransform();
+}
+
+void RigidBody::advanceSubstep(double dt) {
+	v += f * iMass * dt;
+	w += dt * iiT * t;
+
+	moved += dt * (v + pseudoV);
+	turned += dt * (w + pseudoW);
+	pseudoV = pseudoW = glm::dvec3(0,0,0);
+}
+
+void RigidBody::applySubsteps() {
+	move(moved, turned);
 
+	moved = turned = glm::dvec3(0,0,0);
 	f = glm::dvec3(0,0,0);
 	t = glm::dvec3(0,0,0);
 }
 
+void RigidBody::sleep() {
+	v = w = glm::dvec3(0,0,0);
+	f = t = glm::dvec3(0,0,0);
+	pseudoV = pseudoW = glm::dvec3(0,0,0);
+	moved = turned = glm::dvec3(0,0,0);
+	sleeping = true;
+	collisionObject->setActivationState(ISLAND_SLEEPING);
+}
+
+void RigidBody::wake() {
+	idleTime = 0;
+	if (!sleeping)
+		return;
+	sleeping = false;
+	collisionObject->setActivationState(ACTIVE_TAG);
+}
+
 void RigidBody::applyForce(glm::dvec3 contactPoint, glm::dvec3 force) {
 	glm::dvec3 r = contactPoint - p;
 	t = glm::cross(r, force);
@@ -185,6 +276,7 @@ glm::dvec3 RigidBody::getContactVelocity(glm::dvec3 contactPoint) {
 	return v + glm::cross(w, r);
 }
 
+#ifndef HEADLESS
 static void getMeshInformation(Ogre::Mesh* mesh,
                         size_t &vertex_count,
                         Ogre::Vector3* &vertices,
@@ -301,3 +393,4 @@ static void getMeshInformation(Ogre::Mesh* mesh,
         current_offset = next_offset;
     }
 }
+#endif
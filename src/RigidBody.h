@@ -15,7 +15,12 @@
 #include <gtc/quaternion.hpp>
 #include <gtx/quaternion.hpp>
 #include <gtc/matrix_access.hpp>
+#ifndef HEADLESS
 #include "BaseApplication.h"
+#else
+#include <iostream>
+#include <cstring>
+#endif
 #include <btBulletDynamicsCommon.h>
 #include "BulletCollision/CollisionShapes/btShapeHull.h"
 
@@ -61,7 +66,16 @@ class RigidBody {
 	/* Body is constrained */
 	bool constrained;
 
+	/* Surface material, negative values use PhysicsWorld::mu and PhysicsWorld::bounce */
+	double friction;
+	double restitution;
+
+	/* Sleeping bodies are not integrated and Bullet skips their collision unless an active body is near */
+	bool sleeping;
+
+#ifndef HEADLESS
 	Ogre::SceneNode *node;
+#endif
 
 	/* Bullet Collision Object */
 	btCollisionObject* collisionObject;
@@ -72,18 +86,52 @@ class RigidBody {
 
 	/* Must be called after initializing collisionObject */
 	void updateTransform();
+	/* Translate by distance and rotate by the rotation vector angle, first order like the integration */
+	void move(const glm::dvec3 &distance, const glm::dvec3 &angle);
+
+	/*
+	 * Mass properties and collision shape from a triangle mesh, shared by all constructors.
+	 * Expects vertex_count, index_count and indices to be set. Returns center of mass of the
+	 * unscaled mesh.
+	 */
+	glm::dvec3 initBody(const glm::dvec3 *meshVertices, const glm::dvec3 &scale, double linMassScale,
+			double angMassScale, const glm::dvec3 &initPos, btCollisionWorld *cW, bool constrained);
 
 public:
 	unsigned long int index;
-	/* For contact processing */
-	glm::dvec3 deltaV; // delta linear velocity
-	glm::dvec3 deltaW; // delta angular velocity
+	/* Split impulse, moves the body apart from what it penetrates on the next advanceTime and is then dropped */
+	glm::dvec3 pseudoV;
+	glm::dvec3 pseudoW;
+	/* Substepping, motion collected since the collision pass, applied at once by applySubsteps */
+	glm::dvec3 moved;
+	glm::dvec3 turned;
 	unsigned int numContacts;
+	double idleTime; // Time spent below the sleep thresholds, kept by PhysicsWorld
 
 	void advanceTime(double dt);
+	/*
+	 * One substep of dt without moving the body: the force is applied to the velocity and the motion is
+	 * added to moved and turned. The force is kept for the next substep, applySubsteps clears it.
+	 */
+	void advanceSubstep(double dt);
+	void applySubsteps();
 	void applyForce(glm::dvec3 contact, glm::dvec3 force);
 	inline void applyForce(const glm::dvec3 &acc) {f += constrained ? glm::dvec3(0,0,0) : acc / iMass;}
 
+	inline bool isConstrained() const { return constrained; }
+	inline bool isSleeping() const { return sleeping; }
+	inline bool isResting(double linear, double angular) const {
+		return glm::dot(v, v) < linear * linear && glm::dot(w, w) < angular * angular; }
+	/* Stops the body and deactivates its collision object */
+	void sleep();
+	void wake();
+
+	inline void setMaterial(double friction, double restitution) { this->friction = friction; this->restitution = restitution; }
+	inline double getFriction() const { return friction; }
+	inline double getRestitution() const { return restitution; }
+
+	inline const glm::dvec3 &getPosition() const { return p; }
+	inline const glm::dquat &getOrientation() const { return b2w_rot; }
 	inline glm::dvec3 getRcrossN(const glm::dvec3 &contact, const glm::dvec3 &normal) const { return glm::cross(contact - p, normal);}
 	//Scale a vector by inverse mass
 	inline glm::dvec3 getScaledByMinv(const glm::dvec3 &vec) const {return vec * iMass;}
@@ -93,8 +141,6 @@ public:
 	inline glm::dvec3 getAngularImpulse(double dt) const {return w + (constrained ? glm::dvec3(0,0,0) : iiT * ((t - glm::cross(w, iT * w)) * dt));}
 	inline double getDotWithV(const glm::dvec3 &vec) const { return glm::dot(v, vec);}
 	inline double getDotWithW(const glm::dvec3 &vec) const { return glm::dot(w, vec);}
-	inline void updateVelocity() { //std::cout<<deltaV.x<<" "<<deltaV.y<<" "<<deltaV.z<<" "<<deltaW.x<<" "<<deltaW.y<<" "<<deltaW.z<<std::endl;
-		v += deltaV; w += deltaW; deltaV = glm::dvec3(0,0,0); deltaW = glm::dvec3(0,0,0); numContacts = 0;}
 	inline void updateVelocity(const glm::dvec3 &deltaLin, const glm::dvec3 &deltaAng) {
 			v += deltaLin; w += deltaAng; numContacts = 0;}
 
@@ -102,9 +148,15 @@ public:
 	glm::dvec4 getBodyToWorld(glm::dvec4 body);
 	glm::dvec3 getContactVelocity(glm::dvec3 contactPoint);
 
+#ifndef HEADLESS
 	RigidBody(unsigned long int index, Ogre::Entity *entity, bool showEntity, bool showBBox,
 			Ogre::SceneManager *sceneMgr, const glm::dvec3 &scale, double linMassScale,
 			double angMassScale, glm::dvec3 initPos, btCollisionWorld *cW, bool constrained);
+#endif
+	/* Build from a raw triangle mesh, no scene node is attached. */
+	RigidBody(unsigned long int index, const glm::dvec3 *meshVertices, size_t vertexCount,
+			const unsigned long *meshIndices, size_t indexCount, const glm::dvec3 &scale,
+			double linMassScale, double angMassScale, glm::dvec3 initPos, btCollisionWorld *cW, bool constrained);
 
 	RigidBody(const RigidBody &obj) {
 		memcpy(this, &obj, sizeof(obj));
@@ -121,16 +173,20 @@ public:
 				new btConvexHullShape((const btScalar*)obj.simplifiedConvexShape->getUnscaledPoints(),
 				obj.simplifiedConvexShape->getNumPoints());
 		collisionObject->setCollisionShape(simplifiedConvexShape);
+		collisionObject->setCollisionFlags(obj.collisionObject->getCollisionFlags());
+		collisionObject->forceActivationState(obj.collisionObject->getActivationState());
 		collisionObject->getWorldTransform().setOrigin(btVector3(p.x, p.y, p.z));
 		collisionObject->getWorldTransform().setRotation(btQuaternion(b2w_rot.x, b2w_rot.y, b2w_rot.z, b2w_rot.w));
 
 		collisionWorld->addCollisionObject(collisionObject);
 		std::cout<<"Creating Copy of Rigid Body"<<std::endl;
 	}
+#ifndef HEADLESS
 	void setOgrePosition() {
 		node->setPosition(p.x, p.y, p.z);
 		node->setOrientation(b2w_rot.w, b2w_rot.x,b2w_rot.y, b2w_rot.z);
 	}
+#endif
 	~RigidBody() {
 		delete []vertices;
 		delete []indices;
@@ -10,9 +10,10 @@
 #include <cstdlib>
 #include <ctime>
 #include <iomanip>
-#include "OclCompute.h"
 
 void RigidBodySystem::addNinja() {
+	btCollisionWorld *collisionWorld = world.getCollisionWorld();
+	std::vector<RigidBody> &bodies = world.getBodies();
 	if (!collisionWorld) {
 		std::cout<<"Cannot add Ninja...Init physics first."<<std::endl;
 		return;
@@ -29,6 +30,8 @@ void RigidBodySystem::addNinja() {
 }
 
 void RigidBodySystem::addCube() {
+	btCollisionWorld *collisionWorld = world.getCollisionWorld();
+	std::vector<RigidBody> &bodies = world.getBodies();
 	if (!collisionWorld) {
 		std::cout<<"Cannot add Cube...Init physics first."<<std::endl;
 		return;
@@ -55,6 +58,8 @@ void RigidBodySystem::addCube() {
 }
 
 void RigidBodySystem::addGround() {
+	btCollisionWorld *collisionWorld = world.getCollisionWorld();
+	std::vector<RigidBody> &bodies = world.getBodies();
 	if (!collisionWorld) {
 		std::cout<<"Cannot add Ground...Init physics first."<<std::endl;
 		return;
@@ -86,15 +91,6 @@ void RigidBodySystem::addGround() {
 	pickBody[phyEntity] = bodies.size() - 1;
 }
 
-void RigidBodySystem::physicsInit(){
-	broadphase = new btDbvtBroadphase();
-	collisionConfiguration = new btDefaultCollisionConfiguration();
-	dispatcher = new btCollisionDispatcher(collisionConfiguration);
-	collisionWorld = new btCollisionWorld(dispatcher, broadphase, collisionConfiguration);
-
-	contacts.reserve(500);
-}
-
 void RigidBodySystem::addLight(void) {
 	mSceneMgr->setAmbientLight(Ogre::ColourValue(0.2, 0.2, 0.2));
 	Ogre::Light* directionalLight = mSceneMgr->createLight("DirectionalLight");
@@ -144,7 +140,7 @@ void RigidBodySystem::physicsProcess() {
 		physicsSystemLocked = true;
 		cv_physics_2.notify_one();
 		contactInfo = physicsRun();
-		nBody = bodies.size();
+		nBody = world.numBodies();
 		physicsSystemLocked = false;
 		total_lock.unlock();
 		cv_physics_2.notify_one();
@@ -162,11 +158,7 @@ void RigidBodySystem::physicsProcess() {
 void RigidBodySystem::physicsStart() {
 	std::lock_guard<std::mutex> lk(m_physics);
 
-	// Initialize Opencl
-	OclCompute::init(ITER_COUNT, mu);
-
-	physicsInit();
-	bodies.reserve(200);
+	world.init(200);
 	pausePhysics = true;
 }
 
@@ -241,305 +233,40 @@ void RigidBodySystem::screenCaptureDataGenerate() {
 	cv.notify_one();
 }
 
-#ifndef OCL_SOLVE
-ContactInfo RigidBodySystem::physicsRun() {
-	ContactInfo cInfo;
-
-	if (mouseButtonDown) {
-			unsigned long i = pickBody[selectedEntity];
-
-			glm::dvec4 startWorld = bodies[i].getBodyToWorld(glm::dvec4(startPoint.x, startPoint.y, startPoint.z, 1));
-			lineObject->beginUpdate(0);
-			lineObject->position(startWorld.x, startWorld.y, startWorld.z);
-			lineObject->position(endPoint);
-			lineObject->end();
-
-			bodies[i].applyForce(glm::dvec3(startWorld),
-					getSpringForce(glm::dvec3(startWorld), glm::dvec3(endPoint.x, endPoint.y, endPoint.z),
-					bodies[i].getContactVelocity(glm::dvec3(startWorld))));
-	}
-
-	for (size_t i = 0; i < bodies.size(); i++)
-			bodies[i].applyForce(glm::dvec3(0, gravity, 0));
-
-		collisionWorld->performDiscreteCollisionDetection();
-
-		int numManifolds = collisionWorld->getDispatcher()->getNumManifolds();
-
-		cInfo.numContacts = 0;
-		for (int i = 0; i < numManifolds; i++)
-			cInfo.numContacts += collisionWorld->getDispatcher()->getManifoldByIndexInternal(i)->getNumContacts();
-
-		if (cInfo.numContacts > contacts.capacity()) {
-			try {
-				contacts.reserve(cInfo.numContacts * 2);
-			} catch(std::bad_alloc &xa) {
-				std::cerr<<"Couldn't Reallocate Contact stack"<<std::endl;
-				exit(0);
-			}
-		}
-
-	#ifndef PGS
-		for (int i = 0; i < numManifolds; i++) {
-			btPersistentManifold* contactManifold = collisionWorld->getDispatcher()->getManifoldByIndexInternal(i);
-			const btCollisionObject* obA = static_cast<const btCollisionObject*>(contactManifold->getBody0());
-			const btCollisionObject* obB = static_cast<const btCollisionObject*>(contactManifold->getBody1());
-			((RigidBody*)obA->getUserPointer())->numContacts += contactManifold->getNumContacts();
-			((RigidBody*)obB->getUserPointer())->numContacts += contactManifold->getNumContacts();
-		}
-	#endif
-
-		cInfo.pentrationError = 0;
-		cInfo.numContacts = 0;
-		for (int i = 0; i < numManifolds; i++) {
-			btPersistentManifold* contactManifold = collisionWorld->getDispatcher()->getManifoldByIndexInternal(i);
-			const btCollisionObject* obA = static_cast<const btCollisionObject*>(contactManifold->getBody0());
-			const btCollisionObject* obB = static_cast<const btCollisionObject*>(contactManifold->getBody1());
-			contactManifold->refreshContactPoints(obA->getWorldTransform(), obB->getWorldTransform());
-			unsigned int _numContacts = contactManifold->getNumContacts();
-			//For each contact point in that manifold
-		    for (unsigned int j = 0; j < _numContacts; j++) {
-		      //Get the contact information
-		        btManifoldPoint& pt = contactManifold->getContactPoint(j);
-		        //if (pt.getDistance() < 0.0f) {
-		        	btVector3 contactPoint = (pt.getPositionWorldOnB());
-		        	contacts[cInfo.numContacts] = Contact((RigidBody *)obA->getUserPointer(), (RigidBody *)obB->getUserPointer(),
-		        		glm::dvec3(contactPoint.getX(), contactPoint.getY(), contactPoint.getZ()),
-						glm::dvec3(-pt.m_normalWorldOnB.getX(), -pt.m_normalWorldOnB.getY(), -pt.m_normalWorldOnB.getZ()), bounce, dt);
-		        	cInfo.numContacts++;
-		        	if (pt.getDistance() < 0.0f)
-		        		cInfo.pentrationError += pt.getDistance();
-		       // }
-		    }
-		}
-
-	#ifdef PGS
-		unsigned int contactPow2 = cInfo.numContacts; // Round numContacts to next power of two.
-		contactPow2--;
-		contactPow2 |= contactPow2 >> 1;
-		contactPow2 |= contactPow2 >> 2;
-		contactPow2 |= contactPow2 >> 4;
-		contactPow2 |= contactPow2 >> 8;
-		contactPow2 |= contactPow2 >> 16;
-
-		srand(std::time(NULL));
-		for (int j = 0; j < ITER_COUNT && cInfo.numContacts; j++) {
-
-			for (unsigned int i = 0; i < cInfo.numContacts; i++)
-				contacts[i].processed = false;
-
-			for (unsigned int i = 0; i < (cInfo.numContacts>>1); i++) {
-				unsigned int randNum = std::rand() & contactPow2;
-				if (randNum >= cInfo.numContacts) randNum >>= 2;
-				if (!contacts[randNum].processed)
-					contacts[randNum].processContact(mu);
-			}
-
-			for (unsigned int i = 0; i < cInfo.numContacts; i++) {
-				if (!contacts[i].processed)
-					contacts[i].processContact(mu);
-			}
-		}
-	#endif
-
-	#ifndef PGS
-		for (int j = 0; j < 500 && cInfo.numContacts; j++) {
-			for (unsigned int i = 0; i < cInfo.numContacts; i++) {
-				//std::cout<<i<<" ContactNo: ";
-				contacts[i].processContact1(mu);
-			}
-
-			for (unsigned int i = 0; i < cInfo.numContacts; i++)
-				contacts[i].processContact2();
-		}
-	#endif
-
-		for (size_t i = 0; i < bodies.size() && cInfo.numContacts; i++)
-				bodies[i].updateVelocity();
-
-		{
-			std::lock_guard<std::mutex> lk(m_physics);
-			pauseAnim = true;
-			cv_physics.notify_one();
-			for (size_t i = 0; i < bodies.size(); i++)
-				bodies[i].advanceTime(dt);
-			pauseAnim = false;
-			cv_physics.notify_one();
-		}
-
-		cInfo.pentrationError /= (float) cInfo.numContacts * -1.0f;
-
-		return cInfo;
-}
-#else
 ContactInfo RigidBodySystem::physicsRun() {
-	ContactInfo cInfo;
+	std::vector<RigidBody> &bodies = world.getBodies();
 
 	if (mouseButtonDown) {
 			unsigned long i = pickBody[selectedEntity];
 
 			glm::dvec4 startWorld = bodies[i].getBodyToWorld(glm::dvec4(startPoint.x, startPoint.y, startPoint.z, 1));
-			//lineObject->beginUpdate(0);
-			//lineObject->position(startWorld.x, startWorld.y, startWorld.z);
-			//lineObject->position(endPoint);
-			//lineObject->end();
 
+			// Held bodies never sleep, the bodies they touch wake in world.solve()
+			bodies[i].wake();
 			bodies[i].applyForce(glm::dvec3(startWorld),
 					getSpringForce(glm::dvec3(startWorld), glm::dvec3(endPoint.x, endPoint.y, endPoint.z),
 					bodies[i].getContactVelocity(glm::dvec3(startWorld))));
 	}
 
-	for (size_t i = 0; i < bodies.size(); i++)
-			bodies[i].applyForce(glm::dvec3(0, gravity, 0));
-
-	collisionWorld->performDiscreteCollisionDetection();
-
-	int numManifolds = collisionWorld->getDispatcher()->getNumManifolds();
-
-	cInfo.numContacts = 0;
-	for (int i = 0; i < numManifolds; i++)
-		cInfo.numContacts += collisionWorld->getDispatcher()->getManifoldByIndexInternal(i)->getNumContacts();
-
-	if (cInfo.numContacts > contacts.capacity() || bodyIndex.capacity() == 0) {
-		try {
-			size_t reserve = bodyIndex.capacity() == 0 ? 500 : contacts.capacity() * 2;
-			reserve = reserve > cInfo.numContacts ? reserve : 2 * cInfo.numContacts;
-			contacts.reserve(reserve);
-			bodyIndex.reserve(reserve);
-			bufConstNormalD_A.reserve(reserve);
-			bufConstNormalM_A.reserve(reserve);
-			bufConstTangentD_A.reserve(reserve);
-			bufConstTangentM_A.reserve(reserve);
-			bufConstNormalD_B.reserve(reserve);
-			bufConstNormalM_B.reserve(reserve);
-			bufConstTangentD_B.reserve(reserve);
-			bufConstTangentM_B.reserve(reserve);
-			bufB.reserve(reserve);
-			bufLambda.reserve(reserve);
-			bufDeltaLambda.reserve(reserve);
-		} catch(std::bad_alloc &xa) {
-			std::cerr<<"Couldn't Reallocate Contact stack"<<std::endl;
-			exit(0);
-		}
-	}
-	if (bodies.size() > deltaVel.capacity()) {
-		try {
-			deltaVel.reserve(bodies.size() * 2);
-			for (size_t i = 0; i < bodies.size(); i++)
-				deltaVel[i].vLin = deltaVel[i].vAng = vec3(0, 0, 0);
-		} catch(std::bad_alloc &xa) {
-			std::cerr<<"Couldn't Reallocate Delta Velocity stack"<<std::endl;
-			exit(0);
-		}
-	}
-
-	for (int i = 0; i < numManifolds; i++) {
-		btPersistentManifold* contactManifold = collisionWorld->getDispatcher()->getManifoldByIndexInternal(i);
-		const btCollisionObject* obA = static_cast<const btCollisionObject*>(contactManifold->getBody0());
-		const btCollisionObject* obB = static_cast<const btCollisionObject*>(contactManifold->getBody1());
-		((RigidBody*)obA->getUserPointer())->numContacts += contactManifold->getNumContacts();
-		((RigidBody*)obB->getUserPointer())->numContacts += contactManifold->getNumContacts();
-	}
-
-	cInfo.numContacts = 0;
-	cInfo.pentrationError = 0;
-	for (int i = 0; i < numManifolds; i++) {
-		btPersistentManifold* contactManifold = collisionWorld->getDispatcher()->getManifoldByIndexInternal(i);
-		const btCollisionObject* obA = static_cast<const btCollisionObject*>(contactManifold->getBody0());
-		const btCollisionObject* obB = static_cast<const btCollisionObject*>(contactManifold->getBody1());
-		contactManifold->refreshContactPoints(obA->getWorldTransform(), obB->getWorldTransform());
-		unsigned int _numContacts = contactManifold->getNumContacts();
-		//For each contact point in that manifold
-		for (unsigned int j = 0; j < _numContacts; j++) {
-		    //Get the contact information
-			btManifoldPoint& pt = contactManifold->getContactPoint(j);
-		   // if (pt.getDistance() < 0.0f) {
-		    	btVector3 contactPoint = (pt.getPositionWorldOnB());
-		    	contacts[cInfo.numContacts] = Contact(cInfo.numContacts, (RigidBody *)obA->getUserPointer(), (RigidBody *)obB->getUserPointer(),
-		    		glm::dvec3(contactPoint.getX(), contactPoint.getY(), contactPoint.getZ()),
-					glm::dvec3(-pt.m_normalWorldOnB.getX(), -pt.m_normalWorldOnB.getY(), -pt.m_normalWorldOnB.getZ()), bounce, dt);
-		        cInfo.numContacts++;
-		        if (pt.getDistance() < 0.0f)
-		        	cInfo.pentrationError += pt.getDistance();
-		  //  }
-		}
-	}
-
-	if (cInfo.numContacts > 0) {
-		OclCompute::_0_run(bodies.size(), cInfo.numContacts,
-			deltaVel, bodyIndex,
-			bufConstNormalD_A, bufConstNormalM_A,
-			bufConstTangentD_A, bufConstTangentM_A,
-			bufConstNormalD_B, bufConstNormalM_B,
-			bufConstTangentD_B, bufConstTangentM_B,
-			bufB, bufLambda);
-/*
-		unsigned int contactPow2 = cInfo.numContacts; // Round numContacts to next power of two.
-				contactPow2--;
-				contactPow2 |= contactPow2 >> 1;
-				contactPow2 |= contactPow2 >> 2;
-				contactPow2 |= contactPow2 >> 4;
-				contactPow2 |= contactPow2 >> 8;
-				contactPow2 |= contactPow2 >> 16;
-
-				srand(std::time(NULL));
-				for (int j = 0; j < 10 && cInfo.numContacts; j++) {
-
-					for (unsigned int i = 0; i < cInfo.numContacts; i++)
-						contacts[i].processed = false;
-
-					for (unsigned int i = 0; i < (cInfo.numContacts>>1); i++) {
-						unsigned int randNum = std::rand() & contactPow2;
-						if (randNum >= cInfo.numContacts) randNum >>= 2;
-						if (!contacts[randNum].processed)
-							contacts[randNum].processContactA(i, mu);
-					}
-
-					for (unsigned int i = 0; i < cInfo.numContacts; i++) {
-						if (!contacts[i].processed)
-							contacts[i].processContactA(i, mu);
-					}
-				}*/
-	}
-	/*
-	for (int j = 0; j < 500 && numContacts; j++) {
-		for (unsigned int i = 0; i < numContacts; i++) {
-			//std::cout<<i<<" ContactNo: ";
-			contacts[i].processContact1(i, mu);
-		}
-		for (unsigned int i = 0; i < numContacts; i++)
-			contacts[i].processContact2(i);
-	}*/
-
-
-	for (size_t i = 0; i < bodies.size() && cInfo.numContacts; i++) {
-		bodies[i].updateVelocity(deltaVel[i].vLin, deltaVel[i].vAng);
-		deltaVel[i].vLin = deltaVel[i].vAng = vec3(0, 0, 0);
-	}
+	ContactInfo cInfo = world.solve();
 
 	{
 		std::lock_guard<std::mutex> lk(m_physics);
 		pauseAnim = true;
 		cv_physics.notify_one();
-		for (size_t i = 0; i < bodies.size(); i++)
-			bodies[i].advanceTime(dt);
+		world.integrate();
 		pauseAnim = false;
 		cv_physics.notify_one();
 	}
 
-	cInfo.pentrationError /= (float) cInfo.numContacts * -1.0f;
 	return cInfo;
 }
-#endif
 
 std::string preInfo = "Sayantan Datta, COMP 559(McGill)";
-std::string infoJacobi = "\nSolver: Projected Jacobi, Iterations: " +
-		std::to_string(ITER_COUNT) + "\nHardware: OpenCL GPU: AMD 7970";
-std::string infoPGS =  "\nSolver: Projected Gauss-Siedel, Iterations: " +
-		std::to_string(ITER_COUNT) + "\nHardware: 1 Core x86 CPU: Intel i5 2500";
-std::string postInfo = "\nTime Step: " + std::to_string(RigidBodySystem::dt) +
-		"\nFriction Coefficient: " + std::to_string(RigidBodySystem::mu) +
-		"\nRestitution: " + std::to_string(RigidBodySystem::bounce);
+std::string infoIterations = ", Iterations: " + std::to_string(ITER_COUNT);
+std::string postInfo = "\nTime Step: " + std::to_string(PhysicsWorld::dt) +
+		"\nFriction Coefficient: " + std::to_string(PhysicsWorld::mu) +
+		"\nRestitution: " + std::to_string(PhysicsWorld::bounce);
 void RigidBodySystem::animate() {
 	if (captureFrames && (timer.getMilliseconds() - time) > 33) {
 		time = timer.getMilliseconds();
@@ -551,17 +278,14 @@ void RigidBodySystem::animate() {
 	info += "\nContacts: " + std::to_string(contactInfo.numContacts);
 	info += "\nBodies: " + std::to_string(nBody);
 	info += "\nRender FPS: " + std::to_string((unsigned int)mWindow->getAverageFPS());
-#ifdef OCL_SOLVE
-	info += infoJacobi;
-#else
-	info += infoPGS;
-#endif
+	info += "\nSolver: " + std::string(world.solverName()) + infoIterations;
 	info += postInfo;
 	if (captureFrames)
 		info += "\nRecording @30FPS";
 	textItem->setText(info);    // Text to be displayed
 
 
+	std::vector<RigidBody> &bodies = world.getBodies();
 	std::unique_lock<std::mutex> lk(m_physics);
 	cv_physics.wait(lk,  [this](){return !pauseAnim;});
 	for (size_t i = 0; i < bodies.size(); i++)
@@ -636,7 +360,7 @@ void RigidBodySystem::mousePressedRigidBody(OIS::MouseButtonID id) {
 				startPoint = ray.getPoint(distance);
 				endPoint = startPoint;
 				mouseButtonDown = true;
-				glm::dvec4 body = bodies[pickBody[selectedEntity]].getWorldToBody(glm::dvec4(startPoint.x, startPoint.y, startPoint.z, 1));
+				glm::dvec4 body = world.getBodies()[pickBody[selectedEntity]].getWorldToBody(glm::dvec4(startPoint.x, startPoint.y, startPoint.z, 1));
 				startPoint = Ogre::Vector3(body.x, body.y, body.z);
 				std::cout<<"Object Picked:"<<it->movable->getName()<<" "<<pickBody[selectedEntity]<<std::endl;
 				break;
@@ -677,6 +401,20 @@ void RigidBodySystem::keyPressedRigidBody(const OIS::KeyEvent &arg) {
 	 	addNinja();
 	 	lk.unlock();
 	 }
+	 else if (arg.key == OIS::KC_B) {
+	 	// Between steps, the next one rebuilds all rows for the new solver
+	 	std::unique_lock<std::mutex> lk(m_physics_2);
+	 	cv_physics_2.wait(lk,  [this](){return !physicsSystemLocked;});
+	 	world.setSolver((SolverBackend)((PhysicsWorld::backend + 1) % SOLVER_COUNT));
+	 	lk.unlock();
+	 }
+	 else if (arg.key == OIS::KC_V) {
+	 	// Between steps, the next one rebuilds all rows in the other precision
+	 	std::unique_lock<std::mutex> lk(m_physics_2);
+	 	cv_physics_2.wait(lk,  [this](){return !physicsSystemLocked;});
+	 	world.setPrecision(world.getPrecision() == PRECISION_FLOAT ? PRECISION_DOUBLE : PRECISION_FLOAT);
+	 	lk.unlock();
+	 }
 }
 
 //---------------------------------------------------------------------------
@@ -9,42 +9,20 @@
 #define __RigidBodySystem_h_
 
 #include "BaseApplication.h"
-#include "RigidBody.h"
-#include "Contact.h"
+#include "PhysicsWorld.h"
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <btBulletDynamicsCommon.h>
 #include "OgreText.h"
 
 //---------------------------------------------------------------------------
-struct ContactInfo {
-	float pentrationError;
-	unsigned int numContacts;
-};
-
 class RigidBodySystem : public BaseApplication
 {
 public:
-	RigidBodySystem() {
-		broadphase = 0;
-		collisionConfiguration = 0;
-		dispatcher = 0;
-		collisionWorld = 0;
-	};
-	~RigidBodySystem() {
-		delete collisionWorld;
-		delete dispatcher;
-		delete collisionConfiguration;
-		delete broadphase;
-	};
-	static double dt;
-	static double bounce;
-	static double mu;
-	static double gravity;
+	RigidBodySystem() {};
+	~RigidBodySystem() {};
 private:
-	std::vector<RigidBody> bodies;
-	std::vector<Contact> contacts;
+	PhysicsWorld world;
 	std::map<Ogre::Entity*, unsigned long> pickBody;
 	Ogre::ManualObject* lineObject; //Draw the force line when an object is dragged
 	OgreText *textItem;
@@ -60,13 +38,6 @@ private:
 		return dx * forceMag;
 	}
 
-	void physicsInit(void);
-
-	btBroadphaseInterface* broadphase;
-	btDefaultCollisionConfiguration* collisionConfiguration;
-	btCollisionDispatcher* dispatcher;
-	btCollisionWorld* collisionWorld;
-
 protected:
     virtual void createScene(void);
     virtual void animate(void);
@@ -117,9 +88,4 @@ private:
 bool RigidBodySystem::captureFrames = false;
 bool RigidBodySystem::showBoundingBox = false;
 
-double RigidBodySystem::dt = 0.05;
-double RigidBodySystem::bounce = 0.0;
-double RigidBodySystem::mu = 0.33;
-double RigidBodySystem::gravity = -0.1;
-
 #endif
\ No newline at end of file
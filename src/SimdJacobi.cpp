@@ -0,0 +1,515 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+#include "SimdJacobi.h"
+#include "Contact.h"
+#include "ContactGraph.h"
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_JACOBI_X86
+#include <immintrin.h>
+#endif
+
+/* Order of the component arrays in rows, each row takes 6 arrays */
+enum {
+	NORMAL_D_A = 0, TANGENT_D_A = 6, NORMAL_D_B = 12, TANGENT_D_B = 18,
+	NORMAL_M_A = 24, TANGENT_M_A = 30, NORMAL_M_B = 36, TANGENT_M_B = 42,
+	B1 = 48, B2, MU, LAMBDA1, LAMBDA2, DELTA_LAMBDA1, DELTA_LAMBDA2,
+	DIRECTION1, DIRECTION2, // Lambda change of the last iteration, for JacobiAccel
+	NUM_ARRAYS
+};
+
+SimdIsa SimdTarget::isa = SimdTarget::detectIsa();
+
+SimdIsa SimdTarget::detectIsa() {
+#ifdef SIMD_JACOBI_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return SIMD_AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return SIMD_AVX2;
+#endif
+	return SIMD_SCALAR;
+}
+
+const char *SimdTarget::isaName(SimdIsa isa) {
+	switch (isa) {
+	case SIMD_AVX512: return "AVX-512";
+	case SIMD_AVX2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+static inline unsigned int roundUp(unsigned int n, unsigned int multiple) {
+	return (n + multiple - 1) / multiple * multiple;
+}
+
+static inline char *alignPtr(char *ptr) {
+	return (char *)(((size_t)ptr + SIMD_JACOBI_ALIGN - 1) & ~(size_t)(SIMD_JACOBI_ALIGN - 1));
+}
+
+template <typename T>
+SimdJacobi<T>::SimdJacobi() {
+	numContacts = numSlots = numBodies = 0;
+	capacity = bodyCapacity = 0;
+	contactMem = bodyMem = NULL;
+	rows = deltaVel = NULL;
+	indexA = indexB = NULL;
+}
+
+template <typename T>
+SimdJacobi<T>::~SimdJacobi() {
+	delete []contactMem;
+	delete []bodyMem;
+}
+
+template <typename T>
+void SimdJacobi<T>::reserve(unsigned int nContacts, unsigned int nBodies) {
+	if (nContacts > capacity) {
+		delete []contactMem;
+		capacity = roundUp(2 * nContacts, SIMD_JACOBI_PAD);
+		try {
+			contactMem = new char[(NUM_ARRAYS * sizeof(T) + 2 * sizeof(unsigned int)) * capacity + SIMD_JACOBI_ALIGN];
+		} catch(std::bad_alloc &xa) {
+			std::cerr<<"Couldn't Reallocate SIMD Contact rows"<<std::endl;
+			exit(0);
+		}
+		// Every array is a multiple of SIMD_JACOBI_PAD elements long, so all of them stay aligned
+		rows = (T *)alignPtr(contactMem);
+		indexA = (unsigned int *)(rows + (size_t)NUM_ARRAYS * capacity);
+		indexB = indexA + capacity;
+	}
+	if (nBodies > bodyCapacity) {
+		delete []bodyMem;
+		bodyCapacity = roundUp(2 * nBodies, SIMD_JACOBI_PAD);
+		try {
+			bodyMem = new char[6 * sizeof(T) * bodyCapacity + SIMD_JACOBI_ALIGN];
+		} catch(std::bad_alloc &xa) {
+			std::cerr<<"Couldn't Reallocate SIMD Delta Velocity stack"<<std::endl;
+			exit(0);
+		}
+		deltaVel = (T *)alignPtr(bodyMem);
+	}
+}
+
+template <typename T>
+static inline void transpose6(T *row, unsigned int i, const tvec6<T> &v, unsigned int stride) {
+	row[i] = v.vLin.x; row[stride + i] = v.vLin.y; row[2 * stride + i] = v.vLin.z;
+	row[3 * stride + i] = v.vAng.x; row[4 * stride + i] = v.vAng.y; row[5 * stride + i] = v.vAng.z;
+}
+
+template <typename T>
+void SimdJacobi<T>::load(unsigned int nContacts, const std::vector<ivec2> &bodyIndex,
+		const std::vector<vec6> &bufConstNormalD_A, const std::vector<vec6> &bufConstNormalM_A,
+		const std::vector<vec6> &bufConstTangentD_A, const std::vector<vec6> &bufConstTangentM_A,
+		const std::vector<vec6> &bufConstNormalD_B, const std::vector<vec6> &bufConstNormalM_B,
+		const std::vector<vec6> &bufConstTangentD_B, const std::vector<vec6> &bufConstTangentM_B,
+		const std::vector<vec2> &bufB, const std::vector<vec2> &bufLambda, const std::vector<vec2> &bufMaterial,
+		const std::vector<unsigned int> &islandOffset, const std::vector<unsigned int> &islandContacts) {
+	unsigned int numIslands = islandOffset.size() - 1;
+	islandSlot.resize(numIslands + 1);
+	islandSlot[0] = 0;
+	for (unsigned int k = 0; k < numIslands; k++)
+		islandSlot[k + 1] = islandSlot[k] + roundUp(islandOffset[k + 1] - islandOffset[k], SIMD_JACOBI_PAD);
+
+	numContacts = nContacts;
+	numSlots = islandSlot[numIslands];
+	reserve(numSlots, 0);
+	slotContact.resize(numSlots);
+
+	for (unsigned int k = 0; k < numIslands; k++) {
+		unsigned int slot = islandSlot[k];
+		for (unsigned int j = islandOffset[k]; j < islandOffset[k + 1]; j++, slot++) {
+			unsigned int i = islandContacts[j];
+			slotContact[slot] = i;
+			indexA[slot] = bodyIndex[i].indexA;
+			indexB[slot] = bodyIndex[i].indexB;
+			transpose6(row(NORMAL_D_A), slot, bufConstNormalD_A[i], capacity);
+			transpose6(row(TANGENT_D_A), slot, bufConstTangentD_A[i], capacity);
+			transpose6(row(NORMAL_D_B), slot, bufConstNormalD_B[i], capacity);
+			transpose6(row(TANGENT_D_B), slot, bufConstTangentD_B[i], capacity);
+			transpose6(row(NORMAL_M_A), slot, bufConstNormalM_A[i], capacity);
+			transpose6(row(TANGENT_M_A), slot, bufConstTangentM_A[i], capacity);
+			transpose6(row(NORMAL_M_B), slot, bufConstNormalM_B[i], capacity);
+			transpose6(row(TANGENT_M_B), slot, bufConstTangentM_B[i], capacity);
+			row(B1)[slot] = bufB[i].s1;
+			row(B2)[slot] = bufB[i].s2;
+			row(MU)[slot] = bufMaterial[i].s1;
+			row(LAMBDA1)[slot] = bufLambda[i].s1;
+			row(LAMBDA2)[slot] = bufLambda[i].s2;
+			row(DIRECTION1)[slot] = 0;
+			row(DIRECTION2)[slot] = 0;
+		}
+
+		// Every island starts on a vector boundary, its padding solves to zero and never moves a body
+		unsigned int end = islandSlot[k + 1];
+		for (unsigned int a = 0; a < NUM_ARRAYS; a++)
+			memset(row(a) + slot, 0, (end - slot) * sizeof(T));
+		memset(indexA + slot, 0, (end - slot) * sizeof(unsigned int));
+		memset(indexB + slot, 0, (end - slot) * sizeof(unsigned int));
+		for (; slot < end; slot++)
+			slotContact[slot] = SIMD_JACOBI_NO_CONTACT;
+	}
+}
+
+/* Pointers handed to the sweep kernels */
+template <typename T>
+struct SweepData {
+	T *rows;
+	size_t stride;
+	const unsigned int *indexA;
+	const unsigned int *indexB;
+	const T *deltaVel;
+	size_t bodyStride;
+
+	inline T *row(unsigned int array) const { return rows + array * stride; }
+	inline const T *velocity(unsigned int component) const { return deltaVel + component * bodyStride; }
+};
+
+/* First half of a Jacobi iteration, new lambda for contacts begin to end from the current deltaVel */
+template <typename T>
+static void sweepScalar(const SweepData<T> &s, unsigned int begin, unsigned int end, Residual &residual) {
+	for (unsigned int i = begin; i < end; i++) {
+		unsigned int a = s.indexA[i], b = s.indexB[i];
+		T lambda1 = s.row(LAMBDA1)[i], lambda2 = s.row(LAMBDA2)[i];
+		T lambda_final1 = lambda1 - s.row(B1)[i];
+		T lambda_final2 = lambda2 - s.row(B2)[i];
+		for (unsigned int c = 0; c < 6; c++) {
+			T va = s.velocity(c)[a], vb = s.velocity(c)[b];
+			lambda_final1 -= s.row(NORMAL_D_A + c)[i] * va + s.row(NORMAL_D_B + c)[i] * vb;
+			lambda_final2 -= s.row(TANGENT_D_A + c)[i] * va + s.row(TANGENT_D_B + c)[i] * vb;
+		}
+
+		if (lambda_final1 < 0) lambda_final1 = 0;
+		T max_tangent1 = s.row(MU)[i] * lambda_final1;
+		if (lambda_final2 < -max_tangent1) lambda_final2 = -max_tangent1;
+		else if (lambda_final2 > max_tangent1) lambda_final2 = max_tangent1;
+
+		s.row(DELTA_LAMBDA1)[i] = lambda_final1 - lambda1;
+		s.row(DELTA_LAMBDA2)[i] = lambda_final2 - lambda2;
+		s.row(LAMBDA1)[i] = lambda_final1;
+		s.row(LAMBDA2)[i] = lambda_final2;
+		residual.add(lambda_final1 - lambda1, lambda_final2 - lambda2, lambda_final1, lambda_final2);
+	}
+}
+
+#ifdef SIMD_JACOBI_X86
+/* Same as sweepScalar, 8 contacts at a time. begin and end must be multiples of 8. */
+__attribute__((target("avx2,fma")))
+static void sweepAvx2(const SweepData<float> &s, unsigned int begin, unsigned int end, Residual &residual) {
+	__m256 zero = _mm256_setzero_ps();
+	__m256 delta = zero, norm = zero;
+	for (unsigned int i = begin; i < end; i += 8) {
+		__m256i ia = _mm256_load_si256((const __m256i *)(s.indexA + i));
+		__m256i ib = _mm256_load_si256((const __m256i *)(s.indexB + i));
+		__m256 lambda1 = _mm256_load_ps(s.row(LAMBDA1) + i);
+		__m256 lambda2 = _mm256_load_ps(s.row(LAMBDA2) + i);
+		__m256 lambda_final1 = _mm256_sub_ps(lambda1, _mm256_load_ps(s.row(B1) + i));
+		__m256 lambda_final2 = _mm256_sub_ps(lambda2, _mm256_load_ps(s.row(B2) + i));
+		for (unsigned int c = 0; c < 6; c++) {
+			__m256 va = _mm256_i32gather_ps(s.velocity(c), ia, 4);
+			__m256 vb = _mm256_i32gather_ps(s.velocity(c), ib, 4);
+			lambda_final1 = _mm256_fnmadd_ps(_mm256_load_ps(s.row(NORMAL_D_A + c) + i), va, lambda_final1);
+			lambda_final1 = _mm256_fnmadd_ps(_mm256_load_ps(s.row(NORMAL_D_B + c) + i), vb, lambda_final1);
+			lambda_final2 = _mm256_fnmadd_ps(_mm256_load_ps(s.row(TANGENT_D_A + c) + i), va, lambda_final2);
+			lambda_final2 = _mm256_fnmadd_ps(_mm256_load_ps(s.row(TANGENT_D_B + c) + i), vb, lambda_final2);
+		}
+
+		lambda_final1 = _mm256_max_ps(lambda_final1, zero);
+		__m256 max_tangent1 = _mm256_mul_ps(_mm256_load_ps(s.row(MU) + i), lambda_final1);
+		lambda_final2 = _mm256_min_ps(_mm256_max_ps(lambda_final2, _mm256_sub_ps(zero, max_tangent1)), max_tangent1);
+
+		__m256 deltaLambda1 = _mm256_sub_ps(lambda_final1, lambda1);
+		__m256 deltaLambda2 = _mm256_sub_ps(lambda_final2, lambda2);
+		_mm256_store_ps(s.row(DELTA_LAMBDA1) + i, deltaLambda1);
+		_mm256_store_ps(s.row(DELTA_LAMBDA2) + i, deltaLambda2);
+		_mm256_store_ps(s.row(LAMBDA1) + i, lambda_final1);
+		_mm256_store_ps(s.row(LAMBDA2) + i, lambda_final2);
+
+		delta = _mm256_fmadd_ps(deltaLambda1, deltaLambda1, _mm256_fmadd_ps(deltaLambda2, deltaLambda2, delta));
+		norm = _mm256_fmadd_ps(lambda_final1, lambda_final1, _mm256_fmadd_ps(lambda_final2, lambda_final2, norm));
+	}
+
+	float sum[16];
+	_mm256_storeu_ps(sum, delta);
+	_mm256_storeu_ps(sum + 8, norm);
+	for (int k = 0; k < 8; k++) {
+		residual.delta += sum[k];
+		residual.norm += sum[8 + k];
+	}
+}
+
+/* Same as sweepScalar, 16 contacts at a time. begin and end must be multiples of 16. */
+__attribute__((target("avx512f")))
+static void sweepAvx512(const SweepData<float> &s, unsigned int begin, unsigned int end, Residual &residual) {
+	__m512 zero = _mm512_setzero_ps();
+	__m512 delta = zero, norm = zero;
+	for (unsigned int i = begin; i < end; i += 16) {
+		__m512i ia = _mm512_load_si512((const void *)(s.indexA + i));
+		__m512i ib = _mm512_load_si512((const void *)(s.indexB + i));
+		__m512 lambda1 = _mm512_load_ps(s.row(LAMBDA1) + i);
+		__m512 lambda2 = _mm512_load_ps(s.row(LAMBDA2) + i);
+		__m512 lambda_final1 = _mm512_sub_ps(lambda1, _mm512_load_ps(s.row(B1) + i));
+		__m512 lambda_final2 = _mm512_sub_ps(lambda2, _mm512_load_ps(s.row(B2) + i));
+		for (unsigned int c = 0; c < 6; c++) {
+			__m512 va = _mm512_i32gather_ps(ia, s.velocity(c), 4);
+			__m512 vb = _mm512_i32gather_ps(ib, s.velocity(c), 4);
+			lambda_final1 = _mm512_fnmadd_ps(_mm512_load_ps(s.row(NORMAL_D_A + c) + i), va, lambda_final1);
+			lambda_final1 = _mm512_fnmadd_ps(_mm512_load_ps(s.row(NORMAL_D_B + c) + i), vb, lambda_final1);
+			lambda_final2 = _mm512_fnmadd_ps(_mm512_load_ps(s.row(TANGENT_D_A + c) + i), va, lambda_final2);
+			lambda_final2 = _mm512_fnmadd_ps(_mm512_load_ps(s.row(TANGENT_D_B + c) + i), vb, lambda_final2);
+		}
+
+		lambda_final1 = _mm512_max_ps(lambda_final1, zero);
+		__m512 max_tangent1 = _mm512_mul_ps(_mm512_load_ps(s.row(MU) + i), lambda_final1);
+		lambda_final2 = _mm512_min_ps(_mm512_max_ps(lambda_final2, _mm512_sub_ps(zero, max_tangent1)), max_tangent1);
+
+		__m512 deltaLambda1 = _mm512_sub_ps(lambda_final1, lambda1);
+		__m512 deltaLambda2 = _mm512_sub_ps(lambda_final2, lambda2);
+		_mm512_store_ps(s.row(DELTA_LAMBDA1) + i, deltaLambda1);
+		_mm512_store_ps(s.row(DELTA_LAMBDA2) + i, deltaLambda2);
+		_mm512_store_ps(s.row(LAMBDA1) + i, lambda_final1);
+		_mm512_store_ps(s.row(LAMBDA2) + i, lambda_final2);
+
+		delta = _mm512_fmadd_ps(deltaLambda1, deltaLambda1, _mm512_fmadd_ps(deltaLambda2, deltaLambda2, delta));
+		norm = _mm512_fmadd_ps(lambda_final1, lambda_final1, _mm512_fmadd_ps(lambda_final2, lambda_final2, norm));
+	}
+
+	float sum[32];
+	_mm512_storeu_ps(sum, delta);
+	_mm512_storeu_ps(sum + 16, norm);
+	for (int k = 0; k < 16; k++) {
+		residual.delta += sum[k];
+		residual.norm += sum[16 + k];
+	}
+}
+#endif
+
+/*
+ * NNCG step between the two halves of an iteration. Lambda moves on by beta along the previous direction,
+ * the total change including the sweep becomes the new direction and is what scatter applies.
+ */
+template <typename T>
+static void momentum(const SweepData<T> &s, unsigned int begin, unsigned int end, T beta) {
+	T *lambda1 = s.row(LAMBDA1), *lambda2 = s.row(LAMBDA2);
+	T *deltaLambda1 = s.row(DELTA_LAMBDA1), *deltaLambda2 = s.row(DELTA_LAMBDA2);
+	T *direction1 = s.row(DIRECTION1), *direction2 = s.row(DIRECTION2);
+	for (unsigned int i = begin; i < end; i++) {
+		T step1 = beta * direction1[i], step2 = beta * direction2[i];
+		lambda1[i] += step1;
+		lambda2[i] += step2;
+		direction1[i] = deltaLambda1[i] += step1;
+		direction2[i] = deltaLambda2[i] += step2;
+	}
+}
+
+/* Chebyshev step between the two halves, blends in the iteration before by omega and projects again */
+template <typename T>
+static void chebyshev(const SweepData<T> &s, unsigned int begin, unsigned int end, T omega) {
+	T *lambda1 = s.row(LAMBDA1), *lambda2 = s.row(LAMBDA2);
+	T *deltaLambda1 = s.row(DELTA_LAMBDA1), *deltaLambda2 = s.row(DELTA_LAMBDA2);
+	T *direction1 = s.row(DIRECTION1), *direction2 = s.row(DIRECTION2);
+	const T *mu = s.row(MU);
+	for (unsigned int i = begin; i < end; i++) {
+		T old1 = lambda1[i] - deltaLambda1[i], old2 = lambda2[i] - deltaLambda2[i];
+		T final1 = std::max(lambda1[i] + (omega - 1) * (deltaLambda1[i] + direction1[i]), (T)0);
+		T maxTangent = mu[i] * final1;
+		T final2 = std::min(std::max(lambda2[i] + (omega - 1) * (deltaLambda2[i] + direction2[i]), -maxTangent), maxTangent);
+		direction1[i] = deltaLambda1[i] = final1 - old1;
+		direction2[i] = deltaLambda2[i] = final2 - old2;
+		lambda1[i] = final1;
+		lambda2[i] = final2;
+	}
+}
+
+template <typename T>
+static inline void accelerate(const SweepData<T> &s, unsigned int begin, unsigned int end, JacobiAccel mode, T factor) {
+	if (mode == ACCEL_NNCG)
+		momentum(s, begin, end, factor);
+	else
+		chebyshev(s, begin, end, factor);
+}
+
+/* Second half of a Jacobi iteration, add deltaLambda of contacts begin to end to the 6 arrays at target */
+template <typename T>
+void SimdJacobi<T>::scatter(unsigned int begin, unsigned int end, T *target) const {
+	const T *deltaLambda1 = row(DELTA_LAMBDA1);
+	const T *deltaLambda2 = row(DELTA_LAMBDA2);
+	for (unsigned int c = 0; c < 6; c++) {
+		T *v = target + (size_t)c * bodyCapacity;
+		const T *normalA = row(NORMAL_M_A + c), *tangentA = row(TANGENT_M_A + c);
+		const T *normalB = row(NORMAL_M_B + c), *tangentB = row(TANGENT_M_B + c);
+		for (unsigned int i = begin; i < end; i++) {
+			v[indexA[i]] += normalA[i] * deltaLambda1[i] + tangentA[i] * deltaLambda2[i];
+			v[indexB[i]] += normalB[i] * deltaLambda1[i] + tangentB[i] * deltaLambda2[i];
+		}
+	}
+}
+
+/* Jacobi sweep over slots begin to end, double rows have no vector path */
+template <typename T>
+static inline void sweep(const SweepData<T> &s, unsigned int begin, unsigned int end, Residual &residual) {
+	sweepScalar(s, begin, end, residual);
+}
+
+/* Jacobi sweep over float slots begin to end with the selected instruction set */
+static inline void sweep(const SweepData<float> &s, unsigned int begin, unsigned int end, Residual &residual) {
+	switch (SimdTarget::isa) {
+#ifdef SIMD_JACOBI_X86
+	case SIMD_AVX512:
+		sweepAvx512(s, begin, end, residual);
+		break;
+	case SIMD_AVX2:
+		sweepAvx2(s, begin, end, residual);
+		break;
+#endif
+	default:
+		sweepScalar(s, begin, end, residual);
+	}
+}
+
+/* Adds the accumulated change of bodies begin to end of the list to deltaVel and clears it */
+template <typename T>
+void SimdJacobi<T>::apply(T *accumulator, const unsigned int *bodyList, unsigned int begin, unsigned int end) {
+	for (unsigned int c = 0; c < 6; c++) {
+		T *v = velocity(c);
+		T *a = accumulator + (size_t)c * bodyCapacity;
+		for (unsigned int k = begin; k < end; k++) {
+			unsigned int i = bodyList[k];
+			v[i] += a[i];
+			a[i] = 0;
+		}
+	}
+}
+
+template <typename T>
+unsigned int SimdJacobi<T>::solve(unsigned int nBody, std::vector<vec6> &bufDeltaVel, std::vector<vec2> &bufLambda,
+		unsigned int iterCount, double tolerance, JacobiAccel accel, ThreadPool &pool,
+		const std::vector<unsigned int> &islandBodyOffset, const std::vector<unsigned int> &islandBodies) {
+	reserve(0, nBody);
+	numBodies = nBody;
+
+	for (unsigned int i = 0; i < nBody; i++) {
+		velocity(0)[i] = bufDeltaVel[i].vLin.x; velocity(1)[i] = bufDeltaVel[i].vLin.y; velocity(2)[i] = bufDeltaVel[i].vLin.z;
+		velocity(3)[i] = bufDeltaVel[i].vAng.x; velocity(4)[i] = bufDeltaVel[i].vAng.y; velocity(5)[i] = bufDeltaVel[i].vAng.z;
+	}
+
+	unsigned int nThreads = pool.size();
+	size_t accumulatorSize = (size_t)6 * bodyCapacity;
+	if (accumulators.size() != nThreads * accumulatorSize)
+		accumulators.assign(nThreads * accumulatorSize, 0);
+
+	SweepData<T> s;
+	s.rows = rows;
+	s.stride = capacity;
+	s.indexA = indexA;
+	s.indexB = indexB;
+	s.deltaVel = deltaVel;
+	s.bodyStride = bodyCapacity;
+
+	/* Islands are sorted largest first, the large ones are split across the pool one at a time */
+	unsigned int numIslands = islandSlot.size() - 1;
+	unsigned int numLarge = 0;
+	while (nThreads > 1 && numLarge < numIslands && islandSlot[numLarge + 1] - islandSlot[numLarge] >= ISLAND_SPLIT_SIZE)
+		numLarge++;
+
+	islandIterations.assign(numIslands, iterCount);
+	std::atomic<unsigned int> nextIsland(numLarge);
+	SpinBarrier barrier(nThreads);
+	std::vector<Residual> partial(2 * nThreads); // Double buffered by iteration, see below
+
+	pool.run([&](unsigned int threadId, unsigned int nThreads) {
+		T *accumulator = &accumulators[threadId * accumulatorSize];
+		unsigned int phase = 0; // Iterations run so far over all large islands, the same on every thread
+
+		for (unsigned int k = 0; k < numLarge; k++) {
+			// Contact ranges start on a vector boundary, padding solves to zero
+			unsigned int first = islandSlot[k], span = islandSlot[k + 1] - first;
+			unsigned int chunk = roundUp((span + nThreads - 1) / nThreads, SIMD_JACOBI_PAD);
+			unsigned int begin = first + std::min(span, threadId * chunk);
+			unsigned int end = std::min(first + span, begin + chunk);
+			unsigned int bodyFirst = islandBodyOffset[k], bodySpan = islandBodyOffset[k + 1] - bodyFirst;
+			unsigned int bodyChunk = (bodySpan + nThreads - 1) / nThreads;
+			unsigned int bodyBegin = bodyFirst + std::min(bodySpan, threadId * bodyChunk);
+			unsigned int bodyEnd = std::min(bodyFirst + bodySpan, bodyBegin + bodyChunk);
+
+			AccelSchedule schedule(accel);
+			for (unsigned int iter = 0; iter < iterCount; iter++, phase++) {
+				Residual residual;
+				sweep(s, begin, end, residual);
+
+				// A thread can be one iteration ahead writing partial while others still read it, hence two sets
+				partial[(phase & 1) * nThreads + threadId] = residual;
+				if (accel != ACCEL_NONE) {
+					// The factor depends on the change over the whole island, which is known only after the barrier
+					barrier.wait();
+					Residual total;
+					for (unsigned int t = 0; t < nThreads; t++)
+						total.add(partial[(phase & 1) * nThreads + t]);
+					double factor;
+					if (!total.converged(tolerance) && iter + 1 < iterCount && schedule.next(total.delta, factor))
+						accelerate(s, begin, end, accel, (T)factor);
+				}
+				scatter(begin, end, accumulator);
+				barrier.wait();
+
+				// Every thread reduces its own slice of the island's bodies over all accumulators
+				for (unsigned int t = 0; t < nThreads; t++)
+					apply(&accumulators[t * accumulatorSize], &islandBodies[0], bodyBegin, bodyEnd);
+				barrier.wait();
+
+				Residual total;
+				for (unsigned int t = 0; t < nThreads; t++)
+					total.add(partial[(phase & 1) * nThreads + t]);
+				if (total.converged(tolerance)) {
+					if (threadId == 0) islandIterations[k] = iter + 1;
+					phase++;
+					break;
+				}
+			}
+		}
+
+		// Small islands go whole to whichever thread is free, no barriers
+		for (unsigned int k = nextIsland++; k < numIslands; k = nextIsland++) {
+			AccelSchedule schedule(accel);
+			for (unsigned int iter = 0; iter < iterCount; iter++) {
+				Residual residual;
+				double factor;
+				sweep(s, islandSlot[k], islandSlot[k + 1], residual);
+				if (accel != ACCEL_NONE && !residual.converged(tolerance) && iter + 1 < iterCount && schedule.next(residual.delta, factor))
+					accelerate(s, islandSlot[k], islandSlot[k + 1], accel, (T)factor);
+				scatter(islandSlot[k], islandSlot[k + 1], accumulator);
+				apply(accumulator, &islandBodies[0], islandBodyOffset[k], islandBodyOffset[k + 1]);
+				if (residual.converged(tolerance)) {
+					islandIterations[k] = iter + 1;
+					break;
+				}
+			}
+		}
+	});
+
+	for (unsigned int slot = 0; slot < numSlots; slot++) {
+		if (slotContact[slot] == SIMD_JACOBI_NO_CONTACT)
+			continue;
+		bufLambda[slotContact[slot]].s1 = row(LAMBDA1)[slot];
+		bufLambda[slotContact[slot]].s2 = row(LAMBDA2)[slot];
+	}
+	for (unsigned int i = 0; i < nBody; i++) {
+		bufDeltaVel[i].vLin = glm::tvec3<T>(velocity(0)[i], velocity(1)[i], velocity(2)[i]);
+		bufDeltaVel[i].vAng = glm::tvec3<T>(velocity(3)[i], velocity(4)[i], velocity(5)[i]);
+	}
+
+	unsigned int iterations = 0;
+	for (unsigned int k = 0; k < numIslands; k++)
+		iterations = std::max(iterations, islandIterations[k]);
+	return iterations;
+}
+
+template class SimdJacobi<float>;
+template class SimdJacobi<double>;
@@ -0,0 +1,94 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+#ifndef __SimdJacobi_h_
+#define __SimdJacobi_h_
+
+#include <vector>
+#include "DataType.h"
+#include "ThreadPool.h"
+#include "JacobiAccel.h"
+
+#define SIMD_JACOBI_ALIGN 64 // Bytes, one AVX-512 register or cache line
+#define SIMD_JACOBI_PAD 16 // Islands and bodies are padded to a multiple of the widest vector
+#define SIMD_JACOBI_NO_CONTACT 0xFFFFFFFF // Padding slot
+
+/* Instruction set used by SimdJacobi::solve, ordered by width */
+enum SimdIsa {
+	SIMD_SCALAR,
+	SIMD_AVX2, // 8 floats per instruction
+	SIMD_AVX512 // 16 floats per instruction
+};
+
+/* Instruction set of the float solver, shared by all instances */
+struct SimdTarget {
+	static SimdIsa isa; // Defaults to the widest supported by this CPU
+	static SimdIsa detectIsa();
+	static const char *isaName(SimdIsa isa);
+};
+
+/*
+ * Projected Jacobi on the CPU over the contact buffers of the OpenCL path. load() transposes the vec6
+ * rows into a structure of arrays with one aligned array per component, so a vector register holds the
+ * same component of 8 or 16 contacts. Reading deltaVel is a gather, writing it back is a scalar loop
+ * since contacts in one vector may share a body. Double rows always take the scalar path.
+ * Contacts are stored island by island, every island converges on its own.
+ */
+template <typename T>
+class SimdJacobi : public SimdTarget {
+	typedef tvec6<T> vec6;
+	typedef tvec2<T> vec2;
+
+	unsigned int numContacts;
+	unsigned int numSlots; // Contacts plus the padding after every island
+	unsigned int numBodies;
+	unsigned int capacity; // Slots
+	unsigned int bodyCapacity; // Bodies, padded
+
+	char *contactMem;
+	char *bodyMem;
+	T *rows; // Component arrays of capacity scalars, see SimdJacobi.cpp for the order
+	unsigned int *indexA;
+	unsigned int *indexB;
+	T *deltaVel; // 6 arrays of bodyCapacity scalars
+	std::vector<T> accumulators; // Private deltaVel change of every thread, same layout as deltaVel
+	std::vector<unsigned int> slotContact; // Contact index of every slot
+	std::vector<unsigned int> islandSlot; // Island k spans slots islandSlot[k] to islandSlot[k + 1] - 1
+	std::vector<unsigned int> islandIterations;
+
+	inline T *row(unsigned int array) const { return rows + (size_t)array * capacity; }
+	inline T *velocity(unsigned int component) const { return deltaVel + (size_t)component * bodyCapacity; }
+
+	void reserve(unsigned int numContacts, unsigned int numBodies);
+	void scatter(unsigned int begin, unsigned int end, T *target) const;
+	void apply(T *accumulator, const unsigned int *bodyList, unsigned int begin, unsigned int end);
+
+public:
+	SimdJacobi();
+	~SimdJacobi();
+
+	/* Copy the contact rows into the SoA layout in island order, same inputs as OclCompute::_0_run */
+	void load(unsigned int nContacts, const std::vector<ivec2> &bodyIndex,
+			const std::vector<vec6> &bufConstNormalD_A, const std::vector<vec6> &bufConstNormalM_A,
+			const std::vector<vec6> &bufConstTangentD_A, const std::vector<vec6> &bufConstTangentM_A,
+			const std::vector<vec6> &bufConstNormalD_B, const std::vector<vec6> &bufConstNormalM_B,
+			const std::vector<vec6> &bufConstTangentD_B, const std::vector<vec6> &bufConstTangentM_B,
+			const std::vector<vec2> &bufB, const std::vector<vec2> &bufLambda, const std::vector<vec2> &bufMaterial,
+			const std::vector<unsigned int> &islandOffset, const std::vector<unsigned int> &islandContacts);
+
+	/*
+	 * Iterates on the loaded contacts starting from deltaVel, returns the most iterations any island ran.
+	 * Large islands are split across the pool, every thread scatters into its own accumulator and the
+	 * accumulators are summed into deltaVel once per iteration, so there are no locks or atomics. Small
+	 * islands are solved whole by one thread. Island bodies are the lists from ContactGraph::buildIslands.
+	 * accel runs between the sweeps of every island, with its own schedule per island.
+	 */
+	unsigned int solve(unsigned int nBody, std::vector<vec6> &deltaVel, std::vector<vec2> &bufLambda,
+			unsigned int iterCount, double tolerance, JacobiAccel accel, ThreadPool &pool,
+			const std::vector<unsigned int> &islandBodyOffset, const std::vector<unsigned int> &islandBodies);
+};
+
+#endif
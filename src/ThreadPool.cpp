@@ -0,0 +1,75 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int numThreads) {
+	job = NULL;
+	generation = 0;
+	pending = 0;
+	quit = false;
+
+	if (numThreads == 0)
+		numThreads = std::thread::hardware_concurrency();
+	if (numThreads == 0)
+		numThreads = 1;
+
+	for (unsigned int i = 1; i < numThreads; i++)
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lk(m);
+		quit = true;
+	}
+	cvStart.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+void ThreadPool::workerLoop(unsigned int threadId) {
+	unsigned long seen = 0;
+	while (1) {
+		const std::function<void(unsigned int, unsigned int)> *fn;
+		{
+			std::unique_lock<std::mutex> lk(m);
+			cvStart.wait(lk, [&]{return quit || generation != seen;});
+			if (quit)
+				return;
+			seen = generation;
+			fn = job;
+		}
+
+		(*fn)(threadId, size());
+
+		{
+			std::lock_guard<std::mutex> lk(m);
+			if (--pending == 0)
+				cvDone.notify_one();
+		}
+	}
+}
+
+void ThreadPool::run(const std::function<void(unsigned int, unsigned int)> &fn) {
+	if (workers.empty()) {
+		fn(0, 1);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lk(m);
+		job = &fn;
+		pending = workers.size();
+		generation++;
+	}
+	cvStart.notify_all();
+
+	fn(0, size());
+
+	std::unique_lock<std::mutex> lk(m);
+	cvDone.wait(lk, [&]{return pending == 0;});
+}
@@ -0,0 +1,67 @@
+/*
+ * This software is Copyright (c) 2017 Sayantan Datta <std2048 at gmail dot com>
+ * and it is hereby released to the general public under the following terms:
+ * Redistribution and use in source and binary forms, with or without modification, are permitted for non-profit
+ * and non-commericial purposes.
+ */
+#ifndef __ThreadPool_h_
+#define __ThreadPool_h_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/*
+ * Sense reversing spin barrier. Solver sweeps sync once per color, far too often to go through the
+ * kernel, so waiting threads spin and yield instead of sleeping.
+ */
+class SpinBarrier {
+	unsigned int numThreads;
+	std::atomic<unsigned int> count;
+	std::atomic<unsigned int> sense;
+public:
+	SpinBarrier(unsigned int numThreads) : numThreads(numThreads), count(0), sense(0) {}
+
+	inline void wait() {
+		unsigned int mySense = sense.load(std::memory_order_relaxed);
+		if (count.fetch_add(1, std::memory_order_acq_rel) == numThreads - 1) {
+			count.store(0, std::memory_order_relaxed);
+			sense.store(mySense ^ 1, std::memory_order_release);
+		}
+		else {
+			unsigned int spin = 0;
+			while (sense.load(std::memory_order_acquire) == mySense)
+				if (++spin > 1024) std::this_thread::yield();
+		}
+	}
+};
+
+/*
+ * Persistent worker threads. run() wakes the workers once, executes fn(threadId, numThreads) on every
+ * worker and on the calling thread (threadId 0) and returns when all of them are done.
+ */
+class ThreadPool {
+	std::vector<std::thread> workers;
+	std::mutex m;
+	std::condition_variable cvStart;
+	std::condition_variable cvDone;
+
+	const std::function<void(unsigned int, unsigned int)> *job;
+	unsigned long generation;
+	unsigned int pending;
+	bool quit;
+
+	void workerLoop(unsigned int threadId);
+public:
+	/* numThreads includes the calling thread, 0 uses all hardware threads */
+	ThreadPool(unsigned int numThreads = 0);
+	~ThreadPool();
+
+	inline unsigned int size() const { return workers.size() + 1; }
+	void run(const std::function<void(unsigned int, unsigned int)> &fn);
+};
+
+#endif